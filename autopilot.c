@@ -0,0 +1,216 @@
+/*
+ * autopilot.c
+ *
+ * Attract mode player - see autopilot.h.
+ */
+
+#include <stdlib.h>
+#include <avr/pgmspace.h>
+
+#include "autopilot.h"
+#include "game.h"
+
+// The hops weighed up, in order of preference when they are as good
+#define NUM_MOVES 5
+static const uint8_t moves[NUM_MOVES] PROGMEM = {
+	MOVE_FORWARD, MOVE_NONE, MOVE_LEFT, MOVE_RIGHT, MOVE_BACKWARD
+};
+
+// Scrolls counted ahead at most - enough to tell that a frog would be
+// carried off a log (more than 16) however few there were up to the first
+// tick looked at (fewer than 16, or the row is all danger by then)
+#define MAX_SCROLLS 32
+
+static uint32_t hop_time;
+static uint8_t planning;
+// Where the frog will be at hop_time (moved along by its log)
+static int8_t start_row;
+static int8_t start_column;
+// The next hop to weigh up, and the best so far
+static uint8_t candidate;
+static uint8_t best_move;
+static int16_t best_value;
+
+// The scroll times and ms between hops being weighed up with
+static const uint32_t* scroll_time;
+static const uint16_t* period;
+static const int8_t* direction;
+static uint32_t hop_period;
+
+static void hop_by(uint8_t move, int8_t* row, int8_t* column);
+static int16_t weigh_up(int8_t row, int8_t column, uint32_t from, uint8_t hops);
+static uint8_t survives(int8_t row, int8_t* column, uint32_t from, uint32_t to);
+static uint8_t scrolls_by(uint8_t i, uint32_t tick);
+static uint16_t shift_mask(uint16_t mask, int8_t way, uint8_t n);
+
+void autopilot_start(uint32_t tick) {
+	hop_time = tick + AUTOPILOT_PERIOD;
+	planning = 0;
+}
+
+uint8_t autopilot_step(uint32_t tick, const uint32_t* next_scroll_time,
+		const uint16_t* scroll_period, const int8_t* scroll_direction) {
+	int8_t row, column;
+	int16_t value;
+	uint8_t move;
+
+	scroll_time = next_scroll_time;
+	period = scroll_period;
+	direction = scroll_direction;
+	hop_period = AUTOPILOT_PERIOD;
+
+	if(!planning) {
+		// Start planning a few ticks before the hop, from where the frog
+		// will be then
+		if((int32_t)(hop_time - tick) > NUM_MOVES) {
+			return MOVE_NONE;
+		}
+		start_row = (int8_t)get_frog_row(0);
+		start_column = (int8_t)get_frog_column(0);
+		if(start_row >= 0 && start_row < get_level_rows()) {
+			(void)survives(start_row, &start_column, tick, hop_time);
+		}
+		candidate = 0;
+		best_value = AUTOPILOT_DEAD - 1;
+		best_move = MOVE_NONE;
+		planning = 1;
+		return MOVE_NONE;
+	}
+	if(candidate < NUM_MOVES) {
+		move = pgm_read_byte(&moves[candidate++]);
+		row = start_row;
+		column = start_column;
+		hop_by(move, &row, &column);
+		value = weigh_up(row, column, hop_time, 2);
+		if(value > best_value) {
+			best_value = value;
+			best_move = move;
+		}
+		return MOVE_NONE;
+	}
+	if((int32_t)(tick - hop_time) < 0) {
+		return MOVE_NONE;
+	}
+	planning = 0;
+	hop_time = tick + AUTOPILOT_PERIOD;
+	// The plan is no good if the frog isn't where it expected (it died)
+	if((int8_t)get_frog_row(0) != start_row || (int8_t)get_frog_column(0) != start_column) {
+		return MOVE_NONE;
+	}
+	return best_move;
+}
+
+int16_t autopilot_weigh_up(int8_t row, int8_t column, uint32_t from, uint32_t hop_period_ms,
+		uint8_t hops, const uint32_t* next_scroll_time, const uint16_t* scroll_period,
+		const int8_t* scroll_direction) {
+	scroll_time = next_scroll_time;
+	period = scroll_period;
+	direction = scroll_direction;
+	hop_period = hop_period_ms;
+	return weigh_up(row, column, from, hops);
+}
+
+static void hop_by(uint8_t move, int8_t* row, int8_t* column) {
+	switch(move) {
+		case MOVE_FORWARD:
+		(*row)++;
+		break;
+		case MOVE_BACKWARD:
+		(*row)--;
+		break;
+		case MOVE_LEFT:
+		(*column)--;
+		break;
+		case MOVE_RIGHT:
+		(*column)++;
+		break;
+	}
+}
+
+// How good it is for the frog to hop to the given place at tick from, then
+// make the best of the hops after it (hops counts this one)
+static int16_t weigh_up(int8_t row, int8_t column, uint32_t from, uint8_t hops) {
+	int16_t value, best = AUTOPILOT_DEAD;
+	int8_t next_row, next_column;
+
+	if(row < 0 || row >= get_level_rows() || column < 0 || column > 15) {
+		return AUTOPILOT_DEAD;
+	}
+	if(row == get_level_rows() - 1) {
+		// The riverbank - a free hole or the edge
+		return ((get_row_danger(row) >> column) & 1) ? AUTOPILOT_DEAD : AUTOPILOT_HOME;
+	}
+	if(!survives(row, &column, from, from + hop_period)) {
+		return AUTOPILOT_DEAD;
+	}
+	if(hops <= 1) {
+		return row * 32 + 16 - abs(2 * column - 15);
+	}
+	for(uint8_t i = 0; i < NUM_MOVES; i++) {
+		next_row = row;
+		next_column = column;
+		hop_by(pgm_read_byte(&moves[i]), &next_row, &next_column);
+		value = weigh_up(next_row, next_column, from + hop_period, hops - 1);
+		if(value > best) {
+			best = value;
+		}
+	}
+	return best;
+}
+
+// Whether a frog which gets to the given place at tick from will still be
+// alive at tick to if it stays there, going by where the row will have
+// scrolled to. In the river the frog goes with the log, so *column is
+// moved along.
+static uint8_t survives(int8_t row, int8_t* column, uint32_t from, uint32_t to) {
+	int8_t i = get_row_scrolling(row);
+	uint16_t mask = get_row_danger(row);
+	uint8_t scrolls;
+	int8_t way;
+
+	if(i < 0) {
+		return !((mask >> *column) & 1);
+	}
+	way = (int8_t)pgm_read_byte(&direction[i]);
+	mask = shift_mask(mask, way, scrolls_by(i, from));
+	if((mask >> *column) & 1) {
+		return 0;
+	}
+	scrolls = scrolls_by(i, to) - scrolls_by(i, from);
+	if(i >= 3) {
+		*column += way * (int8_t)scrolls;
+		return *column >= 0 && *column <= 15;
+	}
+	while(scrolls--) {
+		mask = shift_mask(mask, way, 1);
+		if((mask >> *column) & 1) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// The number of times scrolling row i will scroll from now up to and
+// including the given tick, up to MAX_SCROLLS (counted rather than divided
+// out - the ticks the attract mode looks at are never more than a few
+// scrolls away)
+static uint8_t scrolls_by(uint8_t i, uint32_t tick) {
+	uint8_t scrolls = 0;
+	for(uint32_t time = scroll_time[i]; (int32_t)(tick - time) >= 0 && scrolls < MAX_SCROLLS;
+			time += period[i]) {
+		scrolls++;
+	}
+	return scrolls;
+}
+
+// A row's danger mask after it scrolls n times the given way. What comes
+// on from off the display isn't known, so is taken to be deadly.
+static uint16_t shift_mask(uint16_t mask, int8_t way, uint8_t n) {
+	if(n >= 16) {
+		return 0xFFFF;
+	}
+	while(n--) {
+		mask = way > 0 ? (mask << 1) | 0x0001 : (mask >> 1) | 0x8000;
+	}
+	return mask;
+}
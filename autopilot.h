@@ -0,0 +1,55 @@
+/*
+ * autopilot.h
+ *
+ * A computer player for the attract mode - the game playing itself behind
+ * the splash screen. It hops frog 0 every AUTOPILOT_PERIOD ms, choosing
+ * the hop from what it can see of the level (the danger masks of the rows
+ * - see get_row_danger() in game.h) and when each row will next scroll:
+ * each hop is weighed up by where the frog lands and whether it will still
+ * be alive there at the next hop (moved along by its log in the river), and
+ * then the same for the best hop after that. What scrolls on from off the
+ * display is taken to be deadly, and hazards stepping aren't foreseen.
+ *
+ * The planning is spread over the few ticks before a hop - each call to
+ * autopilot_step() weighs up at most one hop (AUTOPILOT_CHECKS positions),
+ * so a call takes a bounded number of cycles however the game stands (see
+ * bench/bench.c). The main loop calls it once the game is up to date, so
+ * it never holds up a scroll.
+ */
+
+#ifndef AUTOPILOT_H_
+#define AUTOPILOT_H_
+
+#include <stdint.h>
+
+#define AUTOPILOT_PERIOD 250	// ms between hops
+// The most positions checked by a call to autopilot_step() - the hop and
+// each hop after it
+#define AUTOPILOT_CHECKS 6
+
+// Start hopping in a new game (tick is the game clock now)
+void autopilot_start(uint32_t tick);
+
+// Plan a little more on the given tick. Returns the move to make now -
+// MOVE_NONE (game.h) on most ticks. next_scroll_time[] and scroll_period[]
+// are the game clock time each scrolling row next scrolls and the ms
+// between its scrolls; scroll_direction[] (in program memory) is the way
+// each one scrolls.
+uint8_t autopilot_step(uint32_t tick, const uint32_t* next_scroll_time,
+		const uint16_t* scroll_period, const int8_t* scroll_direction);
+
+// How good it is for frog 0 to hop to the given place at tick from, then
+// make the best of the hops after it, hop_period ms apart (hops counts
+// this one) - AUTOPILOT_HOME for a hop into a riverbank hole,
+// AUTOPILOT_DEAD if the frog dies whatever it does, otherwise more the
+// further up and nearer the middle it ends up. The scroll times are as
+// for autopilot_step(). The time taken goes up fivefold with each hop
+// (autopilot_step() looks two ahead). host/difficulty.c's lookahead player
+// weighs up its moves with this too.
+#define AUTOPILOT_HOME 1000
+#define AUTOPILOT_DEAD (-1)
+int16_t autopilot_weigh_up(int8_t row, int8_t column, uint32_t from, uint32_t hop_period,
+		uint8_t hops, const uint32_t* next_scroll_time, const uint16_t* scroll_period,
+		const int8_t* scroll_direction);
+
+#endif /* AUTOPILOT_H_ */
@@ -0,0 +1,100 @@
+/*
+ * bench.c
+ *
+ * Benchmark scenarios, run at power up in a benchmark build (BENCH
+ * defined) before the game starts. Each exercises one of the per-tick
+ * routines BENCH_REPEATS times so bench/simavr_bench.c can count the
+ * cycles each call takes. The game then starts as normal and the
+ * simulator measures the main loop as well.
+ *
+ * Interrupts are off except for show_score(), which needs the UART
+ * interrupt to empty the output buffer (it is emptied before each call so
+ * every call sees the same state), and the save states, which need the
+ * EEPROM interrupt too. (The save states written take the place of any
+ * game saved in EEPROM.)
+ */
+
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "autopilot.h"
+#include "eeprom_writer.h"
+#include "game.h"
+#include "savestate.h"
+#include "score.h"
+#include "serialio.h"
+#include "step.h"
+#include "terminalio.h"
+
+#define BENCH_REPEATS 32
+// Each save state takes about a quarter of a second to write to EEPROM
+#define SAVESTATE_REPEATS 4
+#define SERIAL_BUFFER_EMPTY 255
+
+// A scroll schedule for the autopilot - the rows scroll at their level 1
+// speeds (step.h), the first at BENCH_FIRST_SCROLL and each of the rest
+// BENCH_SCROLL_STAGGER ms after the one before
+#define BENCH_FIRST_SCROLL 100
+#define BENCH_SCROLL_STAGGER 250
+
+void run_benchmarks(void) {
+	uint32_t* scroll_time = get_scroll_times();
+	uint8_t i;
+
+	initialise_game();
+	init_score();
+	reset_speeds();
+	for(i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		scroll_time[i] = BENCH_FIRST_SCROLL + i * BENCH_SCROLL_STAGGER;
+	}
+
+	cli();
+	// Lanes and logs with the frog on the roadside
+	for(i = 0; i < BENCH_REPEATS; i++) {
+		scroll_vehicle_lane(i % 3, (i & 4) ? 1 : -1);
+		scroll_river_channel(i & 1, (i & 2) ? 1 : -1);
+	}
+	// Side to side (a collision check each move)
+	for(i = 0; i < BENCH_REPEATS; i++) {
+		move_frog(0, MOVE_LEFT);
+		move_frog(0, MOVE_RIGHT);
+	}
+	// The frog in the first lane - each scroll checks for a collision
+	move_frog(0, MOVE_FORWARD);
+	for(i = 0; i < BENCH_REPEATS; i++) {
+		scroll_vehicle_lane(0, 1);
+	}
+	// The autopilot through a few hops - 8 ticks up to each one, taking in
+	// the planning (and a tick or two before it)
+	initialise_game();
+	autopilot_start(0);
+	for(i = 0; i < BENCH_REPEATS; i++) {
+		(void)autopilot_step((uint32_t)(i / 8 + 1) * AUTOPILOT_PERIOD - 7 + i % 8,
+				scroll_time, get_scroll_periods(), get_scroll_directions());
+	}
+	sei();
+
+	for(i = 0; i < BENCH_REPEATS; i++) {
+		while(serial_output_space() != SERIAL_BUFFER_EMPTY) {
+			; // wait
+		}
+		show_score();
+	}
+
+	// Capturing a save state (once the last one has been written) and
+	// restoring it - the restore shows the score, so the output buffer is
+	// emptied first as above
+	for(i = 0; i < SAVESTATE_REPEATS; i++) {
+		while(eeprom_write_busy()) {
+			; // wait
+		}
+		(void)savestate_capture(0, scroll_time);
+		while(serial_output_space() != SERIAL_BUFFER_EMPTY) {
+			; // wait
+		}
+		savestate_restore(0, scroll_time);
+	}
+	while(eeprom_write_busy()) {
+		; // wait
+	}
+}
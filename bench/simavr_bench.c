@@ -0,0 +1,370 @@
+/*
+ * simavr_bench.c
+ *
+ * Cycle count benchmarks. Runs a benchmark build of the firmware under
+ * simavr, one instruction at a time, and times every call of the
+ * functions below from the cycle on which they are entered until they
+ * return (found from the stack pointer). Calls are timed while
+ * run_benchmarks() (bench/bench.c) is running. After that the button is
+ * pushed to start a game (it is let go at the game loop's first joystick
+ * ADC read) and the play_game() loop iterations are timed too - from the
+ * loop waking up (idle_until() returning) to it going to sleep again
+ * (idle_until() being called), so the time asleep waiting for the next
+ * scroll or joystick reading isn't counted and the figure is the CPU time
+ * an iteration takes.
+ *
+ * The results are checked against a baseline file - a mean or worst case
+ * more than the tolerance above the baseline is a failure (exit status 1),
+ * and so is a function with no baseline or one which was never called, so
+ * the check can't pass without measuring everything. A baseline file with
+ * no results in it at all (as bench/baseline.txt is until the first run
+ * on a machine with simavr) is filled in with the results, as -w does,
+ * and the check passes - commit the file it writes.
+ *
+ * Build the firmware (from the top of the repository). -fno-inline keeps
+ * the functions being timed as separate functions:
+ *   avr-gcc -mmcu=atmega324a -Os -fno-inline -DBENCH -I. -o bench.elf \
+ *       $(ls *.c) bench/bench.c
+ * Build and run the benchmark:
+ *   gcc -O2 -o simavr_bench bench/simavr_bench.c -lsimavr -lelf
+ *   simavr_bench [-w] [-t percent] [-m mcu] bench.elf bench/baseline.txt
+ * -w writes the results to the baseline file instead of checking them.
+ * The default tolerance is 5% and the default simavr core atmega324pa
+ * (register compatible with the ATmega324A).
+ */
+
+#include <fcntl.h>
+#include <gelf.h>
+#include <libelf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_uart.h>
+
+#define F_CPU 8000000
+#define PLAY_ITERATIONS 200
+#define MAX_CYCLES (30ULL * F_CPU)	// give up after 30 simulated seconds
+#define MAX_DEPTH 32
+
+typedef struct {
+	const char* name;
+	uint32_t address;
+	unsigned long calls;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+} Timing;
+
+static Timing timings[] = {
+	{ "redraw_traffic_lane" },
+	{ "redraw_river_channel" },
+	{ "will_frog_die_at_position" },
+	{ "scroll_vehicle_lane" },
+	{ "scroll_river_channel" },
+	{ "hal_spi_send_byte" },
+	{ "ledmatrix_update_row" },	// an 18 byte SPI burst
+	{ "show_score" },
+	{ "autopilot_step" },
+	{ "savestate_capture" },
+	{ "savestate_restore" },
+	{ "play_game_iteration" },
+	{ "run_benchmarks" },
+	{ "hal_adc_read" },
+	{ "idle_until" },
+};
+#define NUM_TIMINGS (sizeof(timings) / sizeof(timings[0]))
+#define NUM_REPORTED (NUM_TIMINGS - 3)
+#define PLAY_ITERATION (NUM_TIMINGS - 4)
+#define RUN_BENCHMARKS (NUM_TIMINGS - 3)
+#define ADC_READ (NUM_TIMINGS - 2)
+#define IDLE_UNTIL (NUM_TIMINGS - 1)
+
+typedef struct {
+	Timing* timing;
+	uint16_t sp;
+	uint64_t start;
+} Call;
+
+static Call calls[MAX_DEPTH];
+static int depth = 0;
+
+static void record(Timing* timing, uint64_t cycles) {
+	if(timing->calls == 0 || cycles < timing->min) {
+		timing->min = cycles;
+	}
+	if(cycles > timing->max) {
+		timing->max = cycles;
+	}
+	timing->total += cycles;
+	timing->calls++;
+}
+
+// Find the addresses of the functions in the ELF symbol table
+static int load_symbols(const char* path) {
+	int fd = open(path, O_RDONLY);
+	Elf* elf;
+	Elf_Scn* section = NULL;
+	if(fd < 0 || elf_version(EV_CURRENT) == EV_NONE
+			|| (elf = elf_begin(fd, ELF_C_READ, NULL)) == NULL) {
+		perror(path);
+		return -1;
+	}
+	while((section = elf_nextscn(elf, section)) != NULL) {
+		GElf_Shdr header;
+		Elf_Data* data;
+		gelf_getshdr(section, &header);
+		if(header.sh_type != SHT_SYMTAB) {
+			continue;
+		}
+		data = elf_getdata(section, NULL);
+		for(size_t i = 0; i < header.sh_size / header.sh_entsize; i++) {
+			GElf_Sym symbol;
+			const char* name;
+			gelf_getsym(data, i, &symbol);
+			if(GELF_ST_TYPE(symbol.st_info) != STT_FUNC) {
+				continue;
+			}
+			name = elf_strptr(elf, header.sh_link, symbol.st_name);
+			for(size_t t = 0; t < NUM_TIMINGS; t++) {
+				if(name && strcmp(name, timings[t].name) == 0) {
+					timings[t].address = symbol.st_value;
+				}
+			}
+		}
+	}
+	elf_end(elf);
+	close(fd);
+	for(size_t t = 0; t < NUM_TIMINGS; t++) {
+		if(t != PLAY_ITERATION && timings[t].address == 0) {
+			fprintf(stderr, "%s not found - built with -fno-inline and -DBENCH?\n",
+					timings[t].name);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int run(avr_t* avr) {
+	avr_irq_t* button = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 0);
+	int benchmarks_done = 0, button_down = 0, playing = 0;
+	uint64_t iteration_start = 0;	// 0 until the loop wakes up in a game
+	int state = cpu_Running;
+
+	while(state != cpu_Done && state != cpu_Crashed) {
+		uint16_t sp;
+		state = avr_run(avr);
+		if(avr->cycle > MAX_CYCLES) {
+			fprintf(stderr, "Gave up after %llu cycles\n", (unsigned long long)avr->cycle);
+			return -1;
+		}
+
+		// Calls which have returned
+		sp = avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+		while(depth > 0 && sp > calls[depth-1].sp) {
+			Call* call = &calls[--depth];
+			if(call->timing == &timings[RUN_BENCHMARKS]) {
+				// Now start a game - the button is held down until the
+				// game loop starts
+				benchmarks_done = 1;
+				avr_raise_irq(button, 1);
+				button_down = 1;
+			} else if(call->timing == &timings[IDLE_UNTIL]) {
+				// The loop has woken up - an iteration starts
+				if(playing) {
+					iteration_start = avr->cycle;
+				}
+			} else if(!benchmarks_done) {
+				record(call->timing, avr->cycle - call->start);
+			}
+		}
+
+		// Calls starting
+		for(size_t t = 0; t < NUM_TIMINGS; t++) {
+			if(timings[t].address != avr->pc || t == PLAY_ITERATION) {
+				continue;
+			}
+			if(t == ADC_READ && button_down) {
+				// In the game loop
+				avr_raise_irq(button, 0);
+				button_down = 0;
+				playing = 1;
+			}
+			if(t == IDLE_UNTIL && iteration_start) {
+				// The loop is going to sleep - the iteration ends
+				record(&timings[PLAY_ITERATION], avr->cycle - iteration_start);
+				iteration_start = 0;
+				if(timings[PLAY_ITERATION].calls == PLAY_ITERATIONS) {
+					return 0;
+				}
+			}
+			if(depth == MAX_DEPTH) {
+				fprintf(stderr, "Calls nested too deep\n");
+				return -1;
+			}
+			calls[depth].timing = &timings[t];
+			calls[depth].sp = sp;
+			calls[depth].start = avr->cycle;
+			depth++;
+		}
+	}
+	fprintf(stderr, "Firmware stopped (state %d)\n", state);
+	return -1;
+}
+
+// Compare with (or write) the baseline. Returns the number of failures.
+static int check_baseline(const char* path, int write, double tolerance) {
+	FILE* file;
+	char line[128], name[64];
+	unsigned long base_mean, base_max;
+	int failures = 0, entries = 0, first = 0;
+	int checked[NUM_REPORTED] = { 0 };
+
+	file = write ? NULL : fopen(path, "r");
+	if(!write && !file) {
+		perror(path);
+		return 1;
+	}
+	while(file && fgets(line, sizeof(line), file)) {
+		if(line[0] == '#' || sscanf(line, "%63s %lu %lu", name, &base_mean, &base_max) != 3) {
+			continue;
+		}
+		entries++;
+		for(size_t t = 0; t < NUM_REPORTED; t++) {
+			unsigned long mean, max;
+			if(strcmp(name, timings[t].name) != 0 || timings[t].calls == 0) {
+				continue;
+			}
+			checked[t] = 1;
+			mean = timings[t].total / timings[t].calls;
+			max = timings[t].max;
+			if(mean > base_mean * (1 + tolerance / 100) || max > base_max * (1 + tolerance / 100)) {
+				printf("REGRESSION %s: mean %lu (baseline %lu), max %lu (baseline %lu)\n",
+						name, mean, base_mean, max, base_max);
+				failures++;
+			}
+		}
+	}
+	if(file) {
+		fclose(file);
+	}
+	if(!write && entries == 0) {
+		// Nothing to compare with yet - these results are the baseline
+		printf("No results in %s - recording this run as the baseline\n", path);
+		write = first = 1;
+	}
+
+	if(write) {
+		file = fopen(path, "w");
+		if(!file) {
+			perror(path);
+			return 1;
+		}
+		fprintf(file, "# Cycle count baseline for bench/simavr_bench.c\n");
+		fprintf(file, "# name mean max\n");
+		for(size_t t = 0; t < NUM_REPORTED; t++) {
+			if(timings[t].calls == 0) {
+				// (a first baseline must have everything in it)
+				if(first) {
+					printf("MISSING %s: never called\n", timings[t].name);
+					failures++;
+				}
+				continue;
+			}
+			fprintf(file, "%s %lu %lu\n", timings[t].name,
+					(unsigned long)(timings[t].total / timings[t].calls),
+					(unsigned long)timings[t].max);
+		}
+		fclose(file);
+		printf("Baseline written to %s\n", path);
+		return failures;
+	}
+
+	for(size_t t = 0; t < NUM_REPORTED; t++) {
+		if(timings[t].calls == 0) {
+			printf("MISSING %s: never called\n", timings[t].name);
+			failures++;
+		} else if(!checked[t]) {
+			printf("MISSING %s: no baseline - record one with -w\n", timings[t].name);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+int main(int argc, char** argv) {
+	const char* mcu = "atmega324pa";
+	double tolerance = 5;
+	int write = 0, option, failures;
+	elf_firmware_t firmware;
+	avr_t* avr;
+	uint32_t uart_flags = 0;
+
+	while((option = getopt(argc, argv, "wt:m:")) != -1) {
+		switch(option) {
+			case 'w':
+				write = 1;
+				break;
+			case 't':
+				tolerance = atof(optarg);
+				break;
+			case 'm':
+				mcu = optarg;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-w] [-t percent] [-m mcu] firmware.elf baseline.txt\n", argv[0]);
+				return 2;
+		}
+	}
+	if(argc - optind != 2) {
+		fprintf(stderr, "Usage: %s [-w] [-t percent] [-m mcu] firmware.elf baseline.txt\n", argv[0]);
+		return 2;
+	}
+
+	if(load_symbols(argv[optind]) < 0) {
+		return 2;
+	}
+	memset(&firmware, 0, sizeof(firmware));
+	if(elf_read_firmware(argv[optind], &firmware) != 0) {
+		fprintf(stderr, "Can't read %s\n", argv[optind]);
+		return 2;
+	}
+	firmware.frequency = F_CPU;
+	avr = avr_make_mcu_by_name(mcu);
+	if(!avr) {
+		fprintf(stderr, "simavr doesn't know %s\n", mcu);
+		return 2;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, &firmware);
+	avr->frequency = F_CPU;
+
+	// Keep the terminal output out of the results
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &uart_flags);
+	uart_flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &uart_flags);
+
+	if(run(avr) < 0) {
+		return 2;
+	}
+
+	printf("%-26s %6s %8s %8s %8s\n", "function", "calls", "min", "mean", "max");
+	for(size_t t = 0; t < NUM_REPORTED; t++) {
+		Timing* timing = &timings[t];
+		if(timing->calls == 0) {
+			printf("%-26s %6s\n", timing->name, "-");
+			continue;
+		}
+		printf("%-26s %6lu %8lu %8lu %8lu\n", timing->name, timing->calls,
+				(unsigned long)timing->min, (unsigned long)(timing->total / timing->calls),
+				(unsigned long)timing->max);
+	}
+
+	failures = check_baseline(argv[optind + 1], write, tolerance);
+	return failures ? 1 : 0;
+}
@@ -4,9 +4,9 @@
  * Author: Peter Sutton
  */ 
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include <util/atomic.h>
 #include "buttons.h"
+#include "hal.h"
 
 #include "timer0.h" //MAYBE
 
@@ -30,22 +30,10 @@ static volatile int8_t queue_length;
 static volatile int8_t return_value = NO_BUTTON_PUSHED;	// Assume no button pushed
 volatile uint32_t last_move_time = 0;
 
-// Setup interrupt if any of pins B0 to B3 change. We do this
-// using a pin change interrupt. These pins correspond to pin
-// change interrupts PCINT8 to PCINT11 which are covered by
-// Pin change interrupt 1.
+// Setup interrupt if any of pins B0 to B3 change (see hal_buttons_init())
 void init_button_interrupts(void) {
 	
-	// Enable the interrupt (see datasheet page 91)
-	PCICR |= (1<<PCIE1);
-	
-	// Make sure the interrupt flag is cleared (by writing a 
-	// 1 to it) (see datasheet page 92)
-	PCIFR |= (1<<PCIF1);
-	
-	// Choose which pins we're interested in by setting
-	// the relevant bits in the mask register (see datasheet page 94)
-	PCMSK1 |= (1<<PCINT8)|(1<<PCINT9)|(1<<PCINT10)|(1<<PCINT11);	
+	hal_buttons_init();
 	
 	// Empty the button push queue
 	queue_length = 0;
@@ -61,18 +49,11 @@ int8_t button_pushed(void) {
 		return_value = button_queue[0];
 		
 
-		// Save whether interrupts were enabled and turn them off
-		int8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
-		cli();
-		
-		for(uint8_t i = 1; i < queue_length; i++) {
-			button_queue[i-1] = button_queue[i];
-		}
-		queue_length--;
-		
-		if(interrupts_were_enabled) {
-			// Turn them back on again
-			sei();
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			for(uint8_t i = 1; i < queue_length; i++) {
+				button_queue[i-1] = button_queue[i];
+			}
+			queue_length--;
 		}
 	}
 
@@ -92,18 +73,22 @@ void clear_push(void){ //Remove any button queue
 	queue_length = 0;
 }
 
+uint8_t button_waiting(void){
+	return queue_length > 0 || check_still_down();
+}
+
 uint8_t check_still_down(void){ //Is the button still pressed?
-	uint8_t button_state = PINB & 0x0F;
+	uint8_t button_state = hal_buttons_read();
 	if(button_state & last_button_state){
 		return 1; //Yes the button is still down
 	}
 	return 0;
 }
 // Interrupt handler for a change on buttons
-ISR(PCINT1_vect) {
+void buttons_interrupt(void) {
 	// Get the current state of the buttons. We'll compare this with
 	// the last state to see what has changed.
-	uint8_t button_state = PINB & 0x0F;
+	uint8_t button_state = hal_buttons_read();
 	
 	// Iterate over all the buttons and see which ones have changed.
 	// Any button pushes are added to the queue of button pushes (if
@@ -32,6 +32,11 @@ int8_t button_pushed(void);
 
 void clear_push(void);
 
+/* Return 1 if a button push is waiting or a button is held down (so
+ * button_pushed() may return it soon), 0 otherwise.
+ */
+uint8_t button_waiting(void);
+
 uint8_t check_still_down(void);
 
 
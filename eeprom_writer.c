@@ -0,0 +1,58 @@
+/*
+ * eeprom_writer.c
+ *
+ * Interrupt driven EEPROM writes - see eeprom_writer.h
+ */
+
+#include "eeprom_writer.h"
+#include "hal.h"
+
+static const uint8_t* volatile write_data;
+static volatile uint16_t write_address;
+static volatile uint8_t write_remaining = 0;
+static void (*done_handler)(void) = 0;
+
+uint8_t eeprom_write_start(uint16_t address, const void* data, uint8_t length) {
+	if(write_remaining) {
+		return 0;
+	}
+	write_address = address;
+	write_data = (const uint8_t*)data;
+	write_remaining = length;
+	/* Enable the EEPROM ready interrupt. It fires as soon as the EEPROM
+	 * isn't busy, and again after each byte is written.
+	 */
+	hal_eeprom_ready_interrupt(1);
+	return 1;
+}
+
+uint8_t eeprom_write_busy(void) {
+	hal_poll();
+	return write_remaining != 0;
+}
+
+void eeprom_write_set_done_handler(void (*handler)(void)) {
+	done_handler = handler;
+}
+
+void eeprom_ready_interrupt(void) {
+	while(write_remaining) {
+		uint8_t value = *write_data++;
+		uint16_t address = write_address++;
+		write_remaining--;
+
+		/* Read the current value - only write the byte if it differs */
+		if(hal_eeprom_read_byte(address) != value) {
+			hal_eeprom_write_byte(address, value);
+			/* We'll be back when this byte is written */
+			return;
+		}
+	}
+	/* All done - no more interrupts needed (unless the handler starts
+	 * another write)
+	 */
+	hal_eeprom_ready_interrupt(0);
+	if(done_handler) {
+		done_handler();
+	}
+}
@@ -0,0 +1,38 @@
+/*
+ * eeprom_writer.h
+ *
+ * Background EEPROM writes. Each EEPROM byte takes about 3.3ms to write,
+ * so rather than waiting, we hand over a block of data and the EEPROM
+ * ready interrupt writes it out one byte at a time. Bytes which already
+ * hold the right value are skipped (to save time and wear).
+ *
+ * Bytes are written in order, lowest address first - so a record whose
+ * last bytes are a checksum is only complete once the checksum is written.
+ *
+ * EEPROM layout:
+ *   0 - 639     high score table (score.c)
+ *   768 - 965   save states (savestate.c)
+ */
+
+#ifndef EEPROM_WRITER_H_
+#define EEPROM_WRITER_H_
+
+#include <stdint.h>
+
+/* Start writing length bytes from data to the given EEPROM address. The
+ * data is not copied - it must not change until the write has finished.
+ * Returns 1 if the write was started, 0 if another write is still in
+ * progress.
+ */
+uint8_t eeprom_write_start(uint16_t address, const void* data, uint8_t length);
+
+/* Returns non-zero while a write is in progress */
+uint8_t eeprom_write_busy(void);
+
+/* Set a function for the EEPROM ready interrupt to call each time a write
+ * finishes (0 for none). It is called with interrupts off and may start
+ * the next write.
+ */
+void eeprom_write_set_done_handler(void (*handler)(void));
+
+#endif /* EEPROM_WRITER_H_ */
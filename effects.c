@@ -0,0 +1,237 @@
+/*
+ * effects.c
+ *
+ * Display effects - see effects.h.
+ */
+
+#include <stddef.h>
+
+#include "effects.h"
+#include "ledpanels.h"
+#include "timer0.h"
+
+// Job types
+#define EFFECT_NONE 0
+#define EFFECT_FLASH 1
+#define EFFECT_WIPE 2
+#define EFFECT_FADE 3
+
+// How far through a job is, from 0 to TWEEN_END
+#define TWEEN_END 256
+
+// The brightest level of a colour channel
+#define MAX_LEVEL 15
+
+typedef struct {
+	uint8_t type;
+	uint8_t reverse;		// wipe: reveal, fade: fade in
+	uint8_t x, y;			// flash: the cell
+	PixelColour colour;
+	uint16_t period;		// flash: ms on (and off)
+	uint16_t duration;
+	uint32_t start;
+	// What the job showed at the last step - flash: on (1) or off,
+	// wipe: the columns covered or revealed, fade: the brightness
+	uint8_t state;
+} Effect;
+
+static Effect effects[MAX_EFFECTS];
+static uint8_t running;
+
+static Effect* start_effect(uint8_t type, uint16_t duration);
+static void end_effect(Effect* effect);
+static uint8_t effect_state(Effect* effect, uint32_t elapsed);
+static void touch_columns(uint8_t from, uint8_t to);
+static void touch_lit(void);
+static PixelColour apply_effects(uint8_t x, uint8_t y, PixelColour colour);
+
+void effects_flash(uint8_t x, uint8_t y, PixelColour colour, uint16_t period,
+		uint16_t duration) {
+	Effect* effect = start_effect(EFFECT_FLASH, duration);
+	if(effect) {
+		effect->x = x;
+		effect->y = y;
+		effect->colour = colour;
+		effect->period = period ? period : 1;
+		effect->state = 0;
+	}
+}
+
+void effects_wipe(PixelColour colour, uint8_t reveal, uint16_t duration) {
+	Effect* effect = start_effect(EFFECT_WIPE, duration);
+	if(effect) {
+		effect->colour = colour;
+		effect->reverse = reveal;
+		effect->state = 0;
+		if(reveal) {
+			// Everything starts covered
+			ledpanels_touch_all();
+		}
+	}
+}
+
+void effects_fade(uint8_t fade_in, uint16_t duration) {
+	Effect* effect = start_effect(EFFECT_FADE, duration);
+	if(effect) {
+		effect->reverse = fade_in;
+		effect->state = fade_in ? 0 : MAX_LEVEL;
+		if(fade_in) {
+			touch_lit();
+		}
+	}
+}
+
+void effects_step(uint32_t now) {
+	uint8_t state;
+	uint32_t elapsed;
+	Effect* effect;
+
+	if(!running) {
+		return;
+	}
+	for(uint8_t i = 0; i < MAX_EFFECTS; i++) {
+		effect = &effects[i];
+		if(effect->type == EFFECT_NONE) {
+			continue;
+		}
+		elapsed = now - effect->start;
+		if(elapsed >= effect->duration) {
+			end_effect(effect);
+			continue;
+		}
+		state = effect_state(effect, elapsed);
+		if(state == effect->state) {
+			continue;
+		}
+		// Mark what looks different now
+		switch(effect->type) {
+			case EFFECT_FLASH:
+			ledpanels_touch(effect->x, effect->y);
+			break;
+			case EFFECT_WIPE:
+			touch_columns(effect->state, state);
+			break;
+			case EFFECT_FADE:
+			touch_lit();
+			break;
+		}
+		effect->state = state;
+	}
+}
+
+uint8_t effects_running(void) {
+	return running;
+}
+
+void effects_stop(void) {
+	for(uint8_t i = 0; i < MAX_EFFECTS; i++) {
+		if(effects[i].type != EFFECT_NONE) {
+			end_effect(&effects[i]);
+		}
+	}
+}
+
+// Take a free job and start it now. Returns NULL if there isn't one.
+static Effect* start_effect(uint8_t type, uint16_t duration) {
+	for(uint8_t i = 0; i < MAX_EFFECTS; i++) {
+		Effect* effect = &effects[i];
+		if(effect->type == EFFECT_NONE) {
+			effect->type = type;
+			effect->reverse = 0;
+			effect->duration = duration;
+			effect->start = get_monotonic_time();
+			if(running++ == 0) {
+				ledpanels_set_filter(apply_effects);
+			}
+			return effect;
+		}
+	}
+	return NULL;
+}
+
+// Finish a job and mark what it changed to be sent again
+static void end_effect(Effect* effect) {
+	switch(effect->type) {
+		case EFFECT_FLASH:
+		ledpanels_touch(effect->x, effect->y);
+		break;
+		case EFFECT_WIPE:
+		touch_columns(0, LEDPANELS_NUM_COLUMNS);
+		break;
+		case EFFECT_FADE:
+		touch_lit();
+		break;
+	}
+	effect->type = EFFECT_NONE;
+	if(--running == 0) {
+		ledpanels_set_filter(NULL);
+	}
+}
+
+// What a job shows the given time after it started
+static uint8_t effect_state(Effect* effect, uint32_t elapsed) {
+	uint16_t tween = (uint16_t)((elapsed * TWEEN_END) / effect->duration);
+	switch(effect->type) {
+		case EFFECT_FLASH:
+		return (elapsed / effect->period) & 1;
+		case EFFECT_WIPE:
+		return (uint8_t)((tween * LEDPANELS_NUM_COLUMNS) / TWEEN_END);
+		case EFFECT_FADE:
+		tween = (tween * (MAX_LEVEL + 1)) / TWEEN_END;
+		return effect->reverse ? tween : MAX_LEVEL - tween;
+	}
+	return 0;
+}
+
+// Mark the columns from one up to (not including) the other to be sent
+static void touch_columns(uint8_t from, uint8_t to) {
+	if(from > to) {
+		uint8_t swap = from;
+		from = to;
+		to = swap;
+	}
+	for(uint8_t x = from; x < to; x++) {
+		for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+			ledpanels_touch(x, y);
+		}
+	}
+}
+
+// Mark the pixels which aren't black to be sent - a fade doesn't change
+// the others
+static void touch_lit(void) {
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		for(uint8_t x = 0; x < LEDPANELS_NUM_COLUMNS; x++) {
+			if(ledpanels_get_pixel(x, y) != COLOUR_BLACK) {
+				ledpanels_touch(x, y);
+			}
+		}
+	}
+}
+
+// The filter - how the running jobs change a pixel, in the order they
+// were started
+static PixelColour apply_effects(uint8_t x, uint8_t y, PixelColour colour) {
+	for(uint8_t i = 0; i < MAX_EFFECTS; i++) {
+		Effect* effect = &effects[i];
+		uint8_t red, green;
+		switch(effect->type) {
+			case EFFECT_FLASH:
+			if(effect->state && x == effect->x && y == effect->y) {
+				colour = effect->colour;
+			}
+			break;
+			case EFFECT_WIPE:
+			if((x < effect->state) != effect->reverse) {
+				colour = effect->colour;
+			}
+			break;
+			case EFFECT_FADE:
+			red = ((colour & 0x0F) * effect->state) / MAX_LEVEL;
+			green = ((colour >> 4) * effect->state) / MAX_LEVEL;
+			colour = (green << 4) | red;
+			break;
+		}
+	}
+	return colour;
+}
@@ -0,0 +1,53 @@
+/*
+ * effects.h
+ *
+ * Animations drawn over whatever is on the display: flashing cells, wipes
+ * and fades. Each effect is a job with a start time and a duration which
+ * is tweened - effects_step() works out how far through each job is and
+ * marks only the pixels whose look has changed since the last step, and
+ * a filter (see ledpanels.h) changes those pixels as they are sent. The
+ * framebuffer itself is never changed, so the game carries on drawing
+ * underneath and the display is back as it was when the job ends.
+ *
+ * Nothing here waits - the main loop calls effects_step() then
+ * ledpanels_flush() with a limit on the rows it may send, so an effect
+ * costs at most that much SPI time per frame.
+ *
+ * Fades scale the red and green channels (4 bits each) of every pixel.
+ *
+ * Times are in milliseconds of get_monotonic_time(), so effects carry on
+ * while the game clock is stopped.
+ */
+
+#ifndef EFFECTS_H_
+#define EFFECTS_H_
+
+#include <stdint.h>
+#include "pixel_colour.h"
+
+#define MAX_EFFECTS 4
+
+// Flash the cell at (x, y): it is shown as drawn for period ms, then in the
+// given colour for period ms, and so on
+void effects_flash(uint8_t x, uint8_t y, PixelColour colour, uint16_t period,
+		uint16_t duration);
+
+// Sweep across the display from left to right. Covering, the columns
+// swept over are shown in the given colour until the job ends; revealing,
+// the columns not swept over yet are.
+void effects_wipe(PixelColour colour, uint8_t reveal, uint16_t duration);
+
+// Fade the display out (to black) or in (from black). A fade out stays
+// black until the job ends.
+void effects_fade(uint8_t fade_in, uint16_t duration);
+
+// Bring the effects up to the given time (get_monotonic_time())
+void effects_step(uint32_t now);
+
+// The number of effects running
+uint8_t effects_running(void);
+
+// Stop all the effects - the display goes back to the framebuffer
+void effects_stop(void);
+
+#endif /* EFFECTS_H_ */
@@ -0,0 +1,161 @@
+/*
+ * entity.c
+ *
+ * Moving hazards - see entity.h.
+ */
+
+#include <avr/pgmspace.h>
+
+#include "entity.h"
+
+// Turtles go round a cycle of TURTLE_PHASES steps. They are shown in the
+// warning colour just before they dive, then are under water (and can't be
+// stood on) until the cycle starts again.
+#define TURTLE_PHASES 10
+#define TURTLE_DIVING 7
+#define TURTLE_UNDER 8
+
+// Colours
+#define COLOUR_TURTLE			COLOUR_LIGHT_GREEN
+#define COLOUR_DIVING_TURTLE	COLOUR_LIGHT_YELLOW
+#define COLOUR_CROCODILE		COLOUR_GREEN
+#define COLOUR_CROCODILE_HEAD	COLOUR_RED
+#define COLOUR_SNAKE			COLOUR_RED
+
+// Milliseconds between steps for each type (0 = never steps)
+static const uint16_t step_period[4] PROGMEM = {0, 300, 0, 200};
+
+// The entities - one array per field. A type of ENTITY_NONE is a free slot.
+static uint8_t entity_type[MAX_ENTITIES];
+static uint8_t entity_row[MAX_ENTITIES];
+static int8_t entity_column[MAX_ENTITIES];
+static int8_t entity_velocity[MAX_ENTITIES];
+static uint8_t entity_width[MAX_ENTITIES];
+static uint8_t entity_phase[MAX_ENTITIES];
+static uint16_t entity_timer[MAX_ENTITIES];	// ms until the next step
+
+void clear_entities(void) {
+	for(uint8_t i = 0; i < MAX_ENTITIES; i++) {
+		entity_type[i] = ENTITY_NONE;
+	}
+}
+
+uint8_t add_entity(uint8_t type, uint8_t row, int8_t column, int8_t velocity,
+		uint8_t width, uint8_t phase) {
+	for(uint8_t i = 0; i < MAX_ENTITIES; i++) {
+		if(entity_type[i] == ENTITY_NONE) {
+			entity_type[i] = type;
+			entity_row[i] = row;
+			entity_column[i] = column & (ENTITY_TRACK_WIDTH - 1);
+			entity_velocity[i] = velocity;
+			entity_width[i] = width;
+			entity_phase[i] = phase;
+			entity_timer[i] = pgm_read_word(&step_period[type]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+uint32_t step_entities(void) {
+	uint32_t changed = 0;
+	for(uint8_t i = 0; i < MAX_ENTITIES; i++) {
+		if(entity_timer[i] == 0 || entity_type[i] == ENTITY_NONE) {
+			continue;
+		}
+		if(--entity_timer[i] != 0) {
+			continue;
+		}
+		entity_timer[i] = pgm_read_word(&step_period[entity_type[i]]);
+		switch(entity_type[i]) {
+			case ENTITY_TURTLE:
+			entity_phase[i]++;
+			if(entity_phase[i] >= TURTLE_PHASES) {
+				entity_phase[i] = 0;
+			}
+			// Only a change between the phases shown differently matters
+			if(entity_phase[i] != 0 && entity_phase[i] != TURTLE_DIVING
+					&& entity_phase[i] != TURTLE_UNDER) {
+				continue;
+			}
+			break;
+			case ENTITY_SNAKE:
+			entity_column[i] = (entity_column[i] + entity_velocity[i]) & (ENTITY_TRACK_WIDTH - 1);
+			break;
+		}
+		changed |= (1UL << entity_row[i]);
+	}
+	return changed;
+}
+
+void get_entity_state(uint8_t entity, EntityState* state) {
+	if(entity_type[entity] == ENTITY_NONE) {
+		state->column = 0;
+		state->phase = 0;
+		state->timer = 0;
+		return;
+	}
+	state->column = entity_column[entity];
+	state->phase = entity_phase[entity];
+	state->timer = entity_timer[entity];
+}
+
+void set_entity_state(uint8_t entity, const EntityState* state) {
+	if(entity_type[entity] == ENTITY_NONE) {
+		return;
+	}
+	entity_column[entity] = state->column & (ENTITY_TRACK_WIDTH - 1);
+	entity_phase[entity] = state->phase;
+	entity_timer[entity] = state->timer;
+}
+
+uint16_t get_entity_period(uint8_t entity) {
+	return pgm_read_word(&step_period[entity_type[entity]]);
+}
+
+void rasterize_entities(uint8_t row, uint8_t offset, MatrixRow data,
+		uint16_t* solid, uint16_t* deadly) {
+	*solid = 0;
+	*deadly = 0;
+	for(uint8_t i = 0; i < MAX_ENTITIES; i++) {
+		uint8_t type = entity_type[i];
+		uint8_t head;
+		PixelColour colour;
+		if(type == ENTITY_NONE || entity_row[i] != row) {
+			continue;
+		}
+		if(type == ENTITY_TURTLE && entity_phase[i] >= TURTLE_UNDER) {
+			continue; // under water
+		}
+		// The head is the end the entity is moving towards
+		head = entity_velocity[i] < 0 ? 0 : entity_width[i] - 1;
+		for(uint8_t cell = 0; cell < entity_width[i]; cell++) {
+			uint8_t column = (entity_column[i] + cell - offset) & (ENTITY_TRACK_WIDTH - 1);
+			uint16_t bit;
+			if(column >= MATRIX_NUM_COLUMNS) {
+				continue; // off the display
+			}
+			bit = (1U << column);
+			switch(type) {
+				case ENTITY_TURTLE:
+				colour = entity_phase[i] == TURTLE_DIVING ? COLOUR_DIVING_TURTLE : COLOUR_TURTLE;
+				*solid |= bit;
+				break;
+				case ENTITY_CROCODILE:
+				if(cell == head) {
+					colour = COLOUR_CROCODILE_HEAD;
+					*deadly |= bit;
+				} else {
+					colour = COLOUR_CROCODILE;
+					*solid |= bit;
+				}
+				break;
+				default:
+				colour = COLOUR_SNAKE;
+				*deadly |= bit;
+				break;
+			}
+			data[column] = colour;
+		}
+	}
+}
@@ -0,0 +1,71 @@
+/*
+ * entity.h
+ *
+ * Moving hazards which sit on top of the rows of the game field: turtles
+ * which dive every so often, crocodiles whose heads kill and snakes. Each
+ * entity has a type, a row, a position, a velocity, a width (in columns)
+ * and a phase. The entities are kept as one array per field (so looking
+ * through them for a row touches only the rows array) and are turned
+ * into two bit masks per row when the row is drawn - what can be stood
+ * on and what kills - so a collision is still one bit test however many
+ * entities there are.
+ *
+ * Positions are on a track ENTITY_TRACK_WIDTH columns wide which wraps
+ * around - only 16 columns of it are on the display. Entities in the
+ * river are placed on the log data (the track is the same width) and
+ * are carried along with it, so their velocity is only the direction
+ * they face. Others move by themselves: velocity columns every step.
+ */
+
+#ifndef ENTITY_H_
+#define ENTITY_H_
+
+#include <stdint.h>
+#include "ledmatrix.h"
+
+#define MAX_ENTITIES 8
+#define ENTITY_TRACK_WIDTH 32	// must be a power of 2
+
+// Entity types
+#define ENTITY_NONE 0
+#define ENTITY_TURTLE 1		// safe to stand on, except when under water
+#define ENTITY_CROCODILE 2	// body is safe to stand on, the head kills
+#define ENTITY_SNAKE 3		// kills
+
+// Remove all entities
+void clear_entities(void);
+
+// Add an entity. Column is its left hand end on the track and phase where
+// it starts in its cycle (turtles: 0 to 9, under water from 8). Returns 0
+// if there are already MAX_ENTITIES.
+uint8_t add_entity(uint8_t type, uint8_t row, int8_t column, int8_t velocity,
+		uint8_t width, uint8_t phase);
+
+// Step the entities on one game tick. Returns a bit mask of the rows
+// (bit N for row N) which look different afterwards and so need to be
+// redrawn.
+uint32_t step_entities(void);
+
+// Where an entity has got to since it was added - its position, phase and
+// the ms until it next steps (0 if it never does) - for a save state
+// (savestate.h). An entity which hasn't been added is all 0, and setting
+// its state does nothing.
+typedef struct {
+	int8_t column;
+	uint8_t phase;
+	uint16_t timer;
+} EntityState;
+void get_entity_state(uint8_t entity, EntityState* state);
+void set_entity_state(uint8_t entity, const EntityState* state);
+
+// The ms between an entity's steps (0 if it never steps)
+uint16_t get_entity_period(uint8_t entity);
+
+// Draw the entities in the given row into the row data. Offset is the
+// track position in column 0 of the display (the log position for the
+// river). Sets *solid to the columns which can be stood on and *deadly to
+// the columns which kill.
+void rasterize_entities(uint8_t row, uint8_t offset, MatrixRow data,
+		uint16_t* solid, uint16_t* deadly);
+
+#endif /* ENTITY_H_ */
@@ -0,0 +1,99 @@
+/*
+ * frame.c
+ *
+ * Frame deadline monitor - see frame.h.
+ */
+
+#include <avr/pgmspace.h>
+
+#include "frame.h"
+#include "timer0.h"
+#include "serialio.h"
+
+typedef struct {
+	uint16_t time;		// get_fine_time() units
+	uint32_t tick;
+	uint8_t what;
+} SlowFrame;
+
+static SlowFrame worst[FRAME_WORST];	// slowest first
+static uint32_t frames;
+static uint16_t overruns;
+static uint16_t deferred;
+
+static uint16_t frame_start;
+static uint32_t frame_tick;
+static uint8_t frame_what;
+static uint8_t frame_deferred;
+
+static const char frame_names[4][7] PROGMEM = {
+	"scroll", "move", "serial", "score"
+};
+
+void frame_begin(uint32_t tick) {
+	frame_start = get_fine_time();
+	frame_tick = tick;
+	frame_what = 0;
+	frame_deferred = 0;
+}
+
+void frame_note(uint8_t what) {
+	frame_what |= what;
+}
+
+uint8_t frame_over_budget(void) {
+	if((uint16_t)(get_fine_time() - frame_start) > FRAME_BUDGET) {
+		frame_deferred = 1;
+		return 1;
+	}
+	return 0;
+}
+
+void frame_end(void) {
+	uint16_t time = get_fine_time() - frame_start;
+	uint8_t i;
+
+	frames++;
+	deferred += frame_deferred;
+	if(time <= FRAME_BUDGET) {
+		return;
+	}
+	overruns++;
+	// Keep it if it is one of the slowest
+	for(i = FRAME_WORST; i > 0 && worst[i - 1].time < time; i--) {
+		if(i < FRAME_WORST) {
+			worst[i] = worst[i - 1];
+		}
+	}
+	if(i < FRAME_WORST) {
+		worst[i].time = time;
+		worst[i].tick = frame_tick;
+		worst[i].what = frame_what;
+	}
+}
+
+void frame_report(void) {
+	serial_put_string_P(PSTR("\nFrames "));
+	serial_put_uint32(frames);
+	serial_put_string_P(PSTR(" over "));
+	serial_put_uint16(overruns);
+	serial_put_string_P(PSTR(" deferred "));
+	serial_put_uint16(deferred);
+	serial_put_char('\n');
+	for(uint8_t i = 0; i < FRAME_WORST && worst[i].time; i++) {
+		serial_put_uint32((uint32_t)worst[i].time * 8);
+		serial_put_string_P(PSTR(" us at tick "));
+		serial_put_uint32(worst[i].tick);
+		for(uint8_t bit = 0; bit < 4; bit++) {
+			if(worst[i].what & (1 << bit)) {
+				serial_put_char(' ');
+				serial_put_string_P(frame_names[bit]);
+			}
+		}
+		serial_put_char('\n');
+		worst[i].time = 0;
+	}
+	frames = 0;
+	overruns = 0;
+	deferred = 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * frame.h
+ *
+ * Frame deadline monitor. Each time round the game loop is a frame, which
+ * should take less than FRAME_BUDGET (one game tick) so the game keeps up
+ * with the clock. Frames over the budget are counted and the slowest few
+ * are kept along with what happened in them (see the FRAME_ flags).
+ *
+ * Once the game has been stepped up to date, a frame which has already
+ * used up its budget puts off the work which is only for show (the score
+ * on the terminal, the lives LEDs, telemetry and the countdown refresh)
+ * to a later frame, so the game itself (scrolling and collisions) stays
+ * on time.
+ */
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include <stdint.h>
+
+// The time a frame may take, in get_fine_time() units (8us) - 1ms
+#define FRAME_BUDGET 125
+
+// What happened in a frame
+#define FRAME_SCROLL 0x01	// a lane or log scrolled
+#define FRAME_MOVE 0x02		// a move was made
+#define FRAME_SERIAL 0x04	// a command came in on the terminal
+#define FRAME_SCORE 0x08	// the score was sent to the terminal
+
+// The slowest frames kept
+#define FRAME_WORST 4
+
+// Start a frame. tick is the game tick it starts on (for the report).
+void frame_begin(uint32_t tick);
+
+// Note something that happened in the frame
+void frame_note(uint8_t what);
+
+// Returns 1 if the frame has used up its budget
+uint8_t frame_over_budget(void);
+
+// End the frame - it is counted (and kept if one of the slowest)
+void frame_end(void);
+
+// Send the frame counts and the slowest frames to the serial terminal,
+// then start counting again:
+//   Frames <count> over <overruns> deferred <frames with work put off>
+//   <us> us at tick <tick> <what happened> (one line per slow frame)
+void frame_report(void);
+
+#endif /* FRAME_H_ */
@@ -11,41 +11,55 @@
 #include "timer0.h"
 #include "buttons.h"
 #include "terminalio.h"
+#include "entity.h"
+#include "effects.h"
 
-#define F_CPU 8000000L
-#include <util/delay.h>
+#include <avr/pgmspace.h>
 
 
 ///////////////////////////////// Global variables //////////////////////
-// frog_row and frog_column store the current position of the frog. Row
-// numbers are from 0 to 7; column numbers are from 0 to 15.
-static int8_t frog_row;
-static int8_t frog_column;
-static uint8_t time_died = 2; //Start with two so that you only have 3 lives to lose if died (MAXIMUM = 5)
+// The frogs - one per player. Row numbers are from 0 to 7; column numbers
+// are from 0 to 15. A frog which has run out of lives is out of the game
+// (frog_in_play() is 0) but the others carry on.
+typedef struct {
+	int8_t row;
+	int8_t column;
+	// Whether the frog is alive (0) or dead. A dead frog is shown until
+	// update_frogs() deals with it, then is FROG_DYING until respawn_tick.
+	uint8_t dead;
+	uint32_t respawn_tick;
+	// Lives lost - start with two so that you only have 3 lives to lose
+	// (MAXIMUM = 5)
+	uint8_t time_died;
+} Frog;
+
+#define FROG_DYING 2
+
+#define INITIAL_TIME_DIED 2
+#define MAX_TIME_DIED 5
+
+static Frog frogs[MAX_FROGS];
+static uint8_t num_frogs = 1;
 static uint8_t layout = 0;
-// Boolean flag to indicate whether the frog is alive or dead
-static uint8_t frog_dead;
+static uint8_t current_level;	// the level_data[] entry in use
+// No buzzer or terminal score - see set_game_quiet()
+static uint8_t quiet;
+// The game's idea of the current time - see set_game_tick()
+static uint32_t game_tick;
 
 // Vehicle data - 64 bits in each lane which we loop continuously. A 1
 // indicates the presence of a vehicle, 0 is empty.
 // Index 0 to 2 corresponds to lanes 1 to 3 respectively. Lanes 1 and 3
 // will move to the right; lane 2 will move to the left.
 #define LANE_DATA_WIDTH 64	// must be power of 2
-static uint64_t lane_data[3] = {
-	0b1100001100011000110000011001100011000011000110001100000110011000,
-	0b0011100000111000011100000111000011100001110001110000111000011100,
-	0b0000111100001111000011110000111100001111000001111100001111000111
-};
+static uint64_t lane_data[3];
 
 // Log data - 32 bits for each log channel which we loop continuously.
 // A 1 indicates the presence of a log, 0 is empty.
 // Index 0 to 1 corresponds to rows 5 and 6 respectively. Row 5 will move
 // to the left; row 6 will move to the right
 #define LOG_DATA_WIDTH 32 // must be power of 2
-static uint32_t log_data[2] = {
-	0b11110001100111000111100011111000,
-	0b11100110111101100001110110011100
-};
+static uint32_t log_data[2];
 
 // Lane positions. The bit position (0 to 63) of the lane_data above that is
 // currently in column 0 of the display (left hand side). (Bit position
@@ -59,14 +73,17 @@ static int8_t log_position[2];
 
 // Colours
 #define COLOUR_FROG			COLOUR_GREEN
+#define COLOUR_FROG_2		COLOUR_LIGHT_ORANGE	// the second player's frog
 #define COLOUR_DEAD_FROG	COLOUR_LIGHT_YELLOW
-uint8_t COLOUR_EDGES = 0x11;
+#define DEATH_FLASH_PERIOD	100	// ms - the dead frog flashes black
+uint8_t COLOUR_EDGES;
 #define COLOUR_WATER		COLOUR_BLACK
 #define COLOUR_ROAD			COLOUR_BLACK
-uint8_t COLOUR_LOGS	= 0x3C;
-PixelColour vehicle_colours[3] = {0x0F, 0xDF, 0x0F}; // by lane
+uint8_t COLOUR_LOGS;
+PixelColour vehicle_colours[3]; // by lane
 
-// Rows
+// Rows (of the 8 row layout - the first 7 rows of a tall level are the
+// same)
 #define START_ROW 0	// row position where the frog starts
 #define FIRST_VEHICLE_ROW 1
 #define SECOND_VEHICLE_ROW 2
@@ -76,27 +93,159 @@ PixelColour vehicle_colours[3] = {0x0F, 0xDF, 0x0F}; // by lane
 #define SECOND_RIVER_ROW 6
 #define RIVERBANK_ROW 7 // row position where the frog finishes
 
+// Row layouts - what each row of a level is. A level can be taller than
+// the display, in which case the display shows the 8 rows from view_bottom
+// up and follows the frog. Rows which share a lane or river channel share
+// its data and scroll with it; each row starts offset bits into the data
+// so that they don't all look the same.
+#define MAX_LEVEL_ROWS 32
+#define ROW_ROADSIDE 0x00
+#define ROW_LANE 0x10	// + lane (0 to 2)
+#define ROW_RIVER 0x20	// + channel (0 or 1)
+#define ROW_RIVERBANK 0x30
+#define ROW_KIND(role) ((role) & 0xF0)
+#define ROW_INDEX(role) ((role) & 0x0F)
+typedef struct {
+	uint8_t role;
+	uint8_t offset;
+} RowInfo;
+
+static const RowInfo short_rows[MATRIX_NUM_ROWS] PROGMEM = {
+	{ROW_ROADSIDE, 0}, {ROW_LANE+0, 0}, {ROW_LANE+1, 0}, {ROW_LANE+2, 0},
+	{ROW_ROADSIDE, 0}, {ROW_RIVER+0, 0}, {ROW_RIVER+1, 0}, {ROW_RIVERBANK, 0}
+};
+
+// Four crossings of the road and the river
+static const RowInfo tall_rows[MAX_LEVEL_ROWS] PROGMEM = {
+	{ROW_ROADSIDE, 0}, {ROW_LANE+0, 0}, {ROW_LANE+1, 0}, {ROW_LANE+2, 0},
+	{ROW_ROADSIDE, 0}, {ROW_RIVER+0, 0}, {ROW_RIVER+1, 0}, {ROW_ROADSIDE, 0},
+	{ROW_LANE+0, 23}, {ROW_LANE+1, 23}, {ROW_LANE+2, 23}, {ROW_ROADSIDE, 0},
+	{ROW_RIVER+0, 11}, {ROW_RIVER+1, 11}, {ROW_ROADSIDE, 0}, {ROW_LANE+0, 41},
+	{ROW_LANE+1, 41}, {ROW_LANE+2, 41}, {ROW_ROADSIDE, 0}, {ROW_RIVER+0, 21},
+	{ROW_RIVER+1, 21}, {ROW_ROADSIDE, 0}, {ROW_LANE+0, 9}, {ROW_LANE+1, 9},
+	{ROW_LANE+2, 9}, {ROW_ROADSIDE, 0}, {ROW_RIVER+0, 5}, {ROW_RIVER+1, 5},
+	{ROW_ROADSIDE, 0}, {ROW_RIVER+0, 17}, {ROW_RIVER+1, 17}, {ROW_RIVERBANK, 0}
+};
+
+static const RowInfo* row_info;	// the current level's layout (program memory)
+static uint8_t level_rows;
+static uint8_t riverbank_row;	// the top row - where the frog finishes
+static uint8_t view_bottom;	// the level row shown in display row 0
+
+// The display scrolls to keep the frog being followed between these
+// display rows
+#define VIEW_LOWEST_ROW 2
+#define VIEW_HIGHEST_ROW 5
+
 // River bank pattern. Note that the least significant bit in this
 // pattern (RHS) corresponds to column 0 on the display (LHS).
 #define RIVERBANK 0b1101110111011101
-static uint16_t riverbank = RIVERBANK;
+static uint16_t riverbank;
 // riverbank_status is a bit pattern similar to riverbank but will
 // only have zeroes where there are unoccupied holes. When this is all 1's
 // then the game/level is complete
-static uint16_t riverbank_status = RIVERBANK;
+static uint16_t riverbank_status;
+
+// Danger masks - for each row, a 1 in bit N means a frog in column N of
+// that row dies (a vehicle, water, a hazard (entity.h) or a riverbank
+// edge or full hole). The masks are worked out as each row is redrawn, so
+// a collision check is a single bit test however many frogs and hazards
+// there are.
+static uint16_t danger[MAX_LEVEL_ROWS];
+
+// Where each player's frog starts (row 0)
+static const int8_t start_column[MAX_FROGS] PROGMEM = {7, 8};
+
+// A hazard placed at the start of a level - see add_entity() in entity.h.
+// River hazards are placed on the log data, in the water. The entities
+// are added in order, so entity N is the one from entry N.
+typedef struct {
+	uint8_t type;	// ENTITY_NONE for an unused entry
+	uint8_t row;
+	int8_t column;
+	int8_t velocity;	// the channel's scroll direction in the river
+	uint8_t width;
+	uint8_t phase;
+} EntitySpawn;
+
+// Level layouts. The first is used for level 1, after that the game
+// alternates between the second and third. The one in use is copied into
+// the variables above by load_level() (and its hazards added by
+// initialise_game()).
+typedef struct {
+	uint64_t lanes[3];
+	uint32_t logs[2];
+	const RowInfo* rows;
+	uint8_t num_rows;
+	uint16_t riverbank;
+	PixelColour edges;
+	PixelColour logs_colour;
+	PixelColour vehicles[3];
+	EntitySpawn entities[MAX_LEVEL_ENTITIES];
+} LevelData;
+
+static const LevelData level_data[3] PROGMEM = {
+	{
+		{0b1100001100011000110000011001100011000011000110001100000110011000,
+		0b0011100000111000011100000111000011100001110001110000111000011100,
+		0b0000111100001111000011110000111100001111000001111100001111000111},
+		{0b11110001100111000111100011111000,
+		0b11100110111101100001110110011100},
+		short_rows, MATRIX_NUM_ROWS, RIVERBANK, 0x11, 0x3C, {0x0F, 0xDF, 0x0F},
+		{{ENTITY_TURTLE, FIRST_RIVER_ROW, 0, -1, 2, 0},
+		{ENTITY_TURTLE, SECOND_RIVER_ROW, 13, 1, 3, 5}}
+	},
+	{
+		{0b1100111100111100111001111001110011100111001110001110011110011100,
+		0b0011110001111000011110001111000111000011100011110001111000111000,
+		0b1100111100011111000111110001111100001111000011110011001111000111},
+		{0b1100001100110100110011010011010,
+		0b1110001110110110010101110001011},
+		short_rows, MATRIX_NUM_ROWS, 0b1011101111011101, 0x3C, 0xDF, {0x11, 0x0F, 0x11},
+		{{ENTITY_CROCODILE, FIRST_RIVER_ROW, 25, -1, 3, 0},
+		{ENTITY_TURTLE, SECOND_RIVER_ROW, 4, 1, 3, 0},
+		{ENTITY_SNAKE, HALFWAY_ROW, 16, -1, 3, 0}}
+	},
+	{
+		{0b0000001100001100010000110001110001001100011100001100011100110110,
+		0b0000110010100000111000110000110010000110000001100011100001110001,
+		0b0010011000010101001100111001001111000010101011100011011000001100},
+		{0b00000110000110000011100001100011,
+		0b00011001010100011110000011100010},
+		tall_rows, MAX_LEVEL_ROWS, 0b1110111011110011, 0x35, 0x0F, {0x3C, 0x3C, 0xDF},
+		{{ENTITY_SNAKE, HALFWAY_ROW, 0, 1, 3, 0},
+		{ENTITY_CROCODILE, SECOND_RIVER_ROW, 9, 1, 3, 0},
+		{ENTITY_TURTLE, FIRST_RIVER_ROW, 7, -1, 3, 3},
+		{ENTITY_TURTLE, FIRST_RIVER_ROW, 15, -1, 3, 8}}
+	}
+};
 
 
 /////////////////////////////// Function Prototypes for Helper Functions ///////
 // These functions are defined after the public functions. Comments are with the
 // definitions.
+static uint8_t frog_in_play(uint8_t frog);
+static uint8_t row_role(uint8_t row);
+static uint8_t row_is_visible(uint8_t row);
+static uint8_t row_is_live(uint8_t row);
+static void show_row(uint8_t row, MatrixRow data);
+static void follow_frog(void);
+static void scroll_view_to(int8_t bottom);
+static void put_frog_in_start_position(uint8_t frog);
+static void move_frog_by(uint8_t frog, int8_t rows, int8_t columns);
+static void check_frogs_in_row(uint8_t row);
 static uint8_t will_frog_die_at_position(int8_t row, int8_t column);
 static void redraw_whole_display(void);
 static void redraw_row(uint8_t row);
+static void redraw_scenery(uint8_t row);
 static void redraw_roadside(uint8_t row);
-static void redraw_traffic_lane(uint8_t lane);
-static void redraw_river_channel(uint8_t channel);
+static void redraw_traffic_lane(uint8_t row);
+static void redraw_river_channel(uint8_t row);
 static void redraw_riverbank(void);
-static void redraw_frog(void);
+static void redraw_frog(uint8_t frog);
+static void redraw_frogs_in_row(uint8_t row);
+static void load_level(uint8_t level);
+static void add_level_entities(void);
 
 /////////////////////////////// Public Functions ///////////////////////////////
 // These functions are defined in the same order as declared in game.h
@@ -106,152 +255,144 @@ void initialise_game(void) {
 	// Initial lane and log positions
 	lane_position[0] = lane_position[1] = lane_position[2] = 0;
 	log_position[0] = log_position[1] = 0;
-
-	if(time_died>=5){ //Only run when start a new game
-		time_died = 2;
-	}
+	// and hazards
+	add_level_entities();
 	
+	// The frogs start at the bottom
+	view_bottom = 0;
 	redraw_whole_display();
 	
-	// Add a frog to the roadside - this will redraw the frog
-	put_frog_in_start_position();
+	// Add the frogs to the roadside - this will redraw them
+	for(uint8_t i = 0; i < num_frogs; i++) {
+		if(frog_in_play(i)) {
+			put_frog_in_start_position(i);
+		}
+	}
 }
 
-// Add a frog to the game
-void put_frog_in_start_position(void) {
+void set_number_of_frogs(uint8_t number) {
+	if(number >= 1 && number <= MAX_FROGS) {
+		num_frogs = number;
+	}
+}
 
+uint8_t get_number_of_frogs(void) {
+	return num_frogs;
+}
 
-	// Initial starting position of frog (7,0)
-	frog_row = 0;
-	frog_column = 7;
-	
-	// Frog is initially alive
-	frog_dead = 0;
-	
-	// Show the frog
-	redraw_frog();
-	
+void set_game_quiet(uint8_t on) {
+	quiet = on;
 }
 
-// This function assumes that the frog is not in row 7 (the top row). A frog in row 7 is out
-// of the game.
-void move_frog_forward(void) {
-	// Redraw the row the frog is currently on (this will remove the frog)
-	redraw_row(frog_row);
-	
-	// Check whether this move will cause the frog to die or not
-	frog_dead = will_frog_die_at_position(frog_row+1, frog_column);
-	
-	// Move the frog position forward and show the frog.
-	// We do this whether the frog is alive or not.
-	frog_row++;
-	redraw_frog();
+void move_frog(uint8_t frog, uint8_t move){
+	if(frog >= num_frogs || !frog_in_play(frog) || frogs[frog].dead) {
+		return;
+	}
+	switch(move){
+		case MOVE_LEFT:
+		move_frog_by(frog, 0, -1);
+		break;
+		case MOVE_RIGHT:
+		move_frog_by(frog, 0, 1);
+		break;
+		case MOVE_FORWARD:
+		move_frog_by(frog, 1, 0);
+		break;
+		case MOVE_BACKWARD:
+		move_frog_by(frog, -1, 0);
+		break;
+		case MOVE_LEFT_UP:
+		move_frog_by(frog, 1, -1);
+		break;
+		case MOVE_RIGHT_UP:
+		move_frog_by(frog, 1, 1);
+		break;
+		case MOVE_LEFT_DOWN:
+		move_frog_by(frog, -1, -1);
+		break;
+		case MOVE_RIGHT_DOWN:
+		move_frog_by(frog, -1, 1);
+		break;
+	}
+}
 
-	add_to_score(1);
-	
-	// If the frog has ended up successfully in row 7 - add it to the riverbank_status flag
-	if(!frog_dead && frog_row == RIVERBANK_ROW) {
-		make_noise(4000); //Buzzer
-		add_to_score(10);
-		update_temp();
-		reset_count(); //Reset game timer
-		riverbank_status |= (1<<frog_column);
-	}
-}
-void move_frog_backward(void) {
-	redraw_row(frog_row);
-	frog_dead = will_frog_die_at_position(frog_row-1, frog_column);
-	frog_row--;
-	redraw_frog();
-}
-void move_frog_to_left(void) {
-	redraw_row(frog_row);
-	frog_dead = will_frog_die_at_position(frog_row, frog_column-1);
-	frog_column--;
-	redraw_frog();
-}
-void move_frog_to_right(void) {
-	redraw_row(frog_row);
-	frog_dead = will_frog_die_at_position(frog_row, frog_column+1);
-	frog_column++;
-	redraw_frog();
-}
-void move_right_up(void){
-	redraw_row(frog_row);
-	add_to_score(1);
-	frog_dead = will_frog_die_at_position(frog_row+1, frog_column+1);
-	frog_column++;
-	frog_row++;
-	redraw_frog();
-}
-void move_left_up(void){
-	redraw_row(frog_row);
-	add_to_score(1);
-	frog_dead = will_frog_die_at_position(frog_row+1, frog_column-1);
-	frog_column--;
-	frog_row++;
-	redraw_frog();
-}
-void move_right_down(void){
-	redraw_row(frog_row);
-	frog_dead = will_frog_die_at_position(frog_row-1, frog_column+1);
-	frog_column++;
-	frog_row--;
-	redraw_frog();
-}
-void move_left_down(void){
-	redraw_row(frog_row);
-	frog_dead = will_frog_die_at_position(frog_row-1, frog_column-1);
-	frog_column--;
-	frog_row--;
-	redraw_frog();
-}
-uint8_t get_frog_row(void) {
-	return frog_row;
-}
-
-uint8_t get_frog_column(void) {
-	return frog_column;
+uint8_t get_frog_row(uint8_t frog) {
+	return frogs[frog].row;
+}
+
+uint8_t get_frog_column(uint8_t frog) {
+	return frogs[frog].column;
 }
 
 uint8_t is_riverbank_full(void) {
 	return (riverbank_status == 0xFFFF);
 }
 
-uint8_t frog_has_reached_riverbank(void) {
-	return (frog_row == RIVERBANK_ROW);
+uint16_t get_riverbank_status(void) {
+	return riverbank_status;
 }
 
-uint8_t is_frog_dead(void) {
-	if(get_count() <= 0){ //If ran out of time then kill the frog
-		frog_dead = 1;
+uint8_t update_frogs(void) {
+	uint8_t in_play = 0;
+	
+	if(count_expired_at(game_tick)){ //If ran out of time then kill the frogs
+		for(uint8_t i = 0; i < num_frogs; i++) {
+			if(frog_in_play(i) && !frogs[i].dead) {
+				frogs[i].dead = 1;
+			}
+		}
 	}
-	if(frog_dead == 1){
-		time_died++; //Add to the death counter
-		reset_to_temp(); //Reset score to before you died
-		make_noise(1000); //Buzzer
-		if(time_died>=5){ //You will start with 3 lives then increase after each level. Maximum 5 lives.
-			return 1; //Stop the game if you've ran out of lives
+	for(uint8_t i = 0; i < num_frogs; i++) {
+		Frog* frog = &frogs[i];
+		if(!frog_in_play(i)) {
+			continue;
+		}
+		if(frog->dead == FROG_DYING) {
+			if(game_tick >= frog->respawn_tick) {
+				put_frog_in_start_position(i);
+			}
+		} else if(frog->dead){
+			frog->time_died++; //Add to the death counter
+			reset_to_temp(i); //Reset score to before you died
+			if(!quiet) {
+				make_noise(1000); //Buzzer
+			}
+			if(row_is_visible(frog->row)) {
+				effects_flash(frog->column, frog->row - view_bottom, COLOUR_BLACK,
+						DEATH_FLASH_PERIOD, DEATH_TIME);
+			}
+			if(frog->time_died >= MAX_TIME_DIED){ //You will start with 3 lives then increase after each level. Maximum 5 lives.
+				// Out of the game. The last frog stays on the display as
+				// it died, any others are taken off
+				if(num_frogs > 1) {
+					redraw_row(frog->row);
+				}
+				continue;
+			}
+			if(!quiet) {
+				show_score();
+			}
+			reset_count_at(game_tick); //Reset the game timer
+			// The frog comes back after a while - it can't be moved meanwhile
+			frog->dead = FROG_DYING;
+			frog->respawn_tick = game_tick + DEATH_TIME;
+		} else if(frog->row == riverbank_row && !is_riverbank_full()) {
+			// Frog reached the other side successfully but the
+			// riverbank isn't full, put a new frog at the start
+			put_frog_in_start_position(i);
 		}
-		show_score();
-		reset_count(); //Reset the game timer
-		pause();
-		_delay_ms(250); //Stop everything for 1/2 second when the frog dies
-		_delay_ms(250);
-		clear_push();
-		unpause();
-		redraw_frog();
-		put_frog_in_start_position();
-		return 0;
+		in_play++;
 	}
-	return 0; //Keep playing
+	return in_play != 0 && !is_riverbank_full();
 }
 
+uint8_t get_time_died(uint8_t frog){ //How many times have the frog died?
+	return frogs[frog].time_died;
+}
 
-// Scroll the given lane of traffic. (lane value must be 0 to 2)
+// Scroll the given lane of traffic (every row of it). (lane value must be
+// 0 to 2)
 void scroll_vehicle_lane(uint8_t lane, int8_t direction) {
-	uint8_t frog_is_in_this_row = (frog_row == lane + FIRST_VEHICLE_ROW);
-	
 	// Work out the new lane position.
 	// Wrap numbers around if they go out of range
 	// A direction of -1 indicates movement to the left which means we
@@ -263,33 +404,36 @@ void scroll_vehicle_lane(uint8_t lane, int8_t direction) {
 		lane_position[lane] = 0;
 	}
 	
-	// Show the lane on the display
-	redraw_traffic_lane(lane);
-	
-	// If the frog is in this row, check whether it is dead or
-	// not (may have been hit by a vehicle) and show it
-	if(frog_is_in_this_row) {
-		frog_dead = will_frog_die_at_position(frog_row, frog_column);
-		redraw_frog();
+	// Show the lane on the display (this works out the new danger mask)
+	// and check whether any frogs in it have been hit. Rows which are off
+	// the display with no frogs in them are left until they are needed.
+	for(uint8_t row = 0; row < level_rows; row++) {
+		if(row_role(row) == ROW_LANE + lane && row_is_live(row)) {
+			redraw_traffic_lane(row);
+			check_frogs_in_row(row);
+		}
 	}
 }
 
 
 
 void scroll_river_channel(uint8_t channel, int8_t direction) {
-	uint8_t frog_is_in_this_row = (frog_row == channel + FIRST_RIVER_ROW);
-	// Note, if the frog is in this row then it will be on a log
-	
-	if(frog_is_in_this_row) {
+	// Any frogs in this channel are on a log - move them with it
+	for(uint8_t i = 0; i < num_frogs; i++) {
+		Frog* frog = &frogs[i];
+		if(!frog_in_play(i) || frog->dead || frog->row < 0 || frog->row >= level_rows
+				|| row_role(frog->row) != ROW_RIVER + channel) {
+			continue;
+		}
 		// Check if they're going to hit the edge - don't let the frog
 		// go beyond the edge
-		if(direction == 1 && frog_column == 15) {
-			frog_dead = 1; // hit right edge
-			} else if(direction == -1 && frog_column == 0) {
-			frog_dead = 1; // hit left edge
+		if(direction == 1 && frog->column == 15) {
+			frog->dead = 1; // hit right edge
+			} else if(direction == -1 && frog->column == 0) {
+			frog->dead = 1; // hit left edge
 			} else {
 			// Move the frog with the log - they're not going to hit the edge
-			frog_column += direction;
+			frog->column += direction;
 		}
 	}
 	
@@ -302,180 +446,424 @@ void scroll_river_channel(uint8_t channel, int8_t direction) {
 		log_position[channel] = 0;
 	}
 	
-	// Work out the log data to send to the display
-	redraw_river_channel(channel);
-	
-	// If the frog is in this row, put them on the log
-	if(frog_is_in_this_row) {
-		redraw_frog();
+	// Work out the log data to send to the display and put the frogs back
+	// on their logs (rows which aren't needed yet are left)
+	for(uint8_t row = 0; row < level_rows; row++) {
+		if(row_role(row) == ROW_RIVER + channel && row_is_live(row)) {
+			redraw_river_channel(row);
+			redraw_frogs_in_row(row);
+		}
 	}
 }
 
-
-uint8_t get_time_died(void){ //How many times have the frog died?
-	return time_died;
+void step_hazards(void) {
+	uint32_t rows = step_entities();
+	for(uint8_t row = 0; rows; row++, rows >>= 1) {
+		if((rows & 1) && row_is_live(row)) {
+			redraw_scenery(row);
+			check_frogs_in_row(row);
+		}
+	}
 }
 
 void next_level(void){ //Layout will alternate between Level 2 and 3 after the player completed level 3
-	if(layout==0){
-		lane_data[0] =
-		0b1100111100111100111001111001110011100111001110001110011110011100;
-		lane_data[1]=
-		0b0011110001111000011110001111000111000011100011110001111000111000;
-		lane_data[2]=0b1100111100011111000111110001111100001111000011110011001111000111;
-
-		log_data[0] =
-		0b1100001100110100110011010011010;
-		log_data[1] =
-		0b1110001110110110010101110001011;
-
-		COLOUR_EDGES = 0x3C;
-		COLOUR_LOGS	= 0xDF;
-		vehicle_colours[0] = 0x11;
-		vehicle_colours[1] = 0x0F;
-		vehicle_colours[2] = 0x11;
-
-		riverbank = 0b1011101111011101;
-		riverbank_status = 0b1011101111011101;
-		}else{
-		lane_data[0] =
-		0b0000001100001100010000110001110001001100011100001100011100110110;
-		lane_data[1]=
-		0b0000110010100000111000110000110010000110000001100011100001110001;
-		lane_data[2]=
-		0b0010011000010101001100111001001111000010101011100011011000001100;
-
-		log_data[0] =
-		0b00000110000110000011100001100011;
-		log_data[1] =
-		0b00011001010100011110000011100010;
-
-		COLOUR_EDGES = 0x35;
-		COLOUR_LOGS	= 0x0F;
-		vehicle_colours[0] = 0x3C;
-		vehicle_colours[1] = 0x3C;
-		vehicle_colours[2] = 0xDF;
-
-		riverbank = 0b1110111011110011;
-		riverbank_status = 0b1110111011110011;
-	}
-	if(time_died>=1){ //Add lives to the frog/ Maximum is 5 lives
-		time_died--;
+	load_level(1 + layout);
+	for(uint8_t i = 0; i < num_frogs; i++) {
+		if(frog_in_play(i) && frogs[i].time_died>=1){ //Add lives to the frog/ Maximum is 5 lives
+			frogs[i].time_died--;
+		}
 	}
 	layout = 1 - layout;
 }
 
+void reset_levels(void){ //Back to the level 1 layout and full lives for a new game
+	load_level(0);
+	layout = 0;
+	for(uint8_t i = 0; i < MAX_FROGS; i++) {
+		frogs[i].time_died = INITIAL_TIME_DIED;
+	}
+}
+
+void set_game_tick(uint32_t tick){
+	game_tick = tick;
+}
+
+void get_game_state(GameState* state){ //Snapshot of the game (player 1) for telemetry
+	state->frog_row = frogs[0].row;
+	state->frog_column = frogs[0].column;
+	for(uint8_t lane = 0; lane < 3; lane++){
+		state->lane_position[lane] = lane_position[lane];
+	}
+	state->log_position[0] = log_position[0];
+	state->log_position[1] = log_position[1];
+	state->riverbank_status = riverbank_status;
+	state->score = get_score(0);
+	state->time_died = frogs[0].time_died;
+	state->count = get_count_at(game_tick);
+}
+
+uint8_t get_level_rows(void){
+	return level_rows;
+}
+
+int8_t get_row_scrolling(uint8_t row){
+	uint8_t role;
+	if(row >= level_rows) {
+		return -1;
+	}
+	role = row_role(row);
+	switch(ROW_KIND(role)) {
+		case ROW_LANE:
+		return ROW_INDEX(role);
+		case ROW_RIVER:
+		return 3 + ROW_INDEX(role);
+	}
+	return -1;
+}
+
+uint16_t get_row_danger(uint8_t row){
+	if(row >= level_rows) {
+		return 0xFFFF;
+	}
+	if(!row_is_live(row)) {
+		redraw_scenery(row); // bring its danger mask up to date
+	}
+	return danger[row];
+}
+
+uint8_t get_saved_game(SavedGame* saved){
+	for(uint8_t i = 0; i < num_frogs; i++) {
+		if(frog_in_play(i) && frogs[i].dead) {
+			return 0;
+		}
+	}
+	saved->level = current_level;
+	saved->layout = layout;
+	saved->num_frogs = num_frogs;
+	for(uint8_t i = 0; i < MAX_FROGS; i++) {
+		saved->frogs[i].row = frogs[i].row;
+		saved->frogs[i].column = frogs[i].column;
+		saved->frogs[i].time_died = frogs[i].time_died;
+	}
+	for(uint8_t lane = 0; lane < 3; lane++){
+		saved->lane_position[lane] = lane_position[lane];
+	}
+	saved->log_position[0] = log_position[0];
+	saved->log_position[1] = log_position[1];
+	saved->riverbank_status = riverbank_status;
+	for(uint8_t i = 0; i < MAX_LEVEL_ENTITIES; i++) {
+		get_entity_state(i, &saved->entities[i]);
+	}
+	return 1;
+}
+
+void restore_saved_game(const SavedGame* saved){
+	load_level(saved->level);
+	layout = saved->layout;
+	set_number_of_frogs(saved->num_frogs);
+	for(uint8_t i = 0; i < MAX_FROGS; i++) {
+		frogs[i].row = saved->frogs[i].row;
+		frogs[i].column = saved->frogs[i].column;
+		frogs[i].time_died = saved->frogs[i].time_died;
+		frogs[i].dead = 0;
+	}
+	for(uint8_t lane = 0; lane < 3; lane++){
+		lane_position[lane] = saved->lane_position[lane];
+	}
+	log_position[0] = saved->log_position[0];
+	log_position[1] = saved->log_position[1];
+	riverbank_status = saved->riverbank_status;
+	add_level_entities();
+	for(uint8_t i = 0; i < MAX_LEVEL_ENTITIES; i++) {
+		set_entity_state(i, &saved->entities[i]);
+	}
+	
+	view_bottom = 0;
+	redraw_whole_display();
+	follow_frog();
+	for(uint8_t i = 0; i < num_frogs; i++) {
+		if(frog_in_play(i)) {
+			redraw_frog(i);
+		}
+	}
+}
+
+uint8_t game_check_invariants(void){
+	uint8_t broken = 0;
+	if(num_frogs < 1 || num_frogs > MAX_FROGS) {
+		return INVARIANT_NUM_FROGS;
+	}
+	for(uint8_t i = 0; i < num_frogs; i++) {
+		Frog* f = &frogs[i];
+		if(f->time_died > MAX_TIME_DIED) {
+			broken |= INVARIANT_LIVES;
+		}
+		if(!frog_in_play(i) || f->dead) {
+			continue;
+		}
+		if(f->row < 0 || f->row > riverbank_row || f->column < 0 || f->column > 15) {
+			broken |= INVARIANT_ON_FIELD;
+		} else if(f->row != riverbank_row && ((danger[f->row] >> f->column) & 1)) {
+			// (the frog's row is live, so its danger mask is up to date)
+			broken |= INVARIANT_SAFE;
+		}
+	}
+	if((riverbank_status & riverbank) != riverbank) {
+		broken |= INVARIANT_RIVERBANK;
+	}
+	for(uint8_t lane = 0; lane < 3; lane++) {
+		if(lane_position[lane] < 0 || lane_position[lane] >= LANE_DATA_WIDTH) {
+			broken |= INVARIANT_POSITIONS;
+		}
+	}
+	for(uint8_t channel = 0; channel < 2; channel++) {
+		if(log_position[channel] < 0 || log_position[channel] >= LOG_DATA_WIDTH) {
+			broken |= INVARIANT_POSITIONS;
+		}
+	}
+	if(view_bottom + MATRIX_NUM_ROWS > level_rows) {
+		broken |= INVARIANT_VIEW;
+	}
+	return broken;
+}
+
 /////////////////////////////// Private (Helper) Functions /////////////////////
 
-// Return 1 if the frog will die at the given position.
+// A frog is in play if it belongs to one of the players and hasn't run out
+// of lives
+static uint8_t frog_in_play(uint8_t frog) {
+	return frog < num_frogs && frogs[frog].time_died < MAX_TIME_DIED;
+}
+
+// Put a frog back at its starting position on the roadside, alive. (If it
+// was still on the display somewhere else it is taken off.)
+static void put_frog_in_start_position(uint8_t frog) {
+	Frog* f = &frogs[frog];
+	int8_t old_row = f->row;
+	
+	if(!row_is_live(START_ROW)) {
+		redraw_scenery(START_ROW); // bring its danger mask up to date
+	}
+	f->row = START_ROW;
+	f->column = pgm_read_byte(&start_column[frog]);
+	f->dead = 0;
+	if(old_row != START_ROW) {
+		redraw_row(old_row);
+	}
+	redraw_frog(frog);
+	follow_frog();
+}
+
+// Move a frog. Moving up a row scores a point and reaching the riverbank
+// fills the hole (in a tall level reaching a roadside row also starts the
+// countdown again). The frog is moved (and shown) whether it survives the
+// move or not - update_frogs() deals with it if it died.
+static void move_frog_by(uint8_t frog, int8_t rows, int8_t columns) {
+	Frog* f = &frogs[frog];
+	int8_t old_row = f->row;
+	
+	// Check whether this move will cause the frog to die or not
+	f->dead = will_frog_die_at_position(f->row + rows, f->column + columns);
+	f->row += rows;
+	f->column += columns;
+	
+	// Redraw the row the frog was on (this will remove the frog but not any
+	// others there) and show the frog in its new position
+	redraw_row(old_row);
+	redraw_frog(frog);
+	
+	if(rows > 0) {
+		add_to_score(frog, 1);
+		// If the frog has ended up successfully in row 7 - add it to the
+		// riverbank_status flag
+		if(!f->dead && f->row == riverbank_row) {
+			if(!quiet) {
+				make_noise(4000); //Buzzer
+			}
+			add_to_score(frog, 10);
+			update_temp(frog);
+			reset_count_at(game_tick); //Reset game timer
+			riverbank_status |= (1<<f->column);
+			danger[riverbank_row] = riverbank_status;
+		} else if(!f->dead && level_rows > MATRIX_NUM_ROWS
+				&& row_role(f->row) == ROW_ROADSIDE) {
+			reset_count_at(game_tick);
+		}
+	}
+	follow_frog();
+}
+
+// A row has just been redrawn after scrolling - check the frogs in it
+// against its danger mask and show them again
+static void check_frogs_in_row(uint8_t row) {
+	uint16_t mask = danger[row];
+	for(uint8_t i = 0; i < num_frogs; i++) {
+		Frog* f = &frogs[i];
+		if(f->row == row && frog_in_play(i)) {
+			if(!f->dead && ((mask >> f->column) & 1)) {
+				f->dead = 1;
+			}
+			redraw_frog(i);
+		}
+	}
+}
+
+// Return 1 if a frog will die at the given position.
 // Return 0 if the frog CAN jump to the given position (i.e. it is not occupied by
 // a vehicle), or, if in the river, then it IS occupied by a log, or, if the final
 // riverbank then that space is free.
 static uint8_t will_frog_die_at_position(int8_t row, int8_t column) {
-	uint8_t lane, channel, bit_position;
-	if(column < 0 || column > 15) {
+	if(column < 0 || column > 15 || row < 0 || row > riverbank_row) {
+		// Off the game field
 		return 1;
 	}
-	switch(row) {
-		case 0: // always safe
-		case 4: // always safe
-		return 0;
-		break;
-		case 1:
-		case 2:
-		case 3:
-		lane = row - 1;
-		bit_position = lane_position[lane] + column;
-		if(bit_position >= LANE_DATA_WIDTH) {
-			bit_position -= LANE_DATA_WIDTH;
-		}
-		return (lane_data[lane] >> bit_position) & 1;
-		break;
-		case 5:
-		case 6:
-		channel = row - 5;
-		bit_position = log_position[channel] + column;
-		if(bit_position >= LOG_DATA_WIDTH) {
-			bit_position -= LOG_DATA_WIDTH;
-		}
-		return !((log_data[channel] >> bit_position) & 1);
-		break;
-		case 7:
-		return (riverbank_status >> column) & 1;
-		break;
+	if(!row_is_live(row)) {
+		redraw_scenery(row); // bring its danger mask up to date
 	}
-	// Any row outside the valid range means the frog will die
-	return 1;
+	return (danger[row] >> column) & 1;
 }
 
-// Redraw the rows on the game field. The frog is not redrawn.
+// Redraw the rows on the game field (and the hazards on them). The frogs
+// are not redrawn. Rows off the display only have their danger masks
+// worked out.
 static void redraw_whole_display(void) {
 	// Clear the display
 	ledmatrix_clear();
 	
-	// Start with the starting and halfway rows
-	redraw_roadside(START_ROW);
-	redraw_roadside(HALFWAY_ROW);
-
-	// Redraw traffic lanes
-	for(uint8_t lane=0; lane<=2; lane++) {
-		redraw_traffic_lane(lane);
+	for(uint8_t row = 0; row < level_rows; row++) {
+		redraw_scenery(row);
 	}
-	// Redraw river
-	for(uint8_t channel=0; channel<=1; channel++) {
-		redraw_river_channel(channel);
-	}
-	// Redraw riverbank
-	redraw_riverbank();
 }
 
-// Redraw the row with the given number (0 to 7). The frog is not redrawn.
+// Redraw the row with the given number (0 to the riverbank), including any
+// frogs in it. (This is how a frog is removed from its old position - the
+// display is updated to show the right colour pixel in its place.)
 static void redraw_row(uint8_t row) {
-	// Remove frog from current position (we need to update the display
-	// so it shows the right colour pixel in its place). We know the frog
-	// must be either on a road edge, on the road or on a log.
-	switch(row) {
-		case START_ROW:
-		case HALFWAY_ROW:
+	if(row > riverbank_row) {
+		// Invalid row - ignore
+		return;
+	}
+	redraw_scenery(row);
+	redraw_frogs_in_row(row);
+}
+
+// Redraw the given row without its frogs
+static void redraw_scenery(uint8_t row) {
+	switch(ROW_KIND(row_role(row))) {
+		case ROW_ROADSIDE:
 		redraw_roadside(row);
 		break;
-		case FIRST_VEHICLE_ROW:
-		case SECOND_VEHICLE_ROW:
-		case THIRD_VEHICLE_ROW:
-		redraw_traffic_lane(row-1);
+		case ROW_LANE:
+		redraw_traffic_lane(row);
 		break;
-		case FIRST_RIVER_ROW:
-		case SECOND_RIVER_ROW:
-		redraw_river_channel(row-5);
+		case ROW_RIVER:
+		redraw_river_channel(row);
 		break;
-		case RIVERBANK_ROW:
+		case ROW_RIVERBANK:
 		redraw_riverbank();
 		break;
-		default:
-		// Invalid row - ignore
-		break;
 	}
 }
 
+// What the given row of the level is (ROW_ values)
+static uint8_t row_role(uint8_t row) {
+	return pgm_read_byte(&row_info[row].role);
+}
+
+static uint8_t row_is_visible(uint8_t row) {
+	return (uint8_t)(row - view_bottom) < MATRIX_NUM_ROWS;
+}
+
+// A row is kept up to date (redrawn as it scrolls) if it is on the display
+// or has a frog in it. Other rows are worked out when they are needed.
+static uint8_t row_is_live(uint8_t row) {
+	if(row_is_visible(row)) {
+		return 1;
+	}
+	for(uint8_t i = 0; i < num_frogs; i++) {
+		if(frogs[i].row == row && frog_in_play(i)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Send a row of the level to the display if it is in view
+static void show_row(uint8_t row, MatrixRow data) {
+	if(row_is_visible(row)) {
+		ledmatrix_update_row(row - view_bottom, data);
+	}
+}
+
+// Scroll the display to keep the frog being followed (player 1's, or player
+// 2's once player 1 is out of the game) in the middle of it
+static void follow_frog(void) {
+	int8_t row = frogs[frog_in_play(0) || num_frogs == 1 ? 0 : 1].row;
+	int8_t bottom = view_bottom;
+	if(row - bottom > VIEW_HIGHEST_ROW) {
+		bottom = row - VIEW_HIGHEST_ROW;
+	} else if(row - bottom < VIEW_LOWEST_ROW) {
+		bottom = row - VIEW_LOWEST_ROW;
+	}
+	if(bottom > level_rows - MATRIX_NUM_ROWS) {
+		bottom = level_rows - MATRIX_NUM_ROWS;
+	}
+	if(bottom < 0) {
+		bottom = 0;
+	}
+	scroll_view_to(bottom);
+}
+
+// Move the view so that the given level row is at the bottom. The display
+// is shifted a row at a time and only the row coming into view is sent -
+// unless the view moves a whole screen or more, when it is all redrawn.
+static void scroll_view_to(int8_t bottom) {
+	if(bottom - view_bottom >= MATRIX_NUM_ROWS || view_bottom - bottom >= MATRIX_NUM_ROWS) {
+		view_bottom = bottom;
+		for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+			redraw_row(view_bottom + y);
+		}
+		return;
+	}
+	while(view_bottom < bottom) {
+		view_bottom++;
+		ledmatrix_shift_display_down();
+		redraw_row(view_bottom + MATRIX_NUM_ROWS - 1);
+	}
+	while(view_bottom > bottom) {
+		view_bottom--;
+		ledmatrix_shift_display_up();
+		redraw_row(view_bottom);
+	}
+}
 
-// Redraw the given roadside row (0 or 4). The frog is not redrawn.
+
+// Redraw the given roadside row (0 or 4) and any hazards on it. The frog
+// is not redrawn.
 static void redraw_roadside(uint8_t row) {
 	MatrixRow row_display_data;
 	uint8_t i;
+	uint16_t solid, deadly;
 	for(i=0;i<=15;i++) {
 		row_display_data[i] = COLOUR_EDGES;
 	}
-	ledmatrix_update_row(row, row_display_data);
+	rasterize_entities(row, 0, row_display_data, &solid, &deadly);
+	danger[row] = deadly; // safe but for the hazards
+	show_row(row, row_display_data);
 }
 
-// Redraw the given traffic lane (0, 1, 2). The frog is not redrawn.
-static void redraw_traffic_lane(uint8_t lane) {
+// Redraw the given row of traffic. The frog is not redrawn.
+static void redraw_traffic_lane(uint8_t row) {
 	MatrixRow row_display_data;
 	uint8_t i;
-	uint8_t bit_position = lane_position[lane];
+	uint8_t lane = ROW_INDEX(row_role(row));
+	uint8_t bit_position = (lane_position[lane] + pgm_read_byte(&row_info[row].offset))
+			& (LANE_DATA_WIDTH-1);
+	uint16_t mask = 0;
 	for(i=0; i<=15; i++) {
 		if((lane_data[lane] >> bit_position) & 1) {
 			row_display_data[i] = vehicle_colours[lane];
+			mask |= (1U<<i);
 			} else {
 			row_display_data[i] = COLOUR_ROAD;
 		}
@@ -485,26 +873,37 @@ static void redraw_traffic_lane(uint8_t lane) {
 			bit_position = 0;
 		}
 	}
-	ledmatrix_update_row(lane+FIRST_VEHICLE_ROW, row_display_data);
+	danger[row] = mask; // vehicles
+	show_row(row, row_display_data);
 }
 
-// Redraw the given river channel (0 or 1). The frog is not redrawn.
-static void redraw_river_channel(uint8_t channel) {
+// Redraw the given row of river and the hazards in it. The frog is not
+// redrawn.
+static void redraw_river_channel(uint8_t row) {
 	MatrixRow row_display_data;
 	uint8_t i;
-	uint8_t bit_position = log_position[channel];
+	uint8_t channel = ROW_INDEX(row_role(row));
+	uint8_t start = (log_position[channel] + pgm_read_byte(&row_info[row].offset))
+			& (LOG_DATA_WIDTH-1);
+	uint8_t bit_position = start;
+	uint16_t mask = 0;
+	uint16_t solid, deadly;
 	for(i=0; i<=15; i++) {
 		if((log_data[channel] >> bit_position) & 1) {
 			row_display_data[i] = COLOUR_LOGS;
 			} else {
 			row_display_data[i] = COLOUR_WATER;
+			mask |= (1U<<i);
 		}
 		bit_position++;
 		if(bit_position >= LOG_DATA_WIDTH) {
 			bit_position = 0;
 		}
 	}
-	ledmatrix_update_row(channel+FIRST_RIVER_ROW, row_display_data);
+	// The hazards ride on the river with the logs
+	rasterize_entities(row, start, row_display_data, &solid, &deadly);
+	danger[row] = (mask & ~solid) | deadly; // water
+	show_row(row, row_display_data);
 }
 
 // Redraw the riverbank (top row). Previous frogs which have made it to a hole
@@ -525,15 +924,60 @@ static void redraw_riverbank(void) {
 			row_display_data[i] = 0;
 		}
 	}
+	// Edges and full holes are deadly
+	danger[riverbank_row] = riverbank_status;
 	// Output our riverbank to the display
-	ledmatrix_update_row(RIVERBANK_ROW, row_display_data);
+	show_row(riverbank_row, row_display_data);
 }
 
-// Redraw the frog in its current position.
-static void redraw_frog(void) {
-	if(frog_dead) {
-		ledmatrix_update_pixel(frog_column, frog_row, COLOUR_DEAD_FROG);
+// Copy a level layout from program memory
+static void load_level(uint8_t level) {
+	const LevelData* data = &level_data[level];
+	current_level = level;
+	row_info = pgm_read_ptr(&data->rows);
+	level_rows = pgm_read_byte(&data->num_rows);
+	riverbank_row = level_rows - 1;
+	memcpy_P(lane_data, data->lanes, sizeof(lane_data));
+	memcpy_P(log_data, data->logs, sizeof(log_data));
+	riverbank = pgm_read_word(&data->riverbank);
+	riverbank_status = riverbank;
+	COLOUR_EDGES = pgm_read_byte(&data->edges);
+	COLOUR_LOGS = pgm_read_byte(&data->logs_colour);
+	memcpy_P(vehicle_colours, data->vehicles, sizeof(vehicle_colours));
+}
+
+// Put the current level's hazards in their starting positions
+static void add_level_entities(void) {
+	const EntitySpawn* spawn = level_data[current_level].entities;
+	clear_entities();
+	for(uint8_t i = 0; i < MAX_LEVEL_ENTITIES; i++, spawn++) {
+		uint8_t type = pgm_read_byte(&spawn->type);
+		if(type != ENTITY_NONE) {
+			add_entity(type, pgm_read_byte(&spawn->row), (int8_t)pgm_read_byte(&spawn->column),
+					(int8_t)pgm_read_byte(&spawn->velocity), pgm_read_byte(&spawn->width),
+					pgm_read_byte(&spawn->phase));
+		}
+	}
+}
+
+// Redraw a frog in its current position.
+static void redraw_frog(uint8_t frog) {
+	Frog* f = &frogs[frog];
+	if(!row_is_visible(f->row)) {
+		return;
+	}
+	if(f->dead) {
+		ledmatrix_update_pixel(f->column, f->row - view_bottom, COLOUR_DEAD_FROG);
 		} else {
-		ledmatrix_update_pixel(frog_column, frog_row, COLOUR_FROG);
+		ledmatrix_update_pixel(f->column, f->row - view_bottom, frog == 0 ? COLOUR_FROG : COLOUR_FROG_2);
+	}
+}
+
+// Redraw the frogs (that are in play) in the given row
+static void redraw_frogs_in_row(uint8_t row) {
+	for(uint8_t i = 0; i < num_frogs; i++) {
+		if(frogs[i].row == row && frog_in_play(i)) {
+			redraw_frog(i);
+		}
 	}
 }
\ No newline at end of file
@@ -11,87 +11,195 @@
  * on to logs (rows 5 and 6) before jumping into into a hole
  * on the riverbank (row 7).
  *
+ * Some levels are taller - 32 rows of road and river, four crossings
+ * before the riverbank at the top. The display shows 8 rows of them and
+ * scrolls to follow the frog.
+ *
  * The functions in this module will update the LED matrix
  * display as required. 
+ *
+ * There is a frog for each player (up to MAX_FROGS). Each has its own
+ * score (score.h) and lives; the riverbank holes are shared. Frogs are
+ * numbered from 0 (player 1).
  */ 
 
 #ifndef GAME_H_
 #define GAME_H_
 
 #include <stdint.h>
+#include "entity.h"
 
-// Reset the game. Get the road and river ready and place a frog
+#define MAX_FROGS 2
+// The rows which scroll - three lanes of traffic then two river channels
+#define NUM_SCROLLING_ROWS 5
+// The most hazards a level starts with (see entity.h)
+#define MAX_LEVEL_ENTITIES 4
+
+// Reset the game. Get the road and river ready and place the frogs
 // on the roadside (bottom row)
 void initialise_game(void);
 
-// Add a frog to the game in the starting (bottom) row
-// (This would typically be called after a frog has made it 
-// successfully to the other side.)
-void put_frog_in_start_position(void);
-
-
-/////////////////////////////////// MOVE FUNCTIONS /////////////////////////
-// is_frog_dead() should be checked after calling one of these to see
-// if the move succeeded or not
-
-// Move the frog one row forward.
-// This function must NOT be called if the frog is in row 7 (i.e. home).
-// Failure may occur if the frog jumps into a vehicle or jumps in the water 
-// or jumps into the riverbank. 
-void move_frog_forward(void);
+// Set the number of players (1 to MAX_FROGS). Takes effect from the next
+// initialise_game().
+void set_number_of_frogs(uint8_t number);
+uint8_t get_number_of_frogs(void);
 
-// Move the frog one row backward, if possible.
-void move_frog_backward(void);
+// While quiet (on is 1) the game makes no sound and doesn't show the
+// score on the terminal - for a game nobody is playing (the attract mode)
+// with something else on the terminal. The LED matrix is still updated.
+void set_game_quiet(uint8_t on);
 
-// Move the frog one column left. 
-// Failure may occur if the frog jumps into a vehicle or jumps off a log
-// into the river. Attempts to jump off the game field result in the frog dying.
-void move_frog_to_left(void);
 
-// Move the frog one column right.
-// Failure may occur if the frog jumps into a vehicle or jumps off a log
-// into the river. Attempts to jump off the game field result in the frog dying. 
-void move_frog_to_right(void);
-
-void move_right_up(void);
-void move_left_up(void);
-void move_right_down(void);
-void move_left_down(void);
+/////////////////////////////////// MOVE FUNCTIONS /////////////////////////
+// update_frogs() should be called after a move to deal with the frog if
+// the move killed it or took it to the riverbank.
+// Moving up a row scores a point. Failure may occur if the frog jumps into
+// a vehicle, jumps in the water (or off a log into the river) or jumps into
+// the riverbank. Attempts to jump off the game field result in the frog
+// dying. Moves for frogs which are dead or out of the game are ignored.
+#define MOVE_NONE 0
+#define MOVE_LEFT 1
+#define MOVE_RIGHT 2
+#define MOVE_FORWARD 3
+#define MOVE_BACKWARD 4
+#define MOVE_LEFT_UP 5
+#define MOVE_RIGHT_UP 6
+#define MOVE_LEFT_DOWN 7
+#define MOVE_RIGHT_DOWN 8
+void move_frog(uint8_t frog, uint8_t move);
 
 /////////////////////// FROG / GAME STATUS ///////////////////////////////////
-// Return the position of the frog. The row ranges from 0 (bottom) to 7 (top).
-// The column ranges from 0 (left hand side) to 1 (right hand side)
-uint8_t get_frog_row(void);
-uint8_t get_frog_column(void);
+// Return the position of a frog. The row ranges from 0 (bottom) to 7 (top)
+// - or 31 in a tall level.
+// The column ranges from 0 (left hand side) to 15 (right hand side)
+uint8_t get_frog_row(uint8_t frog);
+uint8_t get_frog_column(uint8_t frog);
 
 // Check whether the destination riverbank is full (i.e. there are frogs 
 // in all the holes).
 uint8_t is_riverbank_full(void);
+// Which riverbank holes are filled (bit N for column N, the rest of the
+// riverbank set too)
+uint16_t get_riverbank_status(void);
+
+// Deal with frogs which have died (or run out of time) - a life is lost
+// and the frog flashes where it died for DEATH_TIME ticks then starts
+// again (the game and any other frogs carry on meanwhile), or is out of
+// the game if that was its last life - and with frogs which have reached
+// the riverbank, which start again. Returns 0 if the game or level is over: no frog is left in the
+// game or the riverbank is full.
+#define DEATH_TIME 500
+uint8_t update_frogs(void);
 
-// Check whether the frog has reached the riverbank (the other side).
-// (If this returns true, the frog should not be moved any further.)
-uint8_t frog_has_reached_riverbank(void);
-
-// Check whether the frog is alive or dead
-uint8_t is_frog_dead(void);
 void next_level(void);
-uint8_t get_time_died(void);
+// Lives a frog has lost (it is out of the game at 5)
+uint8_t get_time_died(uint8_t frog);
+
+// Go back to the level 1 layout (and empty riverbank) and give every frog
+// its lives back. Must be called before the first game and after each game
+// over.
+void reset_levels(void);
+
+// Set the game's idea of the current time (game clock milliseconds). The
+// main loop steps this one tick at a time so that the countdown (and
+// anything else timed) works out the same however fast the loop runs -
+// this is what makes recorded games play back exactly.
+void set_game_tick(uint32_t tick);
 
 
 
 /////////////////////// UPDATE FUNCTIONS /////////////////////////////////////
 // Scroll the given lane of traffic in the given direction. 
-// Check is_frog_dead() to determine whether the frog was killed or not.
+// Call update_frogs() afterwards in case a frog was killed.
 // lane argument is 0, 1 or 2 corresponding to rows 1, 2 and 3 on the display.
 // direction argument is -1 for left, 1 for right, 0 for no scroll (just redraw)
 void scroll_vehicle_lane(uint8_t lane, int8_t direction);
 
 // Scroll the given log channel (and the frog if the frog is on a log) in
 // the given direction.
-// Check is_frog_dead() to determine whether the frog was killed or not.
+// Call update_frogs() afterwards in case a frog was killed.
 // (Frog dies if it hits the edge of the game field whilst on a log.)
 // log argument is 0 or 1 (corresponding to rows 5 and 6 on the display).
 // direction argument is -1 for left, 1 for right, 0 for no scroll (just redraw)
 void scroll_river_channel (uint8_t channel, int8_t direction);
 
+
+// Step the moving hazards (turtles, crocodiles and snakes - see entity.h)
+// on one game tick. Call once a tick, after set_game_tick(), then call
+// update_frogs() in case a frog was killed.
+void step_hazards(void);
+
+
+/////////////////////// STATE CAPTURE ////////////////////////////////////////
+// A copy of the per-tick game state (used by the telemetry stream). The
+// frog, score and lives are player 1's.
+typedef struct {
+	int8_t frog_row;
+	int8_t frog_column;
+	int8_t lane_position[3];
+	int8_t log_position[2];
+	uint16_t riverbank_status;
+	uint32_t score;
+	uint8_t time_died;
+	uint8_t count;
+} GameState;
+
+// Fill in the given structure with the current state of the game
+void get_game_state(GameState* state);
+
+// What a player can see of the level (for computer players): the number
+// of rows, which of the scrolling rows (0 to 2 the lanes, 3 and 4 the
+// river channels - the order the main loop scrolls them in) a row moves
+// with (-1 if it doesn't) and the columns of a row where a frog would die
+// now (bit N for column N - all of them for a row off the level)
+uint8_t get_level_rows(void);
+int8_t get_row_scrolling(uint8_t row);
+uint16_t get_row_danger(uint8_t row);
+
+// Everything in this module a game needs to carry on from where it was -
+// part of a save state (savestate.h). The rest (the danger masks, the view
+// and the display) is worked out again from it.
+typedef struct {
+	int8_t row;
+	int8_t column;
+	uint8_t time_died;
+} SavedFrog;
+
+typedef struct {
+	uint8_t level;		// the level layout in use
+	uint8_t layout;		// the layout the next level uses
+	uint8_t num_frogs;
+	SavedFrog frogs[MAX_FROGS];
+	int8_t lane_position[3];
+	int8_t log_position[2];
+	uint16_t riverbank_status;
+	EntityState entities[MAX_LEVEL_ENTITIES];
+} SavedGame;
+
+// Fill in the given structure with the state of the game. Returns 0 (and
+// leaves it alone) if the game isn't at a safe point to save - a frog is
+// dead or dying, so the state is part way through a change.
+uint8_t get_saved_game(SavedGame* saved);
+
+// Carry on from a saved game - call after initialise_game(). The display
+// is redrawn.
+void restore_saved_game(const SavedGame* saved);
+
+
+/////////////////////// CHECKING /////////////////////////////////////////////
+// What should always be true of the game between calls to the functions
+// above - for checking the game over long runs of random moves and scrolls
+// (a frog which has died may be off the field until update_frogs() deals
+// with it, and one which has just filled a riverbank hole is on it).
+// game_check_invariants() returns 0 if they all hold, otherwise the bits
+// below for those which don't.
+#define INVARIANT_NUM_FROGS	0x01	// 1 to MAX_FROGS players
+#define INVARIANT_LIVES		0x02	// no frog has lost more than all its lives
+#define INVARIANT_ON_FIELD	0x04	// a live frog is on the field
+#define INVARIANT_SAFE		0x08	// a live frog isn't where it would die
+#define INVARIANT_RIVERBANK	0x10	// the riverbank is all there, holes aside
+#define INVARIANT_POSITIONS	0x20	// lane and log positions are in range
+#define INVARIANT_VIEW		0x40	// the view is within the level
+uint8_t game_check_invariants(void);
+
 #endif /* GAME_H_ */
\ No newline at end of file
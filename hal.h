@@ -0,0 +1,142 @@
+/*
+ * hal.h
+ *
+ * Hardware abstraction layer. These are the only functions which touch
+ * the microcontroller's registers - everything else (game logic, the
+ * serial buffers, the countdown, the button queue) sits on top of them,
+ * so the same code can run on the AVR (hal_avr.c) or natively on a Linux
+ * host (host/hal_native.c).
+ *
+ * Interrupts work the other way - the backend calls the handler functions
+ * declared at the end of this file (which live in the modules that own the
+ * data). On the AVR they are called from the interrupt service routines
+ * in hal_avr.c. On the host they are called from hal_poll().
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+
+/* Busy-wait loops call hal_poll(). It does nothing on the AVR - the
+ * interrupts do the work - but on the host it is where the virtual clock
+ * advances and the interrupt handlers get to run.
+ */
+#ifdef HAL_NATIVE
+void hal_poll(void);
+#else
+#define hal_poll()
+#endif
+
+/* Returns non-zero if interrupts are enabled (i.e. we're not in an
+ * interrupt handler or an atomic block). */
+uint8_t hal_interrupts_enabled(void);
+
+/* Clock - an interrupt every millisecond (timer0_interrupt()). The
+ * counter runs from 0 to 124 within each millisecond (8us per count).
+ * hal_clock_count() must be called with interrupts off. It sets *pending
+ * if the millisecond has ended but the interrupt hasn't been handled yet.
+ */
+void hal_clock_init(void);
+uint8_t hal_clock_count(uint8_t* pending);
+
+/* Idle sleep until the next interrupt - the clock (every millisecond), a
+ * character received, a button change and so on. The timers and the
+ * UART carry on while the CPU sleeps. On the host it waits for the clock
+ * to move on or a character to come in.
+ */
+void hal_sleep(void);
+
+/* Cycle counter - timer 1 running freely at the CPU clock, for timing
+ * (profile.c). It wraps every 65536 cycles (8.192ms) so only intervals
+ * shorter than that can be measured. On the host it counts virtual time
+ * and so only moves on a whole millisecond at a time.
+ */
+void hal_cycles_init(void);
+uint16_t hal_cycles(void);
+
+/* SPI (to the LED matrix). clockdivider should be one of
+ * 2,4,8,16,32,64,128. hal_spi_send_byte() waits for the byte to be sent
+ * and returns the byte received.
+ * There can be up to 4 LED matrix panels (LEDPANELS, see ledpanels.h),
+ * each with its own slave select line - panel 0 on B4, then D4, D5 and
+ * D7. hal_spi_select() chooses the panel the bytes sent go to (panel 0
+ * after hal_spi_init()). */
+#ifndef LEDPANELS
+#define LEDPANELS 1
+#endif
+void hal_spi_init(uint8_t clockdivider);
+void hal_spi_select(uint8_t panel);
+uint8_t hal_spi_send_byte(uint8_t byte);
+
+/* LEDs on port A pins 3 to 7 (the lives display) */
+void hal_leds_init(void);
+void hal_leds_set(uint8_t leds);
+
+/* Seven segment display - segments on port C, the digit select on D2.
+ * Digit 0 is the right hand digit. */
+void hal_seven_seg_init(void);
+void hal_seven_seg_write(uint8_t digit, uint8_t segments);
+
+/* Push buttons B0 to B3 - an interrupt (buttons_interrupt()) when any of
+ * them changes. hal_buttons_read() returns their state in bits 0 to 3. */
+void hal_buttons_init(void);
+uint8_t hal_buttons_read(void);
+
+/* Switches - sound on/off (D3) and volume (A0) */
+#define HAL_SWITCH_SOUND 0x01
+#define HAL_SWITCH_VOLUME 0x02
+uint8_t hal_switches_read(void);
+
+/* ADC - the joystick is on channels 1 (x) and 2 (y). hal_adc_read() waits
+ * for the conversion and returns a value from 0 to 1023. */
+void hal_adc_init(void);
+uint16_t hal_adc_read(uint8_t channel);
+
+/* Buzzer - PWM on D6. hal_buzzer_set() gives the period and the high time
+ * in microseconds. The buzzer only sounds while enabled. */
+void hal_buzzer_init(void);
+void hal_buzzer_set(uint16_t period, uint16_t pulse_width);
+void hal_buzzer_enable(uint8_t on);
+
+/* EEPROM. hal_eeprom_write_byte() starts writing a byte and returns
+ * straight away - eeprom_ready_interrupt() is called (if enabled) once the
+ * EEPROM can take another. */
+#define HAL_EEPROM_SIZE 1024
+uint8_t hal_eeprom_read_byte(uint16_t address);
+void hal_eeprom_read_block(void* data, uint16_t address, uint16_t length);
+void hal_eeprom_write_byte(uint16_t address, uint8_t value);
+void hal_eeprom_ready_interrupt(uint8_t enable);
+
+/* UART 0 (the terminal). serial_rx_interrupt() is called with each
+ * character received and serial_tx_interrupt() (while enabled) whenever
+ * hal_uart_write() can take another character. */
+void hal_uart_init(long baudrate);
+void hal_uart_write(uint8_t byte);
+void hal_uart_tx_interrupt(uint8_t enable);
+
+/* UART 1 - transmit only (telemetry.c, when TELEMETRY_USART is 1) */
+void hal_uart1_init(long baudrate);
+void hal_uart1_write(uint8_t byte);
+void hal_uart1_tx_interrupt(uint8_t enable);
+
+/* RAM use. The RAM between the static data (.data and .bss) and the
+ * stack is filled with a pattern at power up, before main() runs, so the
+ * deepest the stack has ever reached can be found later.
+ * hal_ram_static() returns the bytes taken by the static data and
+ * hal_ram_untouched() the bytes above it that still hold the pattern. The
+ * host backend doesn't measure either and returns 0.
+ */
+#define HAL_RAM_SIZE 2048
+uint16_t hal_ram_static(void);
+uint16_t hal_ram_untouched(void);
+
+/* Interrupt handlers - implemented by the modules, called by the backend */
+void timer0_interrupt(void);
+void buttons_interrupt(void);
+void serial_rx_interrupt(char c);
+void serial_tx_interrupt(void);
+void eeprom_ready_interrupt(void);
+void telemetry_tx_interrupt(void);
+
+#endif /* HAL_H_ */
@@ -0,0 +1,466 @@
+/*
+ * hal_avr.c
+ *
+ * ATmega324A backend for the hardware abstraction layer - see hal.h.
+ * The SPI code was spi.c (by Peter Sutton) and the rest came out of the
+ * modules which used to set up their own registers.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+
+#include "hal.h"
+#include "telemetry.h"
+#include "profile.h"
+
+/* System clock rate in Hz. (L at the end indicates this is a long constant) */
+#define SYSCLK 8000000L
+
+/* In a PROFILE build each ISR is timed with timer 1 (see profile.h) */
+#ifdef PROFILE
+#define ISR_BEGIN() uint16_t isr_start = TCNT1
+#define ISR_END(isr) profile_isr(isr, TCNT1 - isr_start)
+#else
+#define ISR_BEGIN()
+#define ISR_END(isr)
+#endif
+
+uint8_t hal_interrupts_enabled(void) {
+	return bit_is_set(SREG, SREG_I) != 0;
+}
+
+///////////////////////////////// CLOCK ////////////////////////////////////
+
+/* Set up timer 0 to generate an interrupt every 1ms.
+* We will divide the clock by 64 and count up to 124.
+* We will therefore get an interrupt every 64 x 125
+* clock cycles, i.e. every 1 milliseconds with an 8MHz
+* clock.
+* The counter will be reset to 0 when it reaches it's
+* output compare value.
+*/
+void hal_clock_init(void) {
+	/* Clear the timer */
+	TCNT0 = 0;
+
+	/* Set the output compare value to be 124 */
+	OCR0A = 124;
+
+	/* Set the timer to clear on compare match (CTC mode)
+	* and to divide the clock by 64. This starts the timer
+	* running.
+	*/
+	TCCR0A = (1<<WGM01);
+	TCCR0B = (1<<CS01)|(1<<CS00);
+
+	/* Enable an interrupt on output compare match.
+	* Note that interrupts have to be enabled globally
+	* before the interrupts will fire.
+	*/
+	TIMSK0 |= (1<<OCIE0A);
+
+	/* Make sure the interrupt flag is cleared by writing a
+	* 1 to it.
+	*/
+	TIFR0 &= (1<<OCF0A);
+}
+
+uint8_t hal_clock_count(uint8_t* pending) {
+	uint8_t counter = TCNT0;
+	*pending = 0;
+	if(TIFR0 & (1<<OCF0A)) {
+		/* The timer has just matched but the interrupt hasn't run yet */
+		*pending = 1;
+		counter = TCNT0;
+	}
+	return counter;
+}
+
+ISR(TIMER0_COMPA_vect) {
+	ISR_BEGIN();
+	timer0_interrupt();
+	ISR_END(ISR_TIMER0);
+}
+
+/* Idle mode stops only the CPU clock - any interrupt wakes it */
+void hal_sleep(void) {
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
+	sleep_cpu();
+	sleep_disable();
+}
+
+/* Timer 1 counts every clock cycle (no prescaler) from 0 to 0xFFFF and
+ * wraps - normal mode, no interrupts.
+ */
+void hal_cycles_init(void) {
+	TCCR1A = 0;
+	TCCR1B = (1<<CS10);
+}
+
+uint16_t hal_cycles(void) {
+	return TCNT1;
+}
+
+////////////////////////////////// SPI /////////////////////////////////////
+
+#if LEDPANELS > 1
+// Slave select lines (port D) of panels 1 to 3 - panel 0 is on B4
+static const uint8_t panel_select[3] PROGMEM = {(1<<4), (1<<5), (1<<7)};
+#endif
+
+void hal_spi_init(uint8_t clockdivider) {
+	// Set up SPI communication as a master
+	// Make the SS, MOSI and SCK pins outputs. These are pins
+	// 4, 5 and 7 of port B on the ATmega324A
+
+	DDRB |= (1<<4)|(1<<5)|(1<<7);
+
+	// Set the slave select (SS) line high
+	PORTB |= (1<<4);
+
+	// Set up the SPI control registers SPCR and SPSR:
+	// - SPE bit = 1 (SPI is enabled)
+	// - MSTR bit = 1 (Master Mode)
+	SPCR0 = (1<<SPE0)|(1<<MSTR0);
+
+	// Set SPR0 and SPR1 bits in SPCR and SPI2X bit in SPSR
+	// based on the given clock divider
+	// Invalid values default to the slowest speed
+	// We consider each bit in turn
+	switch(clockdivider) {
+		case 2:
+		case 8:
+		case 32:
+			SPSR0 = (1<<SPI2X0);
+			break;
+		default:
+			SPSR0 = 0;
+			break;
+	}
+	switch(clockdivider) {
+		case 128:
+			SPCR0 |= (1<<SPR00);
+			// Note this flows through to the next code block
+		case 32:
+		case 64:
+			SPCR0 |= (1<<SPR10);
+			break;
+		case 8:
+		case 16:
+			SPCR0 |= (1<<SPR00);
+			break;
+	}
+
+#if LEDPANELS > 1
+	// The other panels' slave select lines - outputs, high
+	for(uint8_t panel = 1; panel < LEDPANELS; panel++) {
+		DDRD |= pgm_read_byte(&panel_select[panel - 1]);
+		PORTD |= pgm_read_byte(&panel_select[panel - 1]);
+	}
+#endif
+
+	// Take SS (slave select) line low
+	PORTB &= ~(1<<4);
+}
+
+void hal_spi_select(uint8_t panel) {
+#if LEDPANELS > 1
+	// Only one slave select line low at a time
+	PORTB |= (1<<4);
+	for(uint8_t i = 1; i < LEDPANELS; i++) {
+		PORTD |= pgm_read_byte(&panel_select[i - 1]);
+	}
+	if(panel == 0) {
+		PORTB &= ~(1<<4);
+	} else if(panel < LEDPANELS) {
+		PORTD &= ~pgm_read_byte(&panel_select[panel - 1]);
+	}
+#else
+	(void)panel;
+#endif
+}
+
+uint8_t hal_spi_send_byte(uint8_t byte) {
+	// Write out the byte to the SPDR0 register. This will initiate
+	// the transfer. We then wait until the most significant byte of
+	// SPSR0 (SPIF0 bit) is set - this indicates that the transfer is
+	// complete. (The final read of SPSR0 followed by a read of SPDR0
+	// will cause the SPIF bit to be reset to 0. See page 224 of the
+	// ATmega324A datasheet.)
+	SPDR0 = byte;
+	while((SPSR0 & (1<<SPIF0)) == 0) {
+		; // wait
+	}
+	return SPDR0;
+}
+
+///////////////////////// LEDS AND SEVEN SEGMENT ////////////////////////////
+
+void hal_leds_init(void) {
+	DDRA |= 0b11111000;
+}
+
+void hal_leds_set(uint8_t leds) {
+	PORTA = leds;
+}
+
+void hal_seven_seg_init(void) {
+	DDRC = 0xFF;
+	DDRD |= (1<<2);
+}
+
+void hal_seven_seg_write(uint8_t digit, uint8_t segments) {
+	/* Output the segments for this digit then the digit selection (CC) bit */
+	PORTC = segments;
+	if(digit == 0) {
+		PORTD &= ~(1<<2);
+	} else {
+		PORTD |= (1<<2);
+	}
+}
+
+/////////////////////////// BUTTONS AND SWITCHES /////////////////////////////
+
+// Setup interrupt if any of pins B0 to B3 change. We do this
+// using a pin change interrupt. These pins correspond to pin
+// change interrupts PCINT8 to PCINT11 which are covered by
+// Pin change interrupt 1.
+void hal_buttons_init(void) {
+
+	// Enable the interrupt (see datasheet page 91)
+	PCICR |= (1<<PCIE1);
+
+	// Make sure the interrupt flag is cleared (by writing a
+	// 1 to it) (see datasheet page 92)
+	PCIFR |= (1<<PCIF1);
+
+	// Choose which pins we're interested in by setting
+	// the relevant bits in the mask register (see datasheet page 94)
+	PCMSK1 |= (1<<PCINT8)|(1<<PCINT9)|(1<<PCINT10)|(1<<PCINT11);
+}
+
+uint8_t hal_buttons_read(void) {
+	return PINB & 0x0F;
+}
+
+ISR(PCINT1_vect) {
+	ISR_BEGIN();
+	buttons_interrupt();
+	ISR_END(ISR_BUTTONS);
+}
+
+uint8_t hal_switches_read(void) {
+	uint8_t switches = 0;
+	if(PIND & 0x08) {
+		switches |= HAL_SWITCH_SOUND;
+	}
+	if(PINA & 0x01) {
+		switches |= HAL_SWITCH_VOLUME;
+	}
+	return switches;
+}
+
+////////////////////////////////// ADC //////////////////////////////////////
+
+void hal_adc_init(void) {
+	// Set up ADC - AVCC reference, right adjust
+	// Input selection doesn't matter yet - it's chosen for each conversion
+	ADMUX = (1<<REFS0);
+	// Turn on the ADC (but don't start a conversion yet). Choose a clock
+	// divider of 64. (The ADC clock must be somewhere
+	// between 50kHz and 200kHz. We will divide our 8MHz clock by 64
+	// to give us 125kHz.)
+	ADCSRA = (1<<ADEN)|(1<<ADPS2)|(1<<ADPS1);
+}
+
+uint16_t hal_adc_read(uint8_t channel) {
+	ADMUX = (1<<REFS0) | (channel & 0x07);
+	// Start the ADC conversion
+	ADCSRA |= (1<<ADSC);
+
+	while(ADCSRA & (1<<ADSC)) {
+		; /* Wait until conversion finished */
+	}
+	return ADC;
+}
+
+///////////////////////////////// BUZZER ////////////////////////////////////
+
+void hal_buzzer_init(void) {
+	// Set up timer/counter 2 for Fast PWM, counting from 0 to the value in OCR2A
+	// before reseting to 0. Count at 1MHz (CLK/8).
+	// Configure output OC2B to be clear on compare match and set on timer/counter
+	// overflow (non-inverting mode).
+	TCCR2A = (1<<COM2A1)|(0<<COM2A0)|(1 << COM0B1) | (0 <<COM0B0)| (1 <<WGM21) | (1 << WGM20);
+	TCCR2B = (1 << WGM22) | (0 << CS22) | (1 << CS21) | (0 << CS20);
+}
+
+void hal_buzzer_set(uint16_t period, uint16_t pulse_width) {
+	// The compare value is one less than the number of clock cycles in the pulse width
+	// - unless the pulse width is 0.
+	if(pulse_width > 0) {
+		OCR2B = pulse_width - 1;
+	} else {
+		OCR2B = 0;
+	}
+	// Set the maximum count value for timer/counter 2 to be one less than the clockperiod
+	OCR2A = period - 1;
+}
+
+void hal_buzzer_enable(uint8_t on) {
+	if(on) {
+		DDRD |= (1<<6);
+	} else {
+		DDRD &= ~(1<<6);
+	}
+}
+
+///////////////////////////////// EEPROM ////////////////////////////////////
+
+uint8_t hal_eeprom_read_byte(uint16_t address) {
+	return eeprom_read_byte((const uint8_t*)address);
+}
+
+void hal_eeprom_read_block(void* data, uint16_t address, uint16_t length) {
+	eeprom_read_block(data, (const void*)address, length);
+}
+
+void hal_eeprom_write_byte(uint16_t address, uint8_t value) {
+	EEAR = address;
+	EEDR = value;
+	/* EEPE must be set within 4 cycles of EEMPE */
+	EECR |= (1<<EEMPE);
+	EECR |= (1<<EEPE);
+}
+
+void hal_eeprom_ready_interrupt(uint8_t enable) {
+	/* The EEPROM ready interrupt fires as soon as the EEPROM isn't busy
+	 * (and keeps firing until it's disabled) */
+	if(enable) {
+		EECR |= (1<<EERIE);
+	} else {
+		EECR &= ~(1<<EERIE);
+	}
+}
+
+ISR(EE_READY_vect) {
+	ISR_BEGIN();
+	eeprom_ready_interrupt();
+	ISR_END(ISR_EEPROM);
+}
+
+////////////////////////////////// UART /////////////////////////////////////
+
+void hal_uart_init(long baudrate) {
+	/* Configure the serial port baud rate */
+	/* (This differs from the datasheet formula so that we get
+	 * rounding to the nearest integer while using integer division
+	 * (which truncates)).
+	*/
+	UBRR0 = ((SYSCLK / (8 * baudrate)) + 1)/2 - 1;
+
+	/*
+	 * Enable transmission and receiving via UART and the receive
+	 * complete interrupt. We don't enable the UDR empty interrupt here
+	 * (we wait until we've got a character to transmit).
+	 * NOTE: Interrupts must be enabled globally for this
+	 * to work, but we do not do this here.
+	*/
+	UCSR0B = (1<<RXEN0)|(1<<TXEN0)|(1<<RXCIE0);
+}
+
+void hal_uart_write(uint8_t byte) {
+	UDR0 = byte;
+}
+
+void hal_uart_tx_interrupt(uint8_t enable) {
+	if(enable) {
+		UCSR0B |= (1<<UDRIE0);
+	} else {
+		UCSR0B &= ~(1<<UDRIE0);
+	}
+}
+
+ISR(USART0_UDRE_vect) {
+	ISR_BEGIN();
+	serial_tx_interrupt();
+	ISR_END(ISR_UART_TX);
+}
+
+ISR(USART0_RX_vect) {
+	ISR_BEGIN();
+	/* Read the character - we ignore the possibility of overrun. */
+	serial_rx_interrupt(UDR0);
+	ISR_END(ISR_UART_RX);
+}
+
+void hal_uart1_init(long baudrate) {
+	/* Transmit only, double speed so that 115200 baud is within 4% at 8MHz */
+	UBRR1 = ((SYSCLK / (4 * baudrate)) + 1)/2 - 1;
+	UCSR1A = (1<<U2X1);
+	UCSR1C = (1<<UCSZ11)|(1<<UCSZ10);
+	UCSR1B = (1<<TXEN1);
+}
+
+void hal_uart1_write(uint8_t byte) {
+	UDR1 = byte;
+}
+
+void hal_uart1_tx_interrupt(uint8_t enable) {
+	if(enable) {
+		UCSR1B |= (1<<UDRIE1);
+	} else {
+		UCSR1B &= ~(1<<UDRIE1);
+	}
+}
+
+#if TELEMETRY_USART == 1
+ISR(USART1_UDRE_vect) {
+	ISR_BEGIN();
+	telemetry_tx_interrupt();
+	ISR_END(ISR_TELEMETRY);
+}
+#endif
+
+///////////////////////////////// MEMORY ////////////////////////////////////
+
+/* Linker symbols - the end of the static data and the top of the stack */
+extern uint8_t _end;
+extern uint8_t __stack;
+
+#define STACK_PAINT 0xC5
+
+/* Paint the free RAM. This runs in .init1, before the stack pointer and
+ * the zero register are set up, so it has to be written in assembler.
+ */
+void hal_paint_ram(void) __attribute__((naked, used, section(".init1")));
+void hal_paint_ram(void) {
+	__asm volatile (
+		"	ldi r30, lo8(_end)\n"
+		"	ldi r31, hi8(_end)\n"
+		"	ldi r24, %0\n"
+		"	ldi r25, hi8(__stack)\n"
+		"	rjmp 2f\n"
+		"1:	st Z+, r24\n"
+		"2:	cpi r30, lo8(__stack)\n"
+		"	cpc r31, r25\n"
+		"	brlo 1b\n"
+		"	breq 1b\n"
+		:: "M" (STACK_PAINT));
+}
+
+uint16_t hal_ram_static(void) {
+	return (uint16_t)&_end - RAMSTART;
+}
+
+uint16_t hal_ram_untouched(void) {
+	const uint8_t* p = &_end;
+	while(p <= &__stack && *p == STACK_PAINT) {
+		p++;
+	}
+	return p - &_end;
+}
@@ -0,0 +1,468 @@
+/*
+ * difficulty.c
+ *
+ * Monte Carlo difficulty estimator. Plays one level of the game (game.c and
+ * the modules it uses, with the native HAL - host/hal_native.c - standing in
+ * for the hardware) headless with a computer player, many times over, and
+ * reports:
+ *  - for each row, how often a frog which got to it died there
+ *  - how long a crossing (from the start to a riverbank hole) took
+ *  - how often the level was cleared and how long that took
+ *
+ * The game is stepped a tick at a time by the main loop's own stepping
+ * (step.h), without the display, sound or terminal.
+ * The players:
+ *  - random     moves at random, mostly forward
+ *  - greedy     moves forward if the row ahead is clear where it is, else
+ *               stays put if that is safe, else moves aside
+ *  - lookahead  tries every sequence of the next few moves (-d) against
+ *               where the traffic and logs will have scrolled to, and
+ *               takes the first move of the best - weighed up as the
+ *               attract mode's autopilot does (autopilot_weigh_up() in
+ *               autopilot.h), so hazards stepping and what scrolls in
+ *               from off the display aren't foreseen
+ * A player makes a move every -m ms give or take half of that.
+ *
+ * Runs are shared out between worker processes (the game's state is
+ * global, so each worker is a fork()ed copy of it) which take the next
+ * batch from a counter in shared memory whenever they finish the last, so
+ * a worker held up by long runs doesn't hold up the rest. Each run's
+ * random numbers come from the seed and the run's number alone, and the
+ * results are sums, so the same seed gives the same results however many
+ * workers there are.
+ *
+ * Build (from the top of the repository):
+ *   gcc -std=gnu99 -O2 -DHAL_NATIVE -I. -Ihost/native -o difficulty \
+ *       $(ls *.c | grep -v -e hal_avr.c -e project.c) host/hal_native.c \
+ *       host/difficulty.c
+ * Usage:
+ *   difficulty [-p random|greedy|lookahead] [-l level] [-s speed ups]
+ *       [-n runs] [-j workers] [-r seed] [-m ms between moves]
+ *       [-t longest run in s] [-d lookahead moves]
+ * The level's scroll speeds are the game's (step.h) with -s speed ups (by default
+ * the number the game has made by that level). A run ends when the level
+ * is cleared, the frog is out of lives or after -t seconds.
+ */
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "autopilot.h"
+#include "game.h"
+#include "effects.h"
+#include "ledmatrix.h"
+#include "score.h"
+#include "step.h"
+#include "timer0.h"
+
+#define MAX_WORKERS 64
+#define MAX_ROWS 32
+#define BATCH 16		// runs a worker takes at a time
+#define BINS 30			// histogram bins...
+#define BIN_MS 2000		// ...of this many ms (the last is everything longer)
+
+#define PLAYER_RANDOM 0
+#define PLAYER_GREEDY 1
+#define PLAYER_LOOKAHEAD 2
+static const char* player_names[] = {"random", "greedy", "lookahead"};
+
+static const uint8_t moves[] = {MOVE_FORWARD, MOVE_NONE, MOVE_LEFT, MOVE_RIGHT, MOVE_BACKWARD};
+#define NUM_MOVES (sizeof(moves))
+
+typedef struct {
+	uint64_t runs;
+	uint64_t cleared;
+	uint64_t out_of_lives;
+	uint64_t ticks;
+	// Crossings (a frog's time from the start to a death or a hole) which
+	// got to each row, and died in it
+	uint64_t reached[MAX_ROWS];
+	uint64_t died[MAX_ROWS];
+	uint64_t crossings;
+	uint64_t crossing_ms;
+	uint64_t crossing_time[BINS];
+	uint64_t clear_ms;
+	uint64_t clear_time[BINS];
+} Stats;
+
+// Shared between the workers
+typedef struct {
+	uint64_t next_run;
+	Stats stats[MAX_WORKERS];
+} Shared;
+
+// Settings
+static uint8_t player = PLAYER_GREEDY;
+static uint8_t level = 1;
+static uint32_t move_period = 300;
+static uint32_t time_limit = 300000;
+static uint8_t depth = 3;
+static uint64_t seed = 1;
+
+// The run being played
+static uint64_t random_state;
+
+static void usage(void);
+static void work(Shared* shared, uint8_t worker, uint64_t runs);
+static void play(Stats* stats, uint64_t run);
+static uint8_t choose_move(uint32_t tick);
+static uint8_t holes_filled(void);
+static void count_crossing(Stats* stats, uint32_t reached);
+static void add_time(uint64_t* histogram, uint32_t ms);
+static uint32_t next_random(void);
+static uint64_t splitmix(uint64_t x);
+static void print_stats(const Stats* stats, uint64_t runs, uint8_t workers, double elapsed);
+static void print_histogram(const uint64_t* histogram, uint64_t total);
+
+int main(int argc, char** argv) {
+	Shared* shared;
+	Stats total;
+	uint64_t runs = 1000;
+	long workers = sysconf(_SC_NPROCESSORS_ONLN);
+	int speed_ups = -1;
+	int option, status;
+	struct timespec start, end;
+
+	while((option = getopt(argc, argv, "p:l:s:n:j:r:m:t:d:")) != -1) {
+		switch(option) {
+			case 'p':
+			for(player = 0; player < 3 && strcmp(optarg, player_names[player]); player++) {
+			}
+			if(player == 3) {
+				usage();
+			}
+			break;
+			case 'l':
+			level = atoi(optarg);
+			break;
+			case 's':
+			speed_ups = atoi(optarg);
+			break;
+			case 'n':
+			runs = strtoull(optarg, NULL, 10);
+			break;
+			case 'j':
+			workers = atol(optarg);
+			break;
+			case 'r':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+			case 'm':
+			move_period = atol(optarg);
+			break;
+			case 't':
+			time_limit = atol(optarg) * 1000;
+			break;
+			case 'd':
+			depth = atoi(optarg);
+			break;
+			default:
+			usage();
+		}
+	}
+	if(level < 1 || move_period < 2 || depth < 1 || workers < 1) {
+		usage();
+	}
+	if(workers > MAX_WORKERS) {
+		workers = MAX_WORKERS;
+	}
+	if(speed_ups < 0) {
+		speed_ups = level - 1;
+	}
+	reset_speeds();
+	for(int i = 0; i < speed_ups; i++) {
+		speed_up();
+	}
+
+	shared = mmap(NULL, sizeof(Shared), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(shared == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	memset(shared, 0, sizeof(Shared));
+	// Nothing is sent to the display until it is flushed, and it never is
+	ledmatrix_defer_updates(1);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint8_t i = 0; i < workers; i++) {
+		pid_t pid = fork();
+		if(pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if(pid == 0) {
+			work(shared, i, runs);
+			_exit(0);
+		}
+	}
+	while(wait(&status) > 0) {
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			fprintf(stderr, "A worker failed\n");
+			return 1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	memset(&total, 0, sizeof(total));
+	for(uint8_t i = 0; i < workers; i++) {
+		uint64_t* from = (uint64_t*)&shared->stats[i];
+		uint64_t* to = (uint64_t*)&total;
+		for(size_t j = 0; j < sizeof(Stats) / sizeof(uint64_t); j++) {
+			to[j] += from[j];
+		}
+	}
+	print_stats(&total, runs, workers, (end.tv_sec - start.tv_sec)
+			+ (end.tv_nsec - start.tv_nsec) / 1e9);
+	return 0;
+}
+
+static void usage(void) {
+	fprintf(stderr, "Usage: difficulty [-p random|greedy|lookahead] [-l level] [-s speed ups]\n"
+			"    [-n runs] [-j workers] [-r seed] [-m ms between moves]\n"
+			"    [-t longest run in s] [-d lookahead moves]\n");
+	exit(1);
+}
+
+// A worker - play batches of runs until they have all been taken
+static void work(Shared* shared, uint8_t worker, uint64_t runs) {
+	uint64_t first;
+	for(;;) {
+		first = __atomic_fetch_add(&shared->next_run, BATCH, __ATOMIC_RELAXED);
+		if(first >= runs) {
+			return;
+		}
+		for(uint64_t run = first; run < first + BATCH && run < runs; run++) {
+			play(&shared->stats[worker], run);
+		}
+	}
+}
+
+// Play a level once
+static void play(Stats* stats, uint64_t run) {
+	uint32_t tick = 0, next_move, crossing_start = 0;
+	uint32_t reached = 1;	// rows the frog has got to this crossing (bit N for row N)
+	uint8_t playing = 1, move, lives_lost, holes, rows;
+	int8_t row;
+
+	random_state = splitmix(seed ^ splitmix(run)) | 1;
+	effects_stop();
+	init_score();
+	set_number_of_frogs(1);
+	reset_levels();
+	for(uint8_t i = 1; i < level; i++) {
+		next_level();
+	}
+	initialise_game();
+	// The countdown runs as in a game (new_game() in project.c)
+	game_count();
+	set_game_tick(0);
+	reset_count_at(0);
+	start_scrolling(0);
+	rows = get_level_rows();
+	lives_lost = get_time_died(0);
+	holes = holes_filled();
+	next_move = move_period / 2 + next_random() % move_period;
+
+	while(playing && tick < time_limit) {
+		tick++;
+		playing = advance_game(tick);
+		// (no moves while the frog is dying)
+		if(playing && tick >= next_move && tick >= crossing_start) {
+			move = choose_move(tick);
+			if(move != MOVE_NONE) {
+				move_frog(0, move);
+				playing = update_frogs();
+				row = (int8_t)get_frog_row(0);
+				if(holes_filled() != holes) {
+					// Home (and back at the start)
+					holes = holes_filled();
+					count_crossing(stats, reached | (1UL << (rows - 1)));
+					stats->crossings++;
+					stats->crossing_ms += tick - crossing_start;
+					add_time(stats->crossing_time, tick - crossing_start);
+					crossing_start = tick;
+					reached = 1;
+				} else if(row >= 0 && row < rows) {
+					reached |= 1UL << row;
+				}
+			}
+			next_move = tick + move_period / 2 + next_random() % move_period;
+		}
+		if(get_time_died(0) != lives_lost) {
+			// Died where it is (or in row 0 if it jumped off the bottom)
+			lives_lost = get_time_died(0);
+			row = (int8_t)get_frog_row(0);
+			if(row < 0) {
+				row = 0;
+			} else if(row >= rows) {
+				row = rows - 1;
+			}
+			stats->died[row]++;
+			count_crossing(stats, reached);
+			crossing_start = tick + DEATH_TIME;
+			reached = 1;
+		}
+	}
+	if(is_riverbank_full()) {
+		stats->cleared++;
+		stats->clear_ms += tick;
+		add_time(stats->clear_time, tick);
+	} else {
+		if(!playing) {
+			stats->out_of_lives++;
+		} else {
+			count_crossing(stats, reached);	// cut short
+		}
+	}
+	stats->runs++;
+	stats->ticks += tick;
+}
+
+// The player's move on the given tick
+static uint8_t choose_move(uint32_t tick) {
+	int8_t row = (int8_t)get_frog_row(0);
+	int8_t column = (int8_t)get_frog_column(0);
+	uint32_t choice;
+	int16_t value, best = AUTOPILOT_DEAD - 1;
+	uint8_t ties = 0, move = MOVE_NONE;
+
+	switch(player) {
+		case PLAYER_RANDOM:
+		choice = next_random() % 10;
+		return choice < 4 ? MOVE_FORWARD : choice < 6 ? MOVE_LEFT
+				: choice < 8 ? MOVE_RIGHT : choice < 9 ? MOVE_BACKWARD : MOVE_NONE;
+
+		case PLAYER_GREEDY:
+		if(!((get_row_danger(row + 1) >> column) & 1)) {
+			return MOVE_FORWARD;
+		}
+		if(!((get_row_danger(row) >> column) & 1)) {
+			return MOVE_NONE;
+		}
+		choice = next_random() & 1;
+		for(uint8_t i = 0; i < 2; i++, choice ^= 1) {
+			int8_t side = column + (choice ? 1 : -1);
+			if(side >= 0 && side <= 15 && !((get_row_danger(row) >> side) & 1)) {
+				return choice ? MOVE_RIGHT : MOVE_LEFT;
+			}
+		}
+		return MOVE_FORWARD;
+
+		default:
+		// The best move, picking at random between the equal best
+		for(uint8_t i = 0; i < NUM_MOVES; i++) {
+			int8_t rows = moves[i] == MOVE_FORWARD ? 1 : moves[i] == MOVE_BACKWARD ? -1 : 0;
+			int8_t columns = moves[i] == MOVE_RIGHT ? 1 : moves[i] == MOVE_LEFT ? -1 : 0;
+			value = autopilot_weigh_up(row + rows, column + columns, tick, move_period, depth,
+					get_scroll_times(), get_scroll_periods(), get_scroll_directions());
+			if(value > best) {
+				best = value;
+				move = moves[i];
+				ties = 1;
+			} else if(value == best && next_random() % ++ties == 0) {
+				move = moves[i];
+			}
+		}
+		return move;
+	}
+}
+
+static uint8_t holes_filled(void) {
+	GameState state;
+	get_game_state(&state);
+	return __builtin_popcount(state.riverbank_status);
+}
+
+// A crossing got to the given rows
+static void count_crossing(Stats* stats, uint32_t reached) {
+	for(uint8_t row = 0; reached; row++, reached >>= 1) {
+		stats->reached[row] += reached & 1;
+	}
+}
+
+static void add_time(uint64_t* histogram, uint32_t ms) {
+	histogram[ms / BIN_MS < BINS ? ms / BIN_MS : BINS - 1]++;
+}
+
+// xorshift64*
+static uint32_t next_random(void) {
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return (random_state * 2685821657736338717ULL) >> 32;
+}
+
+static uint64_t splitmix(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+static void print_stats(const Stats* stats, uint64_t runs, uint8_t workers, double elapsed) {
+	uint8_t rows = 0;
+	printf("Level %u, scroll periods", level);
+	for(uint8_t i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		printf(" %u", get_scroll_periods()[i]);
+	}
+	printf(" ms, %s player moving every %u ms, seed %llu\n", player_names[player],
+			move_period, (unsigned long long)seed);
+	printf("%llu runs: %.2f%% cleared, %.2f%% out of lives, %.2f%% out of time (%u s)\n\n",
+			(unsigned long long)runs, 100.0 * stats->cleared / runs,
+			100.0 * stats->out_of_lives / runs,
+			100.0 * (runs - stats->cleared - stats->out_of_lives) / runs, time_limit / 1000);
+
+	for(uint8_t row = 0; row < MAX_ROWS; row++) {
+		if(stats->reached[row]) {
+			rows = row + 1;
+		}
+	}
+	printf("Row  Reached      Died  P(death)\n");
+	for(int8_t row = rows - 1; row >= 0; row--) {
+		printf("%3d %8llu  %8llu  %7.4f\n", row, (unsigned long long)stats->reached[row],
+				(unsigned long long)stats->died[row],
+				stats->reached[row] ? (double)stats->died[row] / stats->reached[row] : 0);
+	}
+
+	printf("\nCrossings: %llu, mean %.2f s\n", (unsigned long long)stats->crossings,
+			stats->crossings ? stats->crossing_ms / 1000.0 / stats->crossings : 0);
+	print_histogram(stats->crossing_time, stats->crossings);
+	printf("\nLevel cleared: %llu, mean %.2f s\n", (unsigned long long)stats->cleared,
+			stats->cleared ? stats->clear_ms / 1000.0 / stats->cleared : 0);
+	print_histogram(stats->clear_time, stats->cleared);
+
+	printf("\n%.0f s of game in %.2f s on %u workers (%.0f ticks/s, %.0f runs/s)\n",
+			stats->ticks / 1000.0, elapsed, workers, stats->ticks / elapsed, runs / elapsed);
+}
+
+static void print_histogram(const uint64_t* histogram, uint64_t total) {
+	uint8_t last = 0;
+	for(uint8_t i = 0; i < BINS; i++) {
+		if(histogram[i]) {
+			last = i;
+		}
+	}
+	for(uint8_t i = 0; total && i <= last; i++) {
+		double share = (double)histogram[i] / total;
+		if(i == BINS - 1) {
+			printf("  %3u+    s %6.2f%% ", i * BIN_MS / 1000, 100 * share);
+		} else {
+			printf("  %3u-%-3u s %6.2f%% ", i * BIN_MS / 1000, (i + 1) * BIN_MS / 1000,
+					100 * share);
+		}
+		for(int j = 0; j < (int)(share * 50 + 0.5); j++) {
+			putchar('#');
+		}
+		putchar('\n');
+	}
+}
@@ -0,0 +1,168 @@
+/*
+ * fuzz_escape.c
+ *
+ * Fuzz target for read_escape_sequence() (terminalio.h). Each input is a
+ * run of bytes as they might come from the terminal; they are given to
+ * read_escape_sequence() one at a time and what it does with each is
+ * checked against the whole input parsed the way terminalio.h describes:
+ * ESC [ x is the key x, ESC then anything but [ is that character, and
+ * anything else is itself. The byte it keeps its place in must stay 0 to 2.
+ *
+ * With libFuzzer (from the top of the repository):
+ *   clang -g -O1 -fsanitize=fuzzer,address,undefined -DHAL_NATIVE -DLIBFUZZER \
+ *       -I. -Ihost/native -o fuzz_escape \
+ *       $(ls *.c | grep -v -e hal_avr.c -e project.c) host/hal_native.c \
+ *       host/fuzz_escape.c
+ *   fuzz_escape [corpus directory]
+ * Without -DLIBFUZZER (gcc, or afl-gcc / afl-clang-fast for AFL) there is
+ * a main() which runs each file named on the command line (AFL's @@) as
+ * an input, or with none, every input of up to four bytes from the ones
+ * that matter (ESC, [, a key and 0xFF) and a million random ones.
+ *   afl-fuzz -i seeds -o findings -- ./fuzz_escape @@
+ * host/run_checks.sh builds and runs this with the other host checks.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "terminalio.h"
+
+// What a byte of the input should give
+#define GIVES_NOTHING 0		// part of an escape sequence, not the end
+#define GIVES_CHARACTER 1	// the byte as a character
+#define GIVES_KEY 2			// the byte as the end of an escape sequence
+
+#define MAX_INPUT 4096
+
+static void parse(const uint8_t* data, size_t size, uint8_t* gives);
+static void fail(const uint8_t* data, size_t size, size_t position, const char* message);
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	static uint8_t gives[MAX_INPUT];
+	uint8_t characters_into_escape_sequence = 0;
+	char escape_char, returned;
+
+	if(size > MAX_INPUT) {
+		size = MAX_INPUT;
+	}
+	parse(data, size, gives);
+	for(size_t i = 0; i < size; i++) {
+		// -1 is what project.c starts each loop with
+		escape_char = -1;
+		returned = read_escape_sequence(&characters_into_escape_sequence, (char)data[i],
+				&escape_char);
+		if(characters_into_escape_sequence > 2) {
+			fail(data, size, i, "place in the escape sequence out of range");
+		}
+		switch(gives[i]) {
+			case GIVES_NOTHING:
+			if(returned != -1 || escape_char != -1) {
+				fail(data, size, i, "gave something for part of an escape sequence");
+			}
+			break;
+			case GIVES_CHARACTER:
+			// (0xFF as a character can't be told from -1 - nor can the
+			// terminal's)
+			if(returned != (char)data[i] || escape_char != -1) {
+				fail(data, size, i, "didn't give the character");
+			}
+			break;
+			case GIVES_KEY:
+			if(returned != -1 || escape_char != (char)data[i]) {
+				fail(data, size, i, "didn't give the key");
+			}
+			break;
+		}
+	}
+	return 0;
+}
+
+// What each byte of the input should give
+static void parse(const uint8_t* data, size_t size, uint8_t* gives) {
+	size_t i = 0;
+	while(i < size) {
+		if(data[i] != ESCAPE_CHAR) {
+			gives[i++] = GIVES_CHARACTER;
+		} else if(i + 1 < size && data[i + 1] != '[') {
+			gives[i++] = GIVES_NOTHING;
+			gives[i++] = GIVES_CHARACTER;
+		} else {
+			// ESC [ then the key (if the input goes that far)
+			gives[i++] = GIVES_NOTHING;
+			if(i < size) {
+				gives[i++] = GIVES_NOTHING;
+			}
+			if(i < size) {
+				gives[i++] = GIVES_KEY;
+			}
+		}
+	}
+}
+
+static void fail(const uint8_t* data, size_t size, size_t position, const char* message) {
+	fprintf(stderr, "fuzz_escape: byte %zu: %s. Input:", position, message);
+	for(size_t i = 0; i < size; i++) {
+		fprintf(stderr, " %02X", data[i]);
+	}
+	fprintf(stderr, "\n");
+	abort();
+}
+
+#ifndef LIBFUZZER
+#define MAX_SWEEP_LENGTH 4
+#define RANDOM_INPUTS 1000000
+#define MAX_RANDOM_LENGTH 32
+
+int main(int argc, char** argv) {
+	static const uint8_t interesting[] = {ESCAPE_CHAR, '[', 'D', 0xFF};
+	static uint8_t data[MAX_INPUT];
+	uint32_t random_state = 1;
+	size_t size;
+	uint32_t inputs = 0;
+
+	if(argc > 1) {
+		for(int i = 1; i < argc; i++) {
+			FILE* file = fopen(argv[i], "rb");
+			if(!file) {
+				perror(argv[i]);
+				return 1;
+			}
+			size = fread(data, 1, sizeof(data), file);
+			fclose(file);
+			LLVMFuzzerTestOneInput(data, size);
+		}
+		return 0;
+	}
+	// Every input up to MAX_SWEEP_LENGTH long made of the interesting bytes
+	for(size = 0; size <= MAX_SWEEP_LENGTH; size++) {
+		uint32_t combinations = 1;
+		for(size_t i = 0; i < size; i++) {
+			combinations *= sizeof(interesting);
+		}
+		for(uint32_t n = 0; n < combinations; n++) {
+			uint32_t digits = n;
+			for(size_t i = 0; i < size; i++) {
+				data[i] = interesting[digits % sizeof(interesting)];
+				digits /= sizeof(interesting);
+			}
+			LLVMFuzzerTestOneInput(data, size);
+			inputs++;
+		}
+	}
+	// Random inputs, mostly made of the interesting bytes
+	for(uint32_t n = 0; n < RANDOM_INPUTS; n++) {
+		random_state = random_state * 1664525 + 1013904223;
+		size = (random_state >> 16) % (MAX_RANDOM_LENGTH + 1);
+		for(size_t i = 0; i < size; i++) {
+			random_state = random_state * 1664525 + 1013904223;
+			data[i] = (random_state >> 24) & 1 ? interesting[(random_state >> 16) & 3]
+					: random_state >> 8;
+		}
+		LLVMFuzzerTestOneInput(data, size);
+		inputs++;
+	}
+	printf("fuzz_escape: passed (%u inputs)\n", inputs);
+	return 0;
+}
+#endif
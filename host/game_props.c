@@ -0,0 +1,423 @@
+/*
+ * game_props.c
+ *
+ * Property tests for game.c. Builds the game (game.c and the modules it
+ * uses, with the native HAL - host/hal_native.c - standing in for the
+ * hardware) and checks game_check_invariants() (game.h) after every step
+ * of:
+ *  - long random runs of moves (all nine, diagonals too), scrolls of
+ *    every lane and channel either way, and ticks of the game clock
+ *    (hazards stepping and the countdown running out), one and two
+ *    player, on the short and tall levels, going on to the next level
+ *    when the riverbank fills
+ *  - diagonal moves off each edge of the field - the frog dies and comes
+ *    back at the start
+ *  - a frog carried by its log into column 0 or 15 - it moves with the
+ *    log a column at a time and dies only when carried past the edge
+ *  - the lives of two frogs - both losing one at once when the countdown
+ *    runs out, one out of the game while the other plays on (its moves
+ *    ignored, its lives no lower), the game over only when both are out,
+ *    and a new level giving back a life
+ *  - the riverbank holes - hopping into a free hole fills just that bit
+ *    of the mask and sends the frog back to the start, hopping into a
+ *    filled hole or the bank costs a life and leaves the mask alone
+ * A failure is reported with the seed and step (the same seed always
+ * gives the same run) and the exit status is 1.
+ *
+ * Build (from the top of the repository):
+ *   gcc -std=gnu99 -O2 -DHAL_NATIVE -I. -Ihost/native -o game_props \
+ *       $(ls *.c | grep -v -e hal_avr.c -e project.c) host/hal_native.c \
+ *       host/game_props.c
+ * Usage:
+ *   game_props [-n random runs] [-s steps a run] [-r seed]
+ * host/run_checks.sh builds and runs this with the other host checks.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "game.h"
+#include "effects.h"
+#include "ledmatrix.h"
+#include "score.h"
+#include "timer0.h"
+
+#define START_ROW 0		// as in game.c
+#define MAX_LIVES_LOST 5	// as in game.c - a frog is out of the game then
+#define NUM_MOVES 9		// MOVE_NONE to MOVE_RIGHT_DOWN
+
+// The test being run, for reporting failures
+static const char* test;
+static uint64_t seed = 1;
+static uint32_t step_number;
+static uint32_t tick;
+static uint32_t failures;
+static uint64_t random_state;
+
+static void usage(void);
+static void random_runs(uint32_t runs, uint32_t steps);
+static void diagonal_edges(void);
+static void log_edges(void);
+static void lives(void);
+static void riverbank_holes(void);
+static void start(uint8_t players, uint8_t level);
+static uint8_t step(void);
+static uint8_t tick_on(uint32_t ticks);
+static void place_frog(uint8_t frog, int8_t row, int8_t column);
+static int8_t river_row(uint8_t channel);
+static void fail(const char* format, ...);
+static uint32_t next_random(void);
+static uint64_t splitmix(uint64_t x);
+
+#define CHECK(condition, ...) do { if(!(condition)) { fail(__VA_ARGS__); return; } } while(0)
+
+int main(int argc, char** argv) {
+	uint32_t runs = 1000, steps = 2000;
+	int option;
+
+	while((option = getopt(argc, argv, "n:s:r:")) != -1) {
+		switch(option) {
+			case 'n':
+			runs = strtoul(optarg, NULL, 10);
+			break;
+			case 's':
+			steps = strtoul(optarg, NULL, 10);
+			break;
+			case 'r':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+			default:
+			usage();
+		}
+	}
+	// Nothing is sent to the display until it is flushed, and it never is
+	ledmatrix_defer_updates(1);
+
+	diagonal_edges();
+	log_edges();
+	lives();
+	riverbank_holes();
+	random_runs(runs, steps);
+
+	if(failures) {
+		printf("game_props: %u failures\n", failures);
+		return 1;
+	}
+	printf("game_props: passed (%u random runs of %u steps, seed %llu)\n", runs, steps,
+			(unsigned long long)seed);
+	return 0;
+}
+
+static void usage(void) {
+	fprintf(stderr, "Usage: game_props [-n random runs] [-s steps a run] [-r seed]\n");
+	exit(1);
+}
+
+// Random moves, scrolls and ticks, checking the invariants after each
+static void random_runs(uint32_t runs, uint32_t steps) {
+	uint8_t playing, choice;
+
+	test = "random";
+	for(uint32_t run = 0; run < runs; run++) {
+		random_state = splitmix(seed ^ splitmix(run)) | 1;
+		playing = 0;
+		for(step_number = 0; step_number < steps; step_number++) {
+			if(!playing) {
+				// A new game (each run plays as many as fit in its steps)
+				start(1 + next_random() % MAX_FROGS, 1 + next_random() % 4);
+			}
+			choice = next_random() % 10;
+			if(choice < 5) {
+				// Mostly forward so frogs get up the field
+				move_frog(next_random() % get_number_of_frogs(),
+						choice < 2 ? MOVE_FORWARD : next_random() % NUM_MOVES);
+				playing = step();
+			} else if(choice < 8) {
+				if(next_random() & 1) {
+					scroll_vehicle_lane(next_random() % 3, next_random() & 1 ? 1 : -1);
+				} else {
+					scroll_river_channel(next_random() % 2, next_random() & 1 ? 1 : -1);
+				}
+				playing = step();
+			} else {
+				playing = tick_on(1 + next_random() % 100);
+			}
+			if(failures) {
+				return;
+			}
+			if(!playing && is_riverbank_full()) {
+				// On to the next level, as project.c does
+				next_level();
+				initialise_game();
+				reset_count_at(tick);
+				playing = step();
+				if(failures) {
+					return;
+				}
+			}
+		}
+	}
+}
+
+// Diagonal moves off the sides and bottom of the field
+static void diagonal_edges(void) {
+	static const int8_t moves[][2] = {
+		{0, MOVE_LEFT_UP}, {0, MOVE_LEFT_DOWN}, {15, MOVE_RIGHT_UP}, {15, MOVE_RIGHT_DOWN},
+		{7, MOVE_LEFT_DOWN}, {8, MOVE_RIGHT_DOWN}
+	};
+	uint8_t lives_lost;
+
+	test = "diagonal edges";
+	for(uint8_t level = 1; level <= 3; level += 2) {
+		for(uint8_t i = 0; i < sizeof(moves) / sizeof(moves[0]); i++) {
+			step_number = level * 10 + i;
+			start(1, level);
+			place_frog(0, START_ROW, moves[i][0]);
+			lives_lost = get_time_died(0);
+			move_frog(0, moves[i][1]);
+			step();
+			CHECK(get_time_died(0) == lives_lost + 1,
+					"move %d from column %d didn't cost a life", moves[i][1], moves[i][0]);
+			tick_on(DEATH_TIME);
+			CHECK(get_frog_row(0) == START_ROW && get_frog_column(0) == 7,
+					"frog not back at the start after dying at the edge");
+		}
+	}
+}
+
+// A frog on a log carried to each side
+static void log_edges(void) {
+	uint16_t danger;
+	int8_t row, column, direction;
+	uint8_t lives_lost;
+
+	test = "log edges";
+	for(uint8_t channel = 0; channel < 2; channel++) {
+		for(direction = -1; direction <= 1; direction += 2) {
+			step_number = channel * 2 + (direction > 0);
+			start(1, 1);
+			row = river_row(channel);
+			CHECK(row >= 0, "no row for channel %u", channel);
+			// On a log (a column of it a frog can stand on)
+			danger = get_row_danger(row);
+			for(column = 0; column < 16 && ((danger >> column) & 1); column++) {
+			}
+			CHECK(column < 16, "no log in channel %u", channel);
+			place_frog(0, row, column);
+			lives_lost = get_time_died(0);
+			for(uint8_t i = 0; i < 16; i++) {
+				scroll_river_channel(channel, direction);
+				step();
+				if(get_time_died(0) != lives_lost) {
+					break;
+				}
+				CHECK(get_frog_column(0) == column + direction,
+						"frog went from column %d to %d on a log scrolling %d",
+						column, get_frog_column(0), direction);
+				column += direction;
+			}
+			CHECK(get_time_died(0) == lives_lost + 1, "frog never carried off the edge");
+			CHECK(column == (direction > 0 ? 15 : 0),
+					"frog died in column %d, not at the edge", column);
+		}
+	}
+}
+
+// Two frogs' lives
+static void lives(void) {
+	uint8_t lost[MAX_FROGS], playing = 1;
+	uint32_t i;
+
+	test = "lives";
+	step_number = 0;
+	start(2, 1);
+	// The countdown running out kills both at once
+	lost[0] = get_time_died(0);
+	lost[1] = get_time_died(1);
+	for(i = 0; i < 60000 && get_time_died(0) == lost[0]; i++) {
+		tick_on(1);
+	}
+	CHECK(get_time_died(0) == lost[0] + 1 && get_time_died(1) == lost[1] + 1,
+			"countdown cost lives %u,%u then %u,%u", lost[0], lost[1],
+			get_time_died(0), get_time_died(1));
+	tick_on(DEATH_TIME);
+	CHECK(get_frog_row(0) == START_ROW && get_frog_row(1) == START_ROW,
+			"frogs not back at the start");
+
+	// Frog 1 out of the game - frog 2 plays on
+	step_number = 1;
+	while(get_time_died(0) < MAX_LIVES_LOST) {
+		lost[1] = get_time_died(1);
+		move_frog(0, MOVE_BACKWARD);
+		CHECK(step(), "game over with frog 2 still playing");
+		CHECK(tick_on(DEATH_TIME), "game over with frog 2 still playing");
+		CHECK(get_time_died(1) == lost[1], "frog 2 lost a life it shouldn't have");
+	}
+	step_number = 2;
+	for(i = 0; i < 3; i++) {
+		move_frog(0, MOVE_BACKWARD);
+		CHECK(step(), "game over with frog 2 still playing");
+		CHECK(get_time_died(0) == MAX_LIVES_LOST, "frog 1 lost %u lives", get_time_died(0));
+	}
+	step_number = 3;
+	while(playing) {
+		lost[1] = get_time_died(1);
+		move_frog(1, MOVE_BACKWARD);
+		playing = step();
+		CHECK(get_time_died(1) == lost[1] + 1, "frog 2's move off the bottom didn't cost a life");
+		CHECK(playing == (get_time_died(1) < MAX_LIVES_LOST),
+				"game %s with frog 2 on %u lives lost", playing ? "going" : "over",
+				get_time_died(1));
+		if(playing) {
+			tick_on(DEATH_TIME);
+		}
+	}
+
+	// A new level gives back a life to a frog which has lost one
+	step_number = 4;
+	start(2, 1);
+	move_frog(0, MOVE_BACKWARD);
+	step();
+	tick_on(DEATH_TIME);
+	lost[0] = get_time_died(0);
+	lost[1] = get_time_died(1);
+	next_level();
+	CHECK(get_time_died(0) == lost[0] - 1 && get_time_died(1) == (lost[1] ? lost[1] - 1 : 0),
+			"next level took lives %u,%u to %u,%u", lost[0], lost[1],
+			get_time_died(0), get_time_died(1));
+}
+
+// Hopping into each column of the riverbank
+static void riverbank_holes(void) {
+	uint16_t before;
+	uint8_t lives_lost, top, playing;
+
+	test = "riverbank holes";
+	for(uint8_t level = 1; level <= 3; level += 2) {
+		start(1, level);
+		top = get_level_rows() - 1;
+		// Twice along, so the second time every hole is filled
+		for(step_number = 0; step_number < 32; step_number++) {
+			uint8_t column = step_number % 16;
+			before = get_riverbank_status();
+			lives_lost = get_time_died(0);
+			if(lives_lost + 1 >= MAX_LIVES_LOST && ((before >> column) & 1)) {
+				break;	// one more death would end the game
+			}
+			place_frog(0, top - 1, column);
+			move_frog(0, MOVE_FORWARD);
+			playing = step();
+			if((before >> column) & 1) {
+				CHECK(get_time_died(0) == lives_lost + 1,
+						"hop into filled column %u didn't cost a life", column);
+				CHECK(get_riverbank_status() == before, "riverbank changed from %04X to %04X",
+						before, get_riverbank_status());
+				tick_on(DEATH_TIME);
+			} else {
+				CHECK(get_time_died(0) == lives_lost, "hop into hole %u cost a life", column);
+				CHECK(get_riverbank_status() == (before | (1 << column)),
+						"hole %u filled riverbank %04X as %04X", column, before,
+						get_riverbank_status());
+				CHECK(playing == !is_riverbank_full(), "game over with the riverbank not full");
+				if(!playing) {
+					break;
+				}
+				CHECK(get_frog_row(0) == START_ROW, "frog not back at the start from hole %u",
+						column);
+			}
+		}
+	}
+}
+
+// Start a game with the given players on the given level
+static void start(uint8_t players, uint8_t level) {
+	effects_stop();
+	init_score();
+	set_number_of_frogs(players);
+	reset_levels();
+	for(uint8_t i = 1; i < level; i++) {
+		next_level();
+	}
+	initialise_game();
+	game_count();
+	tick = 0;
+	set_game_tick(tick);
+	reset_count_at(tick);
+}
+
+// Deal with frogs dying or getting home and check the invariants. Returns
+// update_frogs().
+static uint8_t step(void) {
+	uint8_t playing = update_frogs();
+	uint8_t broken = game_check_invariants();
+	if(broken) {
+		fail("invariants broken: %02X", broken);
+	}
+	return playing;
+}
+
+// Run the game clock on, checking after each tick. Returns 0 if the game
+// ends.
+static uint8_t tick_on(uint32_t ticks) {
+	while(ticks--) {
+		tick++;
+		set_game_tick(tick);
+		step_hazards();
+		if(!step()) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Put a frog somewhere (it isn't checked for dying there until it moves
+// or something scrolls)
+static void place_frog(uint8_t frog, int8_t row, int8_t column) {
+	SavedGame saved;
+	if(!get_saved_game(&saved)) {
+		fail("no safe point to place a frog");
+		return;
+	}
+	saved.frogs[frog].row = row;
+	saved.frogs[frog].column = column;
+	restore_saved_game(&saved);
+}
+
+// The first row of the given river channel, or -1
+static int8_t river_row(uint8_t channel) {
+	for(uint8_t row = 0; row < get_level_rows(); row++) {
+		if(get_row_scrolling(row) == 3 + channel) {
+			return row;
+		}
+	}
+	return -1;
+}
+
+static void fail(const char* format, ...) {
+	va_list arguments;
+	printf("FAIL %s (seed %llu, step %u, tick %u): ", test, (unsigned long long)seed,
+			step_number, tick);
+	va_start(arguments, format);
+	vprintf(format, arguments);
+	va_end(arguments);
+	printf("\n");
+	failures++;
+}
+
+// xorshift64*
+static uint32_t next_random(void) {
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return (random_state * 2685821657736338717ULL) >> 32;
+}
+
+static uint64_t splitmix(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
@@ -0,0 +1,600 @@
+/*
+ * hal_native.c
+ *
+ * Linux backend for the hardware abstraction layer (hal.h), so the game
+ * itself (project.c, game.c and the rest) can run natively on a host for
+ * testing and profiling.
+ *
+ * - The clock is virtual. Busy-wait loops call hal_poll(), which moves
+ *   the clock on and runs the interrupt handlers. In realtime mode the
+ *   clock follows the wall clock. In fast mode it goes up by one
+ *   millisecond every poll, so the game runs as fast as the host can go
+ *   and a run with the same input always goes the same way.
+ * - The terminal (UART 0) is a pseudo terminal. Its name is printed at
+ *   start up - connect a terminal program to it (e.g. screen /dev/pts/3).
+ * - The push buttons come from standard input - the characters 0 to 3
+ *   press (and release) buttons B0 to B3.
+ * - The LED matrix commands are decoded into a stored framebuffer for
+ *   each panel (LEDPANELS of them - see ledpanels.h), standing in for the
+ *   panels themselves. They are printed side by side, with the seven
+ *   segment display and the number of bytes each panel was sent, when the
+ *   program exits.
+ * - The EEPROM is kept in a file.
+ * - The joystick is centred and the sound switch is off.
+ *
+ * Environment variables:
+ *   FROGGER_CLOCK=fast        use the fast clock (default realtime)
+ *   FROGGER_TICKS=n           exit after n ms of virtual time
+ *   FROGGER_EEPROM=file       EEPROM file (default frogger.eep)
+ *   FROGGER_TELEMETRY=file    UART 1 output (builds with TELEMETRY_USART=1)
+ *
+ * Build (from the top of the repository):
+ *   gcc -std=gnu99 -O2 -DHAL_NATIVE -I. -Ihost/native -o frogger_native \
+ *       $(ls *.c | grep -v hal_avr.c) host/hal_native.c
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hal.h"
+#include "ledmatrix.h"
+#include "telemetry.h"
+
+#define BUTTON_HOLD_TIME 300	// ms a button is held down for (less than the
+							// 350ms auto repeat in buttons.c)
+#define BUTTON_GAP_TIME 50		// ms between button pushes
+#define BUTTON_START_TIME 1000	// ms before the first push (buttons.c ignores
+							// pushes in the first 350ms)
+
+static uint8_t in_poll = 0;
+static uint8_t fast_clock = 0;
+static uint8_t clock_running = 0;
+static uint32_t virtual_time = 0;
+static uint32_t max_time = 0;
+static double start_wall_time;
+static volatile sig_atomic_t interrupted = 0;
+static uint8_t woken = 0;	// a character came in (see hal_sleep())
+
+// A simulated LED matrix panel
+typedef struct {
+	PixelColour display[MATRIX_NUM_ROWS][MATRIX_NUM_COLUMNS];
+	uint8_t command;
+	uint8_t index;
+	uint8_t remaining;
+	uint8_t position;
+	unsigned long bytes;
+} Panel;
+static Panel panels[LEDPANELS];
+static Panel* panel = &panels[0];	// the one selected
+
+static uint8_t seven_seg_segments[2];
+static uint8_t leds;
+
+static uint8_t button_state = 0;
+static uint16_t button_timer = 0;
+static char button_queue[16];
+static uint8_t buttons_queued = 0;
+static uint8_t stdin_open = 1;
+static uint8_t stdin_is_tty = 0;
+static struct termios stdin_termios;
+
+static uint8_t eeprom[HAL_EEPROM_SIZE];
+static int eeprom_fd = -1;
+static uint8_t eeprom_loaded = 0;
+static uint8_t eeprom_interrupt = 0;
+
+static int uart_master = -1;
+static int uart_slave = -1;
+static uint8_t uart_tx_interrupt = 0;
+static FILE* uart1_file = NULL;
+static uint8_t uart1_tx_interrupt = 0;
+
+static double wall_time(void);
+static void advance_clock(uint32_t ms);
+static void service_buttons(void);
+static void service_io(void);
+static void load_eeprom(void);
+static void report(void);
+
+static double wall_time(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void handle_interrupt_signal(int signal_number) {
+	(void)signal_number;
+	interrupted = 1;
+}
+
+__attribute__((constructor))
+static void hal_native_init(void) {
+	const char* setting = getenv("FROGGER_CLOCK");
+	fast_clock = setting && strcmp(setting, "fast") == 0;
+	setting = getenv("FROGGER_TICKS");
+	if(setting) {
+		max_time = strtoul(setting, NULL, 10);
+	}
+
+	fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+	if(isatty(STDIN_FILENO)) {
+		// One character at a time, not echoed
+		struct termios settings;
+		tcgetattr(STDIN_FILENO, &stdin_termios);
+		settings = stdin_termios;
+		settings.c_lflag &= ~(ICANON | ECHO);
+		tcsetattr(STDIN_FILENO, TCSANOW, &settings);
+		stdin_is_tty = 1;
+	}
+
+	signal(SIGINT, handle_interrupt_signal);
+	signal(SIGTERM, handle_interrupt_signal);
+	start_wall_time = wall_time();
+	atexit(report);
+}
+
+//////////////////////////// CLOCK AND POLLING /////////////////////////////
+
+uint8_t hal_interrupts_enabled(void) {
+	return !in_poll;
+}
+
+void hal_poll(void) {
+	uint8_t idle = 0;
+	if(in_poll) {
+		return; // Interrupts are off while a handler runs
+	}
+	if(interrupted) {
+		exit(1);
+	}
+	in_poll = 1;
+	if(clock_running) {
+		if(fast_clock) {
+			advance_clock(1);
+		} else {
+			uint32_t now = (wall_time() - start_wall_time) * 1000;
+			if(now > virtual_time) {
+				advance_clock(now - virtual_time);
+			} else {
+				idle = 1;
+			}
+		}
+	}
+	service_io();
+	in_poll = 0;
+	if(idle) {
+		usleep(200);
+	}
+}
+
+void hal_native_delay_ms(double ms) {
+	uint32_t end = virtual_time + (uint32_t)ms;
+	if(!clock_running) {
+		if(!fast_clock) {
+			usleep(ms * 1000);
+		}
+		return;
+	}
+	while(virtual_time < end) {
+		hal_poll();
+	}
+}
+
+void hal_sleep(void) {
+	uint32_t now = virtual_time;
+	woken = 0;
+	do {
+		hal_poll();
+	} while(clock_running && virtual_time == now && !woken);
+}
+
+static void advance_clock(uint32_t ms) {
+	while(ms--) {
+		virtual_time++;
+		timer0_interrupt();
+		service_buttons();
+		if(max_time && virtual_time >= max_time) {
+			exit(0);
+		}
+	}
+}
+
+void hal_clock_init(void) {
+	start_wall_time = wall_time() - virtual_time / 1000.0;
+	clock_running = 1;
+}
+
+uint8_t hal_clock_count(uint8_t* pending) {
+	*pending = 0;
+	return 0;
+}
+
+void hal_cycles_init(void) {
+}
+
+uint16_t hal_cycles(void) {
+	return (uint16_t)(virtual_time * 8000);
+}
+
+/////////////////////////////// LED MATRIX //////////////////////////////////
+
+// LED matrix commands - see ledpanels.c
+#define CMD_UPDATE_ALL 0x00
+#define CMD_UPDATE_PIXEL 0x01
+#define CMD_UPDATE_ROW 0x02
+#define CMD_UPDATE_COL 0x03
+#define CMD_SHIFT_DISPLAY 0x04
+#define CMD_CLEAR_SCREEN 0x0F
+
+static void shift_display(uint8_t direction) {
+	PixelColour (*display)[MATRIX_NUM_COLUMNS] = panel->display;
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		if(direction & 0x02) { // left
+			memmove(&display[y][0], &display[y][1], MATRIX_NUM_COLUMNS - 1);
+			display[y][MATRIX_NUM_COLUMNS - 1] = COLOUR_BLACK;
+		} else if(direction & 0x01) { // right
+			memmove(&display[y][1], &display[y][0], MATRIX_NUM_COLUMNS - 1);
+			display[y][0] = COLOUR_BLACK;
+		}
+	}
+	if(direction & 0x08) { // up
+		memmove(&display[1], &display[0], (MATRIX_NUM_ROWS - 1) * MATRIX_NUM_COLUMNS);
+		memset(&display[0], COLOUR_BLACK, MATRIX_NUM_COLUMNS);
+	} else if(direction & 0x04) { // down
+		memmove(&display[0], &display[1], (MATRIX_NUM_ROWS - 1) * MATRIX_NUM_COLUMNS);
+		memset(&display[MATRIX_NUM_ROWS - 1], COLOUR_BLACK, MATRIX_NUM_COLUMNS);
+	}
+}
+
+void hal_spi_init(uint8_t clockdivider) {
+	(void)clockdivider;
+	for(uint8_t i = 0; i < LEDPANELS; i++) {
+		panels[i].remaining = 0;
+	}
+	panel = &panels[0];
+}
+
+void hal_spi_select(uint8_t number) {
+	if(number < LEDPANELS) {
+		panel = &panels[number];
+	}
+}
+
+uint8_t hal_spi_send_byte(uint8_t byte) {
+	PixelColour (*display)[MATRIX_NUM_COLUMNS] = panel->display;
+	panel->bytes++;
+	if(panel->remaining == 0) {
+		// Start of a command - work out how many bytes follow
+		panel->command = byte;
+		panel->index = 0;
+		switch(byte) {
+			case CMD_UPDATE_ALL:
+				panel->remaining = MATRIX_NUM_ROWS * MATRIX_NUM_COLUMNS;
+				break;
+			case CMD_UPDATE_PIXEL:
+				panel->remaining = 2;
+				break;
+			case CMD_UPDATE_ROW:
+				panel->remaining = 1 + MATRIX_NUM_COLUMNS;
+				break;
+			case CMD_UPDATE_COL:
+				panel->remaining = 1 + MATRIX_NUM_ROWS;
+				break;
+			case CMD_SHIFT_DISPLAY:
+				panel->remaining = 1;
+				break;
+			case CMD_CLEAR_SCREEN:
+				memset(panel->display, COLOUR_BLACK, sizeof(panel->display));
+				break;
+		}
+		return 0;
+	}
+	panel->remaining--;
+	switch(panel->command) {
+		case CMD_UPDATE_ALL:
+			display[panel->index / MATRIX_NUM_COLUMNS][panel->index % MATRIX_NUM_COLUMNS] = byte;
+			break;
+		case CMD_UPDATE_PIXEL:
+			if(panel->index == 0) {
+				panel->position = byte;
+			} else {
+				display[(panel->position >> 4) & 0x07][panel->position & 0x0F] = byte;
+			}
+			break;
+		case CMD_UPDATE_ROW:
+			if(panel->index == 0) {
+				panel->position = byte & 0x07;
+			} else {
+				display[panel->position][panel->index - 1] = byte;
+			}
+			break;
+		case CMD_UPDATE_COL:
+			if(panel->index == 0) {
+				panel->position = byte & 0x0F;
+			} else {
+				display[panel->index - 1][panel->position] = byte;
+			}
+			break;
+		case CMD_SHIFT_DISPLAY:
+			shift_display(byte);
+			break;
+	}
+	panel->index++;
+	return 0;
+}
+
+/////////////////// LEDS, SEVEN SEGMENT, BUTTONS, ADC ETC ///////////////////
+
+void hal_leds_init(void) {
+}
+
+void hal_leds_set(uint8_t value) {
+	leds = value;
+}
+
+void hal_seven_seg_init(void) {
+}
+
+void hal_seven_seg_write(uint8_t digit, uint8_t segments) {
+	seven_seg_segments[digit & 1] = segments;
+}
+
+void hal_buttons_init(void) {
+}
+
+uint8_t hal_buttons_read(void) {
+	return button_state;
+}
+
+// Called every millisecond. Each button push from standard input is held
+// down for BUTTON_HOLD_TIME then released.
+static void service_buttons(void) {
+	if(button_timer) {
+		button_timer--;
+		if(button_timer == BUTTON_GAP_TIME) {
+			button_state = 0;
+			buttons_interrupt();
+		}
+	} else if(buttons_queued && virtual_time >= BUTTON_START_TIME) {
+		button_state = 1 << (button_queue[0] - '0');
+		buttons_queued--;
+		memmove(&button_queue[0], &button_queue[1], buttons_queued);
+		button_timer = BUTTON_HOLD_TIME + BUTTON_GAP_TIME;
+		buttons_interrupt();
+	}
+}
+
+uint8_t hal_switches_read(void) {
+	return 0;
+}
+
+void hal_adc_init(void) {
+}
+
+uint16_t hal_adc_read(uint8_t channel) {
+	(void)channel;
+	return 530; // Joystick centred
+}
+
+void hal_buzzer_init(void) {
+}
+
+void hal_buzzer_set(uint16_t period, uint16_t pulse_width) {
+	(void)period;
+	(void)pulse_width;
+}
+
+void hal_buzzer_enable(uint8_t on) {
+	(void)on;
+}
+
+///////////////////////////////// EEPROM ////////////////////////////////////
+
+static void load_eeprom(void) {
+	const char* name = getenv("FROGGER_EEPROM");
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	eeprom_fd = open(name ? name : "frogger.eep", O_RDWR | O_CREAT, 0644);
+	if(eeprom_fd >= 0 && pread(eeprom_fd, eeprom, sizeof(eeprom), 0) < 0) {
+		perror("EEPROM file");
+	}
+	eeprom_loaded = 1;
+}
+
+uint8_t hal_eeprom_read_byte(uint16_t address) {
+	if(!eeprom_loaded) {
+		load_eeprom();
+	}
+	return eeprom[address % HAL_EEPROM_SIZE];
+}
+
+void hal_eeprom_read_block(void* data, uint16_t address, uint16_t length) {
+	uint8_t* bytes = data;
+	while(length--) {
+		*bytes++ = hal_eeprom_read_byte(address++);
+	}
+}
+
+void hal_eeprom_write_byte(uint16_t address, uint8_t value) {
+	if(!eeprom_loaded) {
+		load_eeprom();
+	}
+	address %= HAL_EEPROM_SIZE;
+	eeprom[address] = value;
+	if(eeprom_fd >= 0 && pwrite(eeprom_fd, &value, 1, address) != 1) {
+		perror("EEPROM file");
+	}
+}
+
+void hal_eeprom_ready_interrupt(uint8_t enable) {
+	eeprom_interrupt = enable;
+}
+
+////////////////////////////////// UARTS ////////////////////////////////////
+
+void hal_uart_init(long baudrate) {
+	struct termios settings;
+	(void)baudrate;
+	uart_master = posix_openpt(O_RDWR | O_NOCTTY);
+	if(uart_master < 0 || grantpt(uart_master) || unlockpt(uart_master)) {
+		perror("pseudo terminal");
+		exit(1);
+	}
+	// Keep the other end open ourselves so we can write to it before (and
+	// after) a terminal program is connected
+	uart_slave = open(ptsname(uart_master), O_RDWR | O_NOCTTY);
+	tcgetattr(uart_slave, &settings);
+	cfmakeraw(&settings);
+	tcsetattr(uart_slave, TCSANOW, &settings);
+	fcntl(uart_master, F_SETFL, fcntl(uart_master, F_GETFL) | O_NONBLOCK);
+	fprintf(stderr, "Terminal: %s\n", ptsname(uart_master));
+}
+
+void hal_uart_write(uint8_t byte) {
+	// Output nobody is reading is thrown away
+	if(uart_master >= 0 && write(uart_master, &byte, 1) != 1) {
+		return;
+	}
+}
+
+void hal_uart_tx_interrupt(uint8_t enable) {
+	uart_tx_interrupt = enable;
+}
+
+void hal_uart1_init(long baudrate) {
+	const char* name = getenv("FROGGER_TELEMETRY");
+	(void)baudrate;
+	if(name) {
+		uart1_file = fopen(name, "wb");
+	}
+}
+
+void hal_uart1_write(uint8_t byte) {
+	if(uart1_file) {
+		fputc(byte, uart1_file);
+	}
+}
+
+void hal_uart1_tx_interrupt(uint8_t enable) {
+	uart1_tx_interrupt = enable;
+}
+
+uint16_t hal_ram_static(void) {
+	return 0;
+}
+
+uint16_t hal_ram_untouched(void) {
+	return 0;
+}
+
+// Run the serial and EEPROM interrupt handlers and read the buttons
+static void service_io(void) {
+	char c;
+	// The output buffers are emptied straight away
+	while(uart_tx_interrupt) {
+		serial_tx_interrupt();
+	}
+#if TELEMETRY_USART == 1
+	while(uart1_tx_interrupt) {
+		telemetry_tx_interrupt();
+	}
+#endif
+	// One character received per poll - about the rate of a real UART
+	if(uart_master >= 0 && read(uart_master, &c, 1) == 1) {
+		serial_rx_interrupt(c);
+		woken = 1;
+	}
+	// One EEPROM byte per poll
+	if(eeprom_interrupt) {
+		eeprom_ready_interrupt();
+	}
+	while(stdin_open && buttons_queued < sizeof(button_queue)) {
+		ssize_t result = read(STDIN_FILENO, &c, 1);
+		if(result == 0) {
+			stdin_open = 0;
+		} else if(result < 0) {
+			break;
+		} else if(c >= '0' && c <= '3') {
+			button_queue[buttons_queued++] = c;
+		}
+	}
+}
+
+////////////////////////////////// EXIT /////////////////////////////////////
+
+static char pixel_char(PixelColour colour) {
+	switch(colour) {
+		case COLOUR_BLACK:
+			return '.';
+		case COLOUR_RED:
+			return 'R';
+		case COLOUR_GREEN:
+			return 'G';
+		case COLOUR_YELLOW:
+			return 'Y';
+		case COLOUR_ORANGE:
+			return 'O';
+		case COLOUR_LIGHT_ORANGE:
+			return 'o';
+		case COLOUR_LIGHT_YELLOW:
+			return 'y';
+		case COLOUR_LIGHT_GREEN:
+			return 'g';
+		default:
+			return '#';
+	}
+}
+
+static char seven_seg_char(uint8_t segments) {
+	static const uint8_t digits[10] = {63,6,91,79,102,109,125,7,127,111};
+	for(uint8_t i = 0; i < 10; i++) {
+		if((segments & 0x7F) == digits[i]) {
+			return '0' + i;
+		}
+	}
+	return segments & 0x7F ? '?' : ' ';
+}
+
+// Print the display and how fast we ran
+static void report(void) {
+	double elapsed = wall_time() - start_wall_time;
+	if(stdin_is_tty) {
+		tcsetattr(STDIN_FILENO, TCSANOW, &stdin_termios);
+	}
+	if(uart1_file) {
+		fclose(uart1_file);
+	}
+	if(!clock_running) {
+		// Only the game logic was used (e.g. host/difficulty.c)
+		return;
+	}
+	for(int8_t y = MATRIX_NUM_ROWS - 1; y >= 0; y--) {
+		for(uint8_t i = 0; i < LEDPANELS; i++) {
+			if(i > 0) {
+				fputc(' ', stderr);
+			}
+			for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+				fputc(pixel_char(panels[i].display[y][x]), stderr);
+			}
+		}
+		fputc('\n', stderr);
+	}
+	fprintf(stderr, "SPI bytes:");
+	for(uint8_t i = 0; i < LEDPANELS; i++) {
+		fprintf(stderr, " %lu", panels[i].bytes);
+	}
+	fputc('\n', stderr);
+	fprintf(stderr, "Seven segment: %c%s%c%s  LEDs: %02X\n",
+			seven_seg_char(seven_seg_segments[1]), seven_seg_segments[1] & 0x80 ? "." : "",
+			seven_seg_char(seven_seg_segments[0]), seven_seg_segments[0] & 0x80 ? "." : "",
+			leds);
+	fprintf(stderr, "%lu ms of game time in %.3f s (%.0f ticks/s)\n",
+			(unsigned long)virtual_time, elapsed, elapsed > 0 ? virtual_time / elapsed : 0);
+}
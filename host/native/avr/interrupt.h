@@ -0,0 +1,14 @@
+/*
+ * avr/interrupt.h for the host build (see host/hal_native.c)
+ *
+ * There are no real interrupts on the host - the handlers run from
+ * hal_poll() - so enabling and disabling them does nothing.
+ */
+
+#ifndef NATIVE_AVR_INTERRUPT_H_
+#define NATIVE_AVR_INTERRUPT_H_
+
+#define sei()
+#define cli()
+
+#endif /* NATIVE_AVR_INTERRUPT_H_ */
@@ -0,0 +1,22 @@
+/*
+ * avr/pgmspace.h for the host build (see host/hal_native.c)
+ *
+ * The host has one address space so program memory is just memory.
+ */
+
+#ifndef NATIVE_AVR_PGMSPACE_H_
+#define NATIVE_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_dword(address) (*(const uint32_t*)(address))
+#define pgm_read_ptr(address) (*(const void* const*)(address))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#endif /* NATIVE_AVR_PGMSPACE_H_ */
@@ -0,0 +1,17 @@
+/*
+ * util/atomic.h for the host build (see host/hal_native.c)
+ *
+ * Interrupt handlers only run from hal_poll() on the host, never in the
+ * middle of an atomic block, so the block just runs once.
+ */
+
+#ifndef NATIVE_UTIL_ATOMIC_H_
+#define NATIVE_UTIL_ATOMIC_H_
+
+#include <stdint.h>
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 0
+#define ATOMIC_BLOCK(type) for(uint8_t atomic_done_ = 0; !atomic_done_; atomic_done_ = 1)
+
+#endif /* NATIVE_UTIL_ATOMIC_H_ */
@@ -0,0 +1,19 @@
+/*
+ * util/crc16.h for the host build (see host/hal_native.c)
+ *
+ * The same calculation as avr-libc's version.
+ */
+
+#ifndef NATIVE_UTIL_CRC16_H_
+#define NATIVE_UTIL_CRC16_H_
+
+#include <stdint.h>
+
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data) {
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4)
+			^ ((uint16_t)data << 3));
+}
+
+#endif /* NATIVE_UTIL_CRC16_H_ */
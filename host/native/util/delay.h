@@ -0,0 +1,16 @@
+/*
+ * util/delay.h for the host build (see host/hal_native.c)
+ *
+ * Delays run the virtual clock (and the interrupt handlers) on by the
+ * given time.
+ */
+
+#ifndef NATIVE_UTIL_DELAY_H_
+#define NATIVE_UTIL_DELAY_H_
+
+void hal_native_delay_ms(double ms);
+
+#define _delay_ms(ms) hal_native_delay_ms(ms)
+#define _delay_us(us) hal_native_delay_ms((us) / 1000.0)
+
+#endif /* NATIVE_UTIL_DELAY_H_ */
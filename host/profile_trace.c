@@ -0,0 +1,304 @@
+/*
+ * profile_trace.c
+ *
+ * Host side viewer for the main loop profile (see profile.h). Reads the
+ * output of one or more profile dumps (a capture of the serial terminal -
+ * anything outside the PROFILE ... END lines is ignored) and adds them
+ * together, then writes either:
+ *  - a Chrome trace (the default) - load it in chrome://tracing or
+ *    https://ui.perfetto.dev. It shows an average loop iteration with
+ *    each phase's mean time per iteration on one track and each phase's
+ *    worst case on another. Hover over a phase for its counts.
+ *  - folded stacks (-f) for flamegraph.pl, in cycles.
+ * The part of a loop iteration not in any phase (catching the game up,
+ * collision checks, etc.) is shown as "other".
+ *
+ * A table of the interrupt service routines - how often each ran, its
+ * worst case and its share of the CPU over the time the dumps cover - is
+ * written to standard error.
+ *
+ * Build:  gcc -O2 -o profile_trace host/profile_trace.c
+ * Usage:  profile_trace [-f] <capture file | -> [output file]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_PHASES 10
+#define LOOP 9
+
+typedef struct {
+	const char* name;
+	const char* parent;	// for the folded stacks
+	unsigned long long count;
+	unsigned long long total;
+	unsigned long min;
+	unsigned long max;
+} Phase;
+
+// Same order as profile.h
+static Phase phases[NUM_PHASES] = {
+	{ "input", "play_game" },
+	{ "adc", "play_game" },
+	{ "move", "play_game" },
+	{ "lane0", "play_game;advance_game" },
+	{ "lane1", "play_game;advance_game" },
+	{ "lane2", "play_game;advance_game" },
+	{ "log0", "play_game;advance_game" },
+	{ "log1", "play_game;advance_game" },
+	{ "output", "play_game" },
+	{ "loop", "" },
+};
+
+typedef struct {
+	const char* name;
+	unsigned long long count;
+	unsigned long long total;
+	unsigned long max;
+} Isr;
+
+// Same order as profile.h
+#define NUM_ISRS 6
+static Isr isrs[NUM_ISRS] = {
+	{ "timer0" }, { "buttons" }, { "uart_tx" }, { "uart_rx" }, { "eeprom" }, { "telem" },
+};
+static unsigned long long isr_time_ms = 0;
+
+// The order phases happen in within an iteration
+static const int timeline[] = { 3, 4, 5, 6, 7, 1, 0, 2, 8 };
+#define TIMELINE_LENGTH (sizeof(timeline) / sizeof(timeline[0]))
+
+static unsigned long clock_hz = 0;
+static int dumps = 0;
+
+// Returns the number of complete dumps read
+static int read_dumps(FILE* in) {
+	char line[256];
+	int in_dump = 0;
+	Phase read[NUM_PHASES];
+	Isr read_isrs[NUM_ISRS];
+	unsigned long long read_time_ms = 0;
+	int lines = 0, isr_lines = 0, in_isrs = 0;
+
+	while(fgets(line, sizeof(line), in)) {
+		char* start = strstr(line, "PROFILE ");
+		char name[32];
+		unsigned long long count, total;
+		unsigned long min, max;
+
+		if(start) {
+			clock_hz = strtoul(start + 8, NULL, 10);
+			memset(read, 0, sizeof(read));
+			memset(read_isrs, 0, sizeof(read_isrs));
+			in_dump = 1;
+			in_isrs = 0;
+			lines = 0;
+			isr_lines = 0;
+			continue;
+		}
+		if(!in_dump) {
+			continue;
+		}
+		if(strncmp(line, "ISR ", 4) == 0) {
+			read_time_ms = strtoull(line + 4, NULL, 10);
+			in_isrs = 1;
+			continue;
+		}
+		if(strncmp(line, "END", 3) == 0) {
+			in_dump = 0;
+			if(lines != NUM_PHASES || isr_lines != NUM_ISRS) {
+				fprintf(stderr, "Incomplete dump skipped\n");
+				continue;
+			}
+			for(int i = 0; i < NUM_ISRS; i++) {
+				if(read_isrs[i].max > isrs[i].max) {
+					isrs[i].max = read_isrs[i].max;
+				}
+				isrs[i].count += read_isrs[i].count;
+				isrs[i].total += read_isrs[i].total;
+			}
+			isr_time_ms += read_time_ms;
+			for(int i = 0; i < NUM_PHASES; i++) {
+				if(read[i].count == 0) {
+					continue;
+				}
+				if(phases[i].count == 0 || read[i].min < phases[i].min) {
+					phases[i].min = read[i].min;
+				}
+				if(read[i].max > phases[i].max) {
+					phases[i].max = read[i].max;
+				}
+				phases[i].count += read[i].count;
+				phases[i].total += read[i].total;
+			}
+			dumps++;
+			continue;
+		}
+		if(in_isrs) {
+			if(sscanf(line, "%31s %llu %lu %llu", name, &count, &max, &total) != 4) {
+				continue;
+			}
+			for(int i = 0; i < NUM_ISRS; i++) {
+				if(strcmp(name, isrs[i].name) == 0) {
+					read_isrs[i].count = count;
+					read_isrs[i].max = max;
+					read_isrs[i].total = total;
+					isr_lines++;
+				}
+			}
+			continue;
+		}
+		if(sscanf(line, "%31s %llu %lu %lu %llu", name, &count, &min, &max, &total) != 5) {
+			continue;
+		}
+		for(int i = 0; i < NUM_PHASES; i++) {
+			if(strcmp(name, phases[i].name) == 0) {
+				read[i].count = count;
+				read[i].min = min;
+				read[i].max = max;
+				read[i].total = total;
+				lines++;
+			}
+		}
+	}
+	return dumps;
+}
+
+// Cycles not in any phase
+static unsigned long long other_cycles(void) {
+	unsigned long long in_phases = 0;
+	for(int i = 0; i < NUM_PHASES; i++) {
+		if(i != LOOP) {
+			in_phases += phases[i].total;
+		}
+	}
+	return phases[LOOP].total > in_phases ? phases[LOOP].total - in_phases : 0;
+}
+
+static void write_isr_table(FILE* out) {
+	double cycles = (double)isr_time_ms * clock_hz / 1000;
+	unsigned long long all = 0;
+
+	fprintf(out, "Interrupts over %.3f s:\n", isr_time_ms / 1000.0);
+	fprintf(out, "%-8s %10s %10s %10s %8s %8s\n", "isr", "count", "per sec",
+			"max cyc", "max us", "% cpu");
+	for(int i = 0; i < NUM_ISRS; i++) {
+		fprintf(out, "%-8s %10llu %10.1f %10lu %8.1f %8.3f\n", isrs[i].name,
+				isrs[i].count, isr_time_ms ? isrs[i].count * 1000.0 / isr_time_ms : 0,
+				isrs[i].max, isrs[i].max * 1e6 / clock_hz,
+				cycles > 0 ? isrs[i].total * 100.0 / cycles : 0);
+		all += isrs[i].total;
+	}
+	fprintf(out, "%-8s %52.3f\n", "total", cycles > 0 ? all * 100.0 / cycles : 0);
+}
+
+static void write_folded(FILE* out) {
+	for(int i = 0; i < NUM_PHASES; i++) {
+		if(i != LOOP && phases[i].total) {
+			fprintf(out, "%s;%s %llu\n", phases[i].parent, phases[i].name, phases[i].total);
+		}
+	}
+	fprintf(out, "play_game;other %llu\n", other_cycles());
+}
+
+static double to_us(double cycles) {
+	return cycles * 1e6 / clock_hz;
+}
+
+static void write_event(FILE* out, int* first, const char* name, int track,
+		double start, double duration, const Phase* phase) {
+	fprintf(out, "%s\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+			"\"ts\": %.3f, \"dur\": %.3f", *first ? "" : ",", name, track, start, duration);
+	if(phase) {
+		fprintf(out, ", \"args\": {\"count\": %llu, \"min_cycles\": %lu, "
+				"\"mean_cycles\": %.1f, \"max_cycles\": %lu, \"total_cycles\": %llu}",
+				phase->count, phase->min,
+				phase->count ? (double)phase->total / phase->count : 0.0,
+				phase->max, phase->total);
+	}
+	fprintf(out, "}");
+	*first = 0;
+}
+
+static void write_chrome_trace(FILE* out) {
+	unsigned long long iterations = phases[LOOP].count;
+	double time = 0;
+	int first = 1;
+
+	fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+	fprintf(out, "\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, "
+			"\"args\": {\"name\": \"mean per iteration\"}},");
+	fprintf(out, "\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, "
+			"\"args\": {\"name\": \"worst case\"}}");
+	first = 0;
+
+	// Track 1 - an average iteration. Phases which don't happen every
+	// iteration (the scrolls) are spread over all iterations.
+	write_event(out, &first, "loop", 1, 0,
+			to_us((double)phases[LOOP].total / iterations), &phases[LOOP]);
+	for(size_t i = 0; i < TIMELINE_LENGTH; i++) {
+		const Phase* phase = &phases[timeline[i]];
+		double duration = to_us((double)phase->total / iterations);
+		write_event(out, &first, phase->name, 1, time, duration, phase);
+		time += duration;
+	}
+	write_event(out, &first, "other", 1, time,
+			to_us((double)other_cycles() / iterations), NULL);
+
+	// Track 2 - each phase's worst case, one after the other
+	time = 0;
+	for(size_t i = 0; i < TIMELINE_LENGTH; i++) {
+		const Phase* phase = &phases[timeline[i]];
+		double duration = to_us(phase->max);
+		write_event(out, &first, phase->name, 2, time, duration, phase);
+		time += duration;
+	}
+	fprintf(out, "\n]}\n");
+}
+
+int main(int argc, char** argv) {
+	int folded = 0, option;
+	FILE* in = stdin;
+	FILE* out = stdout;
+
+	while((option = getopt(argc, argv, "f")) != -1) {
+		if(option == 'f') {
+			folded = 1;
+		} else {
+			fprintf(stderr, "Usage: %s [-f] <capture file | -> [output file]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(argc - optind < 1 || argc - optind > 2) {
+		fprintf(stderr, "Usage: %s [-f] <capture file | -> [output file]\n", argv[0]);
+		return 1;
+	}
+	if(strcmp(argv[optind], "-") != 0 && (in = fopen(argv[optind], "r")) == NULL) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if(argc - optind == 2 && (out = fopen(argv[optind + 1], "w")) == NULL) {
+		perror(argv[optind + 1]);
+		return 1;
+	}
+
+	if(read_dumps(in) == 0 || phases[LOOP].count == 0 || clock_hz == 0) {
+		fprintf(stderr, "No profile found (was the firmware built with -DPROFILE?)\n");
+		return 1;
+	}
+	fprintf(stderr, "%d dump(s), %llu loop iterations\n", dumps, phases[LOOP].count);
+	write_isr_table(stderr);
+
+	if(folded) {
+		write_folded(out);
+	} else {
+		write_chrome_trace(out);
+	}
+	if(out != stdout) {
+		fclose(out);
+	}
+	return 0;
+}
@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# ram_report.sh
+#
+# Build time RAM report. Compiles each module of the firmware on its own
+# and lists the static RAM (.data and .bss) each one takes, largest first,
+# then the biggest variables. Whatever is left of the 2KB is the room for
+# the stack - compare it with the high water mark the firmware reports
+# ('m' on the serial terminal).
+#
+# Usage (from the top of the repository, with avr-gcc on the path):
+#   host/ram_report.sh [extra compiler options, e.g. -DPROFILE]
+
+MCU=atmega324a
+RAM_SIZE=2048
+BUILD=$(mktemp -d) || exit 1
+trap 'rm -rf "$BUILD"' EXIT
+
+for source in *.c; do
+	avr-gcc -mmcu=$MCU -Os -I. "$@" -c -o "$BUILD/${source%.c}.o" "$source" || exit 1
+done
+avr-gcc -mmcu=$MCU -o "$BUILD/frogger.elf" "$BUILD"/*.o || exit 1
+
+echo "Static RAM by module (bytes):"
+printf "%-26s %6s %6s %6s\n" module data bss total
+for object in "$BUILD"/*.o; do
+	avr-size -A "$object" | awk -v name="$(basename "$object" .o).c" '
+		$1 == ".data" { data += $2 }
+		$1 ~ /^\.data\./ || $1 ~ /^\.rodata/ { data += $2 }	# constants not in flash
+		$1 == ".bss" || $1 ~ /^\.bss\./ { bss += $2 }
+		END { printf "%-26s %6d %6d %6d\n", name, data, bss, data + bss }'
+done | sort -k4 -n -r
+
+avr-size -A "$BUILD/frogger.elf" | awk -v ram=$RAM_SIZE '
+	$1 == ".data" { data = $2 }
+	$1 == ".bss" { bss = $2 }
+	END {
+		printf "%-26s %6d %6d %6d\n", "linked", data, bss, data + bss
+		printf "Left for the stack: %d of %d bytes\n", ram - data - bss, ram
+	}'
+
+echo
+echo "Largest variables (bytes):"
+avr-nm -S -t d --size-sort -r "$BUILD/frogger.elf" | awk '
+	$3 ~ /^[bBdD]$/ { printf "  %-30s %5d\n", $4, $2; if(++n == 15) exit }'
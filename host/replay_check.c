@@ -0,0 +1,612 @@
+/*
+ * replay_check.c
+ *
+ * Replay regression runner. Plays back a corpus of recorded games (replay
+ * logs - see replay.h) through the game itself (game.c and the modules it
+ * uses, with the native HAL - host/hal_native.c - standing in for the
+ * hardware) and checks each against golden values kept beside it:
+ *  - the tick and the scores at the end of each level
+ *  - the tick each life was lost on
+ *  - a hash of the state of the game, taken every tick and chained, at
+ *    every HASH_PERIOD ticks and at the end
+ * so a change to the drawing, collision checks or timing which changes how
+ * a game goes shows up as the first line that differs (a hash line puts
+ * it within HASH_PERIOD ticks). The state hashed each tick is the
+ * snapshot a save state holds (take_snapshot() in savestate.h) - the
+ * level, frogs, lanes and logs, riverbank, hazards, scores, countdown and
+ * scroll times - or while a frog is dying, when there isn't one, each
+ * frog's position, lives and score with the lane and log positions.
+ *
+ * The games are stepped a tick at a time by the main loop's own stepping
+ * (step.h, as play_game() in project.c), a level after another until game over,
+ * without the display, sound or terminal. Traces are shared out between
+ * worker processes (the game's state is global, so each worker is a
+ * fork()ed copy of it) which take the next one from a counter in shared
+ * memory whenever they finish the last. The throughput - game ticks
+ * replayed per second of wall clock time - is reported at the end.
+ *
+ * The corpus is a directory of .replay files, each a line of hex as sent
+ * by 'x' on the game over screen. The golden values for name.replay are
+ * in name.golden, written by -w. To start a corpus, -g writes count
+ * traces of games played by the attract mode's autopilot (autopilot.h)
+ * with a wrong move now and then - every other one with a second player
+ * moving at random. host/replays is one made that way. Write the golden
+ * values again only for a change which is meant to change how games go.
+ *
+ * Build (from the top of the repository):
+ *   gcc -std=gnu99 -O2 -DHAL_NATIVE -I. -Ihost/native -o replay_check \
+ *       $(ls *.c | grep -v -e hal_avr.c -e project.c) host/hal_native.c \
+ *       host/replay_check.c
+ * Usage:
+ *   replay_check [-w] [-j workers] [-t longest game in s] corpus
+ *   replay_check -g count [-r seed] corpus
+ * Exits with status 1 if any trace doesn't match its golden values (or
+ * has none).
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "autopilot.h"
+#include "game.h"
+#include "effects.h"
+#include "ledmatrix.h"
+#include "replay.h"
+#include "savestate.h"
+#include "score.h"
+#include "step.h"
+#include "timer0.h"
+
+#define MAX_WORKERS 64
+#define MAX_TRACES 1024
+#define MAX_PATH 512
+#define MAX_RESULT 65536	// bytes of golden values for a trace
+#define MAX_MESSAGE 256
+#define HASH_PERIOD 1000	// ticks between hashes in the golden values
+
+// How a trace went
+#define TRACE_PASSED 0
+#define TRACE_FAILED 1
+#define TRACE_WRITTEN 2
+
+typedef struct {
+	uint8_t status;
+	uint64_t ticks;
+	char message[MAX_MESSAGE];
+} Outcome;
+
+// Shared between the workers
+typedef struct {
+	uint32_t next_trace;
+	Outcome outcomes[MAX_TRACES];
+} Shared;
+
+// Settings
+static uint8_t write_golden = 0;
+static uint32_t time_limit = 600000;
+static uint64_t seed = 1;
+static const char* corpus;
+
+// The traces (file names without .replay), sorted
+static char* traces[MAX_TRACES];
+static uint32_t num_traces;
+
+// The game being played
+static uint64_t hash;
+static char* result;
+static size_t result_length;
+static uint8_t generating = 0;
+static uint32_t next_move[MAX_FROGS];
+static uint64_t random_state;
+
+static void usage(void);
+static int find_traces(void);
+static int generate(uint32_t count);
+static void work(Shared* shared);
+static void check(uint32_t trace, Outcome* outcome);
+static uint64_t play(void);
+static uint8_t make_moves(uint32_t tick);
+static uint8_t random_move(uint8_t frog);
+static void hash_state(uint32_t tick);
+static void hash_bytes(const void* data, size_t length);
+static void add_result(const char* format, ...);
+static char* read_file(const char* path);
+static void compare(const char* expected, const char* got, Outcome* outcome);
+static uint32_t next_random(void);
+static uint64_t splitmix(uint64_t x);
+
+int main(int argc, char** argv) {
+	Shared* shared;
+	uint64_t ticks = 0;
+	uint32_t failed = 0, written = 0, count = 0;
+	long workers = sysconf(_SC_NPROCESSORS_ONLN);
+	int option, status;
+	struct timespec start, end;
+	double elapsed;
+
+	while((option = getopt(argc, argv, "wj:t:g:r:")) != -1) {
+		switch(option) {
+			case 'w':
+			write_golden = 1;
+			break;
+			case 'j':
+			workers = atol(optarg);
+			break;
+			case 't':
+			time_limit = atol(optarg) * 1000;
+			break;
+			case 'g':
+			count = atol(optarg);
+			if(count == 0) {
+				usage();
+			}
+			break;
+			case 'r':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+			default:
+			usage();
+		}
+	}
+	if(optind != argc - 1 || workers < 1 || time_limit == 0) {
+		usage();
+	}
+	corpus = argv[optind];
+	if(workers > MAX_WORKERS) {
+		workers = MAX_WORKERS;
+	}
+	// Nothing is sent to the display until it is flushed, and it never is
+	ledmatrix_defer_updates(1);
+	if(count) {
+		return generate(count);
+	}
+	if(find_traces()) {
+		return 1;
+	}
+	if(num_traces == 0) {
+		fprintf(stderr, "No .replay files in %s\n", corpus);
+		return 1;
+	}
+	if(workers > num_traces) {
+		workers = num_traces;
+	}
+
+	shared = mmap(NULL, sizeof(Shared), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(shared == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	memset(shared, 0, sizeof(Shared));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint8_t i = 0; i < workers; i++) {
+		pid_t pid = fork();
+		if(pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if(pid == 0) {
+			work(shared);
+			_exit(0);
+		}
+	}
+	while(wait(&status) > 0) {
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			fprintf(stderr, "A worker failed\n");
+			return 1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	for(uint32_t i = 0; i < num_traces; i++) {
+		Outcome* outcome = &shared->outcomes[i];
+		ticks += outcome->ticks;
+		if(outcome->status == TRACE_FAILED) {
+			printf("FAIL %s: %s\n", traces[i], outcome->message);
+			failed++;
+		} else if(outcome->status == TRACE_WRITTEN) {
+			written++;
+		}
+	}
+	if(write_golden) {
+		printf("Wrote %u golden files\n", written);
+	} else {
+		printf("%u traces, %u passed, %u failed\n", num_traces, num_traces - failed, failed);
+	}
+	printf("%.0f s of game in %.2f s on %ld workers (%.0f ticks/s, %.1f traces/s)\n",
+			ticks / 1000.0, elapsed, workers, ticks / elapsed, num_traces / elapsed);
+	return failed ? 1 : 0;
+}
+
+static void usage(void) {
+	fprintf(stderr, "Usage: replay_check [-w] [-j workers] [-t longest game in s] corpus\n"
+			"       replay_check -g count [-r seed] corpus\n");
+	exit(1);
+}
+
+static int compare_names(const void* a, const void* b) {
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Fill in traces[] from the corpus directory
+static int find_traces(void) {
+	DIR* directory = opendir(corpus);
+	struct dirent* entry;
+	size_t length;
+
+	if(!directory) {
+		perror(corpus);
+		return 1;
+	}
+	while((entry = readdir(directory)) != NULL) {
+		length = strlen(entry->d_name);
+		if(length > 7 && !strcmp(entry->d_name + length - 7, ".replay")) {
+			if(num_traces == MAX_TRACES) {
+				fprintf(stderr, "More than %d traces\n", MAX_TRACES);
+				closedir(directory);
+				return 1;
+			}
+			traces[num_traces++] = strndup(entry->d_name, length - 7);
+		}
+	}
+	closedir(directory);
+	qsort(traces, num_traces, sizeof(char*), compare_names);
+	return 0;
+}
+
+// Play count games at random, recording them, and write each recording
+// to the corpus. (A recording stops when the log is full, so a game
+// played back from one can go differently from then on - the golden
+// values come from playing it back.)
+static int generate(uint32_t count) {
+	char path[MAX_PATH];
+	const uint8_t* log;
+	uint16_t length;
+	FILE* file;
+
+	generating = 1;
+	for(uint32_t trace = 0; trace < count; trace++) {
+		random_state = splitmix(seed ^ splitmix(trace)) | 1;
+		// Every other one a two player game
+		set_number_of_frogs(trace % 2 + 1);
+		replay_start_recording(trace % 2 + 1);
+		(void)play();
+		replay_stop();
+
+		snprintf(path, sizeof(path), "%s/random_%03u.replay", corpus, trace);
+		if(!(file = fopen(path, "w"))) {
+			perror(path);
+			return 1;
+		}
+		length = replay_get_log(&log);
+		for(uint16_t i = 0; i < length; i++) {
+			fprintf(file, "%02X", log[i]);
+		}
+		fprintf(file, "\n");
+		fclose(file);
+	}
+	printf("Wrote %u traces to %s\n", count, corpus);
+	return 0;
+}
+
+// A worker - check traces until they have all been taken
+static void work(Shared* shared) {
+	uint32_t trace;
+	result = malloc(MAX_RESULT);
+	if(!result) {
+		_exit(1);
+	}
+	for(;;) {
+		trace = __atomic_fetch_add(&shared->next_trace, 1, __ATOMIC_RELAXED);
+		if(trace >= num_traces) {
+			return;
+		}
+		check(trace, &shared->outcomes[trace]);
+	}
+}
+
+// Play back a trace and check it against (or write) its golden values
+static void check(uint32_t trace, Outcome* outcome) {
+	char path[MAX_PATH];
+	char* text;
+	char* golden;
+	char* line;
+	FILE* file;
+
+	outcome->status = TRACE_FAILED;
+	snprintf(path, sizeof(path), "%s/%s.replay", corpus, traces[trace]);
+	if(!(text = read_file(path))) {
+		snprintf(outcome->message, MAX_MESSAGE, "can't be read");
+		return;
+	}
+	replay_load_start();
+	for(char* c = text; *c && replay_load_char(*c); c++) {
+	}
+	free(text);
+	replay_start_playback();
+	set_number_of_frogs(replay_players());
+	outcome->ticks = play();
+	replay_stop();
+
+	snprintf(path, sizeof(path), "%s/%s.golden", corpus, traces[trace]);
+	if(write_golden) {
+		if(!(file = fopen(path, "w"))) {
+			snprintf(outcome->message, MAX_MESSAGE, "golden values can't be written");
+			return;
+		}
+		fprintf(file, "# Golden values for %s.replay (host/replay_check.c)\n%s",
+				traces[trace], result);
+		fclose(file);
+		outcome->status = TRACE_WRITTEN;
+		return;
+	}
+	if(!(text = read_file(path))) {
+		snprintf(outcome->message, MAX_MESSAGE, "no golden values - write them with -w");
+		return;
+	}
+	// Leave out the comments
+	golden = malloc(strlen(text) + 1);
+	golden[0] = '\0';
+	for(line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+		if(line[0] != '#') {
+			strcat(strcat(golden, line), "\n");
+		}
+	}
+	free(text);
+	compare(golden, result, outcome);
+	free(golden);
+}
+
+// Play a game to the end, a level at a time - moves are played back from
+// the replay log (or made at random and recorded if generating). The
+// golden values are put in result[]. Returns the number of ticks played.
+static uint64_t play(void) {
+	uint32_t tick = 0;
+	uint8_t playing, level = 1, frogs = get_number_of_frogs();
+	uint8_t lives_lost[MAX_FROGS];
+
+	result_length = 0;
+	hash = 0xCBF29CE484222325ULL;	// FNV-1a
+	effects_stop();
+	reset_levels();
+	reset_speeds();
+	for(;;) {
+		// As new_game() and play_game() in project.c
+		initialise_game();
+		init_score();
+		game_count();
+		set_game_tick(tick);
+		reset_count_at(tick);
+		start_scrolling(tick);
+		replay_new_level(tick);
+		for(uint8_t frog = 0; frog < frogs; frog++) {
+			lives_lost[frog] = get_time_died(frog);
+		}
+		if(generating) {
+			autopilot_start(tick);
+			next_move[1] = tick + 100 + next_random() % 400;
+		}
+
+		playing = 1;
+		while(playing && tick < time_limit) {
+			tick++;
+			playing = advance_game(tick);
+			if(playing) {
+				playing = make_moves(tick);
+			}
+			for(uint8_t frog = 0; frog < frogs; frog++) {
+				if(get_time_died(frog) != lives_lost[frog]) {
+					lives_lost[frog] = get_time_died(frog);
+					add_result("death %u %u\n", frog + 1, tick);
+				}
+			}
+			hash_state(tick);
+			if(tick % HASH_PERIOD == 0) {
+				add_result("hash %u %016llX\n", tick, (unsigned long long)hash);
+			}
+		}
+		add_result("level %u %u score %u", level, tick, get_score(0));
+		if(frogs == 2) {
+			add_result(" %u", get_score(1));
+		}
+		add_result("\n");
+		if(playing || !is_riverbank_full()) {
+			break;
+		}
+		// As handle_next_level()
+		next_level();
+		speed_up();
+		level++;
+	}
+	add_result("end %u %016llX%s\n", tick, (unsigned long long)hash,
+			playing ? " (out of time)" : "");
+	return tick;
+}
+
+// Make the moves due on the given tick. Returns 0 if the game is over.
+static uint8_t make_moves(uint32_t tick) {
+	uint8_t move, frog;
+
+	if(!generating) {
+		while((move = replay_next_move(tick, &frog)) != MOVE_NONE) {
+			move_frog(frog, move);
+			if(!update_frogs()) {
+				return 0;
+			}
+		}
+		return 1;
+	}
+	// Player 1 is the attract mode's autopilot (autopilot.h) with a wrong
+	// move now and then, player 2 moves at random
+	move = autopilot_step(tick, get_scroll_times(), get_scroll_periods(),
+			get_scroll_directions());
+	if(move != MOVE_NONE && next_random() % 8 == 0) {
+		move = random_move(0);
+	}
+	if(move != MOVE_NONE) {
+		replay_record_move(tick, 0, move);
+		move_frog(0, move);
+		if(!update_frogs()) {
+			return 0;
+		}
+	}
+	for(frog = 1; frog < get_number_of_frogs(); frog++) {
+		if(tick >= next_move[frog]) {
+			move = random_move(frog);
+			if(move != MOVE_NONE) {
+				replay_record_move(tick, frog, move);
+				move_frog(frog, move);
+				if(!update_frogs()) {
+					return 0;
+				}
+			}
+			next_move[frog] = tick + 100 + next_random() % 400;
+		}
+	}
+	return 1;
+}
+
+// Mostly forward when the row ahead is clear, otherwise mostly staying
+// put if it is safe or moving aside - but now and then anything at all
+static uint8_t random_move(uint8_t frog) {
+	uint8_t row = get_frog_row(frog);
+	uint8_t column = get_frog_column(frog);
+	uint32_t choice = next_random() % 10;
+
+	if(choice < 2) {
+		return choice ? MOVE_BACKWARD : MOVE_FORWARD;
+	}
+	if(!((get_row_danger(row + 1) >> column) & 1)) {
+		return MOVE_FORWARD;
+	}
+	if(choice < 6 && !((get_row_danger(row) >> column) & 1)) {
+		return MOVE_NONE;
+	}
+	return choice & 1 ? MOVE_LEFT : MOVE_RIGHT;
+}
+
+// Chain the state of the game on the given tick into the hash
+static void hash_state(uint32_t tick) {
+	GameSnapshot snapshot;
+	GameState state;
+	int8_t frog[2];
+	uint8_t lives;
+	uint32_t score;
+
+	// (no padding left over from before)
+	memset(&snapshot, 0, sizeof(snapshot));
+	if(take_snapshot(&snapshot, tick, get_scroll_times())) {
+		// (a frog not in this game is still where the last game left it)
+		for(uint8_t i = snapshot.game.num_frogs; i < MAX_FROGS; i++) {
+			memset(&snapshot.game.frogs[i], 0, sizeof(SavedFrog));
+		}
+		hash_bytes(&snapshot, sizeof(snapshot));
+		return;
+	}
+	memset(&state, 0, sizeof(state));
+	get_game_state(&state);
+	hash_bytes(state.lane_position, sizeof(state.lane_position));
+	hash_bytes(state.log_position, sizeof(state.log_position));
+	for(uint8_t i = 0; i < get_number_of_frogs(); i++) {
+		frog[0] = (int8_t)get_frog_row(i);
+		frog[1] = (int8_t)get_frog_column(i);
+		lives = get_time_died(i);
+		score = get_score(i);
+		hash_bytes(frog, sizeof(frog));
+		hash_bytes(&lives, 1);
+		hash_bytes(&score, sizeof(score));
+	}
+}
+
+static void hash_bytes(const void* data, size_t length) {
+	const uint8_t* bytes = data;
+	for(size_t i = 0; i < length; i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+	}
+}
+
+static void add_result(const char* format, ...) {
+	va_list arguments;
+	int length;
+	if(!result) {
+		// (not kept when generating)
+		return;
+	}
+	va_start(arguments, format);
+	length = vsnprintf(result + result_length, MAX_RESULT - result_length, format, arguments);
+	va_end(arguments);
+	if(length > 0 && result_length + length < MAX_RESULT) {
+		result_length += length;
+	}
+}
+
+// The whole of a file (null terminated), or NULL if it can't be read
+static char* read_file(const char* path) {
+	FILE* file = fopen(path, "r");
+	char* text;
+	long length;
+
+	if(!file) {
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	length = ftell(file);
+	rewind(file);
+	text = malloc(length + 1);
+	if(text) {
+		text[fread(text, 1, length, file)] = '\0';
+	}
+	fclose(file);
+	return text;
+}
+
+// Compare the golden values with the ones got, line by line, and say
+// where they first differ
+static void compare(const char* expected, const char* got, Outcome* outcome) {
+	int line = 1;
+	size_t length;
+
+	while(*expected && *got) {
+		length = strcspn(expected, "\n");
+		if(strncmp(expected, got, length + 1)) {
+			break;
+		}
+		expected += length + 1;
+		got += length + 1;
+		line++;
+	}
+	if(!*expected && !*got) {
+		outcome->status = TRACE_PASSED;
+		return;
+	}
+	snprintf(outcome->message, MAX_MESSAGE, "line %d expected \"%.*s\" got \"%.*s\"", line,
+			(int)strcspn(expected, "\n"), expected, (int)strcspn(got, "\n"), got);
+}
+
+// xorshift64*
+static uint32_t next_random(void) {
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return (random_state * 2685821657736338717ULL) >> 32;
+}
+
+static uint64_t splitmix(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
@@ -0,0 +1,31 @@
+#!/bin/sh
+#
+# run_checks.sh
+#
+# Builds and runs the host checks of the game code - the property tests
+# (game_props.c), the escape sequence fuzz target's own sweep
+# (fuzz_escape.c) and the replay corpus (replay_check.c with
+# host/replays) - and stops at the first one which fails. Takes a few
+# seconds. Each file says how to run it on its own with other options.
+#
+# Usage (from the top of the repository, with gcc on the path):
+#   host/run_checks.sh [extra compiler options, e.g. -DCHECK_INVARIANTS]
+
+CC=${CC:-gcc}
+BUILD=$(mktemp -d) || exit 1
+trap 'rm -rf "$BUILD"' EXIT
+
+# The game's modules once, then each check linked with them
+for source in $(ls *.c | grep -v -e hal_avr.c -e project.c) host/hal_native.c; do
+	$CC -std=gnu99 -O2 -DHAL_NATIVE -I. -Ihost/native "$@" \
+		-c -o "$BUILD/$(basename "${source%.c}").o" "$source" || exit 1
+done
+for check in game_props fuzz_escape replay_check; do
+	$CC -std=gnu99 -O2 -DHAL_NATIVE -I. -Ihost/native "$@" -o "$BUILD/$check" \
+		"$BUILD"/*.o "host/$check.c" || exit 1
+done
+
+"$BUILD/game_props" || exit 1
+"$BUILD/fuzz_escape" || exit 1
+"$BUILD/replay_check" host/replays || exit 1
+echo "All host checks passed"
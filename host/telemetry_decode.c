@@ -0,0 +1,214 @@
+/*
+ * telemetry_decode.c
+ *
+ * Host side decoder for the telemetry stream (see telemetry.h). Reads the
+ * stream from a serial port or a capture file, checks and un-deltas each
+ * frame and writes one CSV line per tick to the output file.
+ *
+ * Build:  gcc -O2 -o telemetry_decode host/telemetry_decode.c
+ * Usage:  telemetry_decode <serial device | capture file | -> <output.csv> [baud]
+ *
+ * If a baud rate is given the input is treated as a serial port and put
+ * into raw mode at that rate. Anything between frames which doesn't decode
+ * (e.g. terminal text on a shared USART) is counted and skipped.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define STATE_SIZE 15
+#define MAX_FRAME 64
+#define KEYFRAME_FLAG 0x8000
+
+static uint8_t state[STATE_SIZE];
+static int have_keyframe = 0;
+static int last_sequence = -1;
+static unsigned long frames = 0, bad_frames = 0, resyncs = 0;
+
+/* Same as avr-libc _crc_ccitt_update() */
+static uint16_t crc_ccitt_update(uint16_t crc, uint8_t data) {
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4)
+			^ ((uint16_t)data << 3));
+}
+
+/* Returns the decoded length or -1 if the data isn't valid COBS */
+static int cobs_decode(const uint8_t* encoded, int length, uint8_t* data) {
+	int in = 0, out = 0;
+	while(in < length) {
+		uint8_t code = encoded[in++];
+		if(code == 0 || in + code - 1 > length) {
+			return -1;
+		}
+		for(int i = 1; i < code; i++) {
+			data[out++] = encoded[in++];
+		}
+		if(code < 0xFF && in < length) {
+			data[out++] = 0;
+		}
+	}
+	return out;
+}
+
+static void baud_to_speed(long baud, speed_t* speed) {
+	switch(baud) {
+		case 9600: *speed = B9600; break;
+		case 19200: *speed = B19200; break;
+		case 38400: *speed = B38400; break;
+		case 57600: *speed = B57600; break;
+		case 115200: *speed = B115200; break;
+		default:
+			fprintf(stderr, "Unsupported baud rate %ld\n", baud);
+			exit(1);
+	}
+}
+
+static int open_input(const char* path, long baud) {
+	int fd;
+	struct termios tio;
+	speed_t speed;
+
+	if(strcmp(path, "-") == 0) {
+		return STDIN_FILENO;
+	}
+	fd = open(path, O_RDONLY | O_NOCTTY);
+	if(fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	if(baud) {
+		baud_to_speed(baud, &speed);
+		if(tcgetattr(fd, &tio) < 0) {
+			perror("tcgetattr");
+			exit(1);
+		}
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, speed);
+		cfsetospeed(&tio, speed);
+		tio.c_cc[VMIN] = 1;
+		tio.c_cc[VTIME] = 0;
+		if(tcsetattr(fd, TCSANOW, &tio) < 0) {
+			perror("tcsetattr");
+			exit(1);
+		}
+	}
+	return fd;
+}
+
+static void write_state(FILE* out, uint8_t sequence) {
+	fprintf(out, "%u,%d,%d,%d,%d,%d,%d,%d,%u,%lu,%u,%u\n",
+			sequence,
+			(int8_t)state[0], (int8_t)state[1],
+			(int8_t)state[2], (int8_t)state[3], (int8_t)state[4],
+			(int8_t)state[5], (int8_t)state[6],
+			state[7] | (state[8] << 8),
+			(unsigned long)state[9] | ((unsigned long)state[10] << 8)
+				| ((unsigned long)state[11] << 16) | ((unsigned long)state[12] << 24),
+			state[13], state[14]);
+}
+
+static void handle_frame(const uint8_t* encoded, int length, FILE* out) {
+	uint8_t frame[MAX_FRAME];
+	uint16_t crc = 0xFFFF, mask;
+	int i, pos, decoded_length;
+
+	decoded_length = cobs_decode(encoded, length, frame);
+	if(decoded_length < 5) {
+		bad_frames++;
+		return;
+	}
+	for(i = 0; i < decoded_length - 2; i++) {
+		crc = crc_ccitt_update(crc, frame[i]);
+	}
+	if(frame[decoded_length-2] != (crc & 0xFF) || frame[decoded_length-1] != (crc >> 8)) {
+		bad_frames++;
+		return;
+	}
+
+	mask = frame[1] | (frame[2] << 8);
+	if(!(mask & KEYFRAME_FLAG) && (!have_keyframe
+			|| frame[0] != (uint8_t)(last_sequence + 1))) {
+		// A frame was lost - deltas are meaningless until the next keyframe
+		if(have_keyframe) {
+			resyncs++;
+		}
+		have_keyframe = 0;
+		last_sequence = frame[0];
+		return;
+	}
+
+	pos = 3;
+	for(i = 0; i < STATE_SIZE; i++) {
+		if(mask & (1 << i)) {
+			if(pos >= decoded_length - 2) {
+				bad_frames++;
+				have_keyframe = 0;
+				return;
+			}
+			state[i] = frame[pos++];
+		}
+	}
+	have_keyframe = 1;
+	last_sequence = frame[0];
+	frames++;
+	write_state(out, frame[0]);
+}
+
+int main(int argc, char** argv) {
+	uint8_t buffer[256];
+	uint8_t frame[MAX_FRAME];
+	int frame_length = 0, overflow = 0;
+	ssize_t n;
+	FILE* out;
+	int fd;
+
+	if(argc < 3) {
+		fprintf(stderr, "Usage: %s <serial device | capture file | -> <output.csv> [baud]\n", argv[0]);
+		return 1;
+	}
+	fd = open_input(argv[1], argc > 3 ? atol(argv[3]) : 0);
+	out = fopen(argv[2], "w");
+	if(!out) {
+		perror(argv[2]);
+		return 1;
+	}
+	fprintf(out, "seq,frog_row,frog_column,lane0,lane1,lane2,log0,log1,"
+			"riverbank_status,score,time_died,count\n");
+
+	while((n = read(fd, buffer, sizeof(buffer))) != 0) {
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			perror("read");
+			break;
+		}
+		for(ssize_t i = 0; i < n; i++) {
+			if(buffer[i] == 0) {
+				if(frame_length > 0 && !overflow) {
+					handle_frame(frame, frame_length, out);
+				} else if(overflow) {
+					bad_frames++;
+				}
+				frame_length = 0;
+				overflow = 0;
+			} else if(frame_length < MAX_FRAME) {
+				frame[frame_length++] = buffer[i];
+			} else {
+				overflow = 1;
+			}
+		}
+		fflush(out);
+	}
+	fclose(out);
+	fprintf(stderr, "%lu frames, %lu bad or skipped chunks, %lu resyncs\n",
+			frames, bad_frames, resyncs);
+	return 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * idle.c
+ *
+ * Idle sleep and CPU load - see idle.h.
+ */
+
+#include <avr/pgmspace.h>
+
+#include "idle.h"
+#include "timer0.h"
+#include "buttons.h"
+#include "serialio.h"
+#include "hal.h"
+
+// Fine time units (see get_fine_time()) per millisecond
+#define FINE_PER_MS 125
+
+// Time spent asleep since the last report, in fine time units
+static uint32_t asleep;
+// When the last report was (get_monotonic_time())
+static uint32_t report_time;
+
+void idle_sleep(void) {
+	uint16_t start = get_fine_time();
+	hal_sleep();
+	asleep += (uint16_t)(get_fine_time() - start);
+}
+
+void idle_until(uint32_t deadline) {
+	while((int32_t)(get_current_time() - deadline) < 0
+			&& !serial_input_available() && !button_waiting()) {
+		idle_sleep();
+	}
+}
+
+void load_report(void) {
+	uint32_t now = get_monotonic_time();
+	uint32_t elapsed = now - report_time;
+	uint32_t busy = elapsed - asleep / FINE_PER_MS;
+
+	if(elapsed == 0) {
+		return;
+	}
+	serial_put_string_P(PSTR("\nCPU load "));
+	serial_put_uint16(busy * 100 / elapsed);
+	serial_put_string_P(PSTR("% busy "));
+	serial_put_uint32(busy);
+	serial_put_string_P(PSTR(" of "));
+	serial_put_uint32(elapsed);
+	serial_put_char('\n');
+	asleep = 0;
+	report_time = now;
+}
@@ -0,0 +1,29 @@
+/*
+ * idle.h
+ *
+ * Sleeping while there is nothing to do, and the CPU load. The CPU is put
+ * in idle sleep (hal_sleep()) until the next interrupt - the millisecond
+ * tick, a character received on the terminal or a button change - rather
+ * than spinning round a loop. The time spent asleep is counted, so the
+ * time the CPU was busy can be reported as a load.
+ */
+
+#ifndef IDLE_H_
+#define IDLE_H_
+
+#include <stdint.h>
+
+// Sleep until the next interrupt
+void idle_sleep(void);
+
+// Sleep until the game clock (get_current_time()) reaches deadline or
+// there is input waiting - a character on the terminal or a button
+// down. Returns straight away if the deadline has passed.
+void idle_until(uint32_t deadline);
+
+// Send a line with the CPU load since the last report (or power up) to
+// the serial terminal:
+//   CPU load <percent>% busy <ms> of <ms>
+void load_report(void);
+
+#endif /* IDLE_H_ */
@@ -3,34 +3,40 @@
  *
  * Author: Peter Sutton
  * 
- * See the LED matrix Reference for details of the SPI commands used.
+ * The functions below draw into panel 0's part of the framebuffer in
+ * ledpanels.c, which sends only what has changed. Each change is sent
+ * straight away unless ledmatrix_defer_updates() has been called, in which
+ * case it waits for the next ledpanels_flush().
  */ 
 
-#include <avr/io.h>
 #include "ledmatrix.h"
-#include "spi.h"
+#include "ledpanels.h"
+#include "hal.h"
 
-#define CMD_UPDATE_ALL 0x00
-#define CMD_UPDATE_PIXEL 0x01
-#define CMD_UPDATE_ROW 0x02
-#define CMD_UPDATE_COL 0x03
-#define CMD_SHIFT_DISPLAY 0x04
-#define CMD_CLEAR_SCREEN 0x0F
+static uint8_t deferred = 0;
+
+static void updated(void);
 
 void ledmatrix_setup(void) {
 	// Setup SPI - we divide the clock by 128.
 	// (This speed guarantees the SPI buffer will never overflow on
 	// the LED matrix.)
-	spi_setup_master(128);
+	hal_spi_init(128);
+	ledpanels_init();
+}
+
+void ledmatrix_defer_updates(uint8_t defer) {
+	deferred = defer;
+	updated();
 }
 
 void ledmatrix_update_all(MatrixData data) {
-	(void)spi_send_byte(CMD_UPDATE_ALL);
 	for(uint8_t y=0; y<MATRIX_NUM_ROWS; y++) {
 		for(uint8_t x=0; x<MATRIX_NUM_COLUMNS; x++) {
-			(void)spi_send_byte(data[x][y]);
+			ledpanels_set_pixel(x, y, data[x][y]);
 		}
 	}
+	updated();
 }
 
 void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
@@ -38,9 +44,8 @@ void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
 		// Position isn't valid - we ignore the request.
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_PIXEL);
-	(void)spi_send_byte( ((y & 0x07)<<4) | (x & 0x0F));
-	(void)spi_send_byte(pixel);
+	ledpanels_set_pixel(x, y, pixel);
+	updated();
 }
 
 void ledmatrix_update_row(uint8_t y, MatrixRow row) {
@@ -48,11 +53,10 @@ void ledmatrix_update_row(uint8_t y, MatrixRow row) {
 		// y value is too large - we ignore the request
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_ROW);
-	(void)spi_send_byte(y & 0x07);	// row number
 	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
-		(void)spi_send_byte(row[x]);
+		ledpanels_set_pixel(x, y, row[x]);
 	}
+	updated();
 }
 
 void ledmatrix_update_column(uint8_t x, MatrixColumn col) {
@@ -60,35 +64,37 @@ void ledmatrix_update_column(uint8_t x, MatrixColumn col) {
 		// x value is too large - we ignore the request
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_COL);
-	(void)spi_send_byte(x & 0x0F); // column number
 	for(uint8_t y = 0; y<MATRIX_NUM_ROWS; y++) {
-		(void)spi_send_byte(col[y]);
+		ledpanels_set_pixel(x, y, col[y]);
 	}
+	updated();
 }
 
 void ledmatrix_shift_display_left(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x02);
+	ledpanels_shift(0, LEDPANELS_SHIFT_LEFT);
 }
 
 void ledmatrix_shift_display_right(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x01);
+	ledpanels_shift(0, LEDPANELS_SHIFT_RIGHT);
 }
 
 void ledmatrix_shift_display_up(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x08);
+	ledpanels_shift(0, LEDPANELS_SHIFT_UP);
 }
 
 void ledmatrix_shift_display_down(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x04);
+	ledpanels_shift(0, LEDPANELS_SHIFT_DOWN);
 }
 
 void ledmatrix_clear(void) {
-	(void)spi_send_byte(CMD_CLEAR_SCREEN);
+	ledpanels_clear(0);
+}
+
+// Send a change now unless changes are being deferred
+static void updated(void) {
+	if(!deferred) {
+		(void)ledpanels_flush(0);
+	}
 }
 
 void copy_matrix_column(MatrixColumn from, MatrixColumn to) {
@@ -26,6 +26,12 @@ typedef PixelColour MatrixColumn[MATRIX_NUM_ROWS];
 // below are used.
 void ledmatrix_setup(void);
 
+// While defer is 1 the functions below only draw into the framebuffer (see
+// ledpanels.h) - the changes are sent by the next ledpanels_flush(), so a
+// frame's worth of drawing can be sent at once and its cost capped. While
+// it is 0 (the default) each change is sent straight away.
+void ledmatrix_defer_updates(uint8_t defer);
+
 // Functions to update the display
 // For those functions which take an x or a y value, the value must be valid
 // or the request will be ignored. (i.e. x must be < MATRIX_NUM_COLUMNS
@@ -0,0 +1,244 @@
+/*
+ * ledpanels.c
+ *
+ * Multi-panel LED matrix display - see ledpanels.h. See the LED matrix
+ * Reference for details of the SPI commands used.
+ */
+
+#include <stddef.h>
+
+#include "ledpanels.h"
+
+#define CMD_UPDATE_PIXEL 0x01
+#define CMD_UPDATE_ROW 0x02
+#define CMD_SHIFT_DISPLAY 0x04
+#define CMD_CLEAR_SCREEN 0x0F
+
+// A row with more changed pixels than this is sent as a row command
+// (18 bytes) rather than pixel commands (3 bytes each)
+#define MAX_PIXEL_COMMANDS 5
+
+static PixelColour frame[MATRIX_NUM_ROWS][LEDPANELS_NUM_COLUMNS];
+// For each panel and row, the columns (bit N for column N of the panel)
+// which have changed since they were last sent
+static uint16_t changed[LEDPANELS][MATRIX_NUM_ROWS];
+// Rows waiting to be sent, in total
+static uint8_t rows_waiting;
+// The panel the next flush starts with
+static uint8_t next_panel;
+static PixelFilter filter;
+
+static void mark(uint8_t panel, uint8_t y, uint16_t columns);
+static void forget(uint8_t panel);
+static uint8_t send_row(uint8_t panel);
+static void send_command(uint8_t panel, uint8_t command);
+
+void ledpanels_init(void) {
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		for(uint8_t x = 0; x < LEDPANELS_NUM_COLUMNS; x++) {
+			frame[y][x] = COLOUR_BLACK;
+		}
+	}
+	for(uint8_t panel = 0; panel < LEDPANELS; panel++) {
+		for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+			changed[panel][y] = 0;
+		}
+		send_command(panel, CMD_CLEAR_SCREEN);
+	}
+	hal_spi_select(0);
+	rows_waiting = 0;
+	next_panel = 0;
+	filter = NULL;
+}
+
+void ledpanels_set_pixel(uint8_t x, uint8_t y, PixelColour colour) {
+	if(x >= LEDPANELS_NUM_COLUMNS || y >= MATRIX_NUM_ROWS || frame[y][x] == colour) {
+		return;
+	}
+	frame[y][x] = colour;
+	mark(x / MATRIX_NUM_COLUMNS, y, 1U << (x % MATRIX_NUM_COLUMNS));
+}
+
+PixelColour ledpanels_get_pixel(uint8_t x, uint8_t y) {
+	if(x >= LEDPANELS_NUM_COLUMNS || y >= MATRIX_NUM_ROWS) {
+		return COLOUR_BLACK;
+	}
+	return frame[y][x];
+}
+
+void ledpanels_fill(PixelColour colour) {
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		for(uint8_t x = 0; x < LEDPANELS_NUM_COLUMNS; x++) {
+			ledpanels_set_pixel(x, y, colour);
+		}
+	}
+}
+
+void ledpanels_clear(uint8_t panel) {
+	PixelColour* row;
+	if(panel >= LEDPANELS) {
+		return;
+	}
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		row = &frame[y][panel * MATRIX_NUM_COLUMNS];
+		for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+			row[x] = COLOUR_BLACK;
+		}
+	}
+	forget(panel);
+	if(filter) {
+		for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+			mark(panel, y, 0xFFFF);
+		}
+	} else {
+		send_command(panel, CMD_CLEAR_SCREEN);
+		hal_spi_select(0);
+	}
+}
+
+void ledpanels_shift(uint8_t panel, uint8_t direction) {
+	PixelColour* row;
+	if(panel >= LEDPANELS) {
+		return;
+	}
+	if(!filter) {
+		// The panel has to show the framebuffer before it is shifted
+		ledpanels_flush(0);
+	}
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		row = &frame[y][panel * MATRIX_NUM_COLUMNS];
+		if(direction & LEDPANELS_SHIFT_LEFT) {
+			for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS - 1; x++) {
+				row[x] = row[x + 1];
+			}
+			row[MATRIX_NUM_COLUMNS - 1] = COLOUR_BLACK;
+		} else if(direction & LEDPANELS_SHIFT_RIGHT) {
+			for(uint8_t x = MATRIX_NUM_COLUMNS - 1; x > 0; x--) {
+				row[x] = row[x - 1];
+			}
+			row[0] = COLOUR_BLACK;
+		}
+	}
+	if(direction & LEDPANELS_SHIFT_UP) {
+		for(uint8_t y = MATRIX_NUM_ROWS - 1; y > 0; y--) {
+			for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+				frame[y][panel * MATRIX_NUM_COLUMNS + x] = frame[y - 1][panel * MATRIX_NUM_COLUMNS + x];
+			}
+		}
+		for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+			frame[0][panel * MATRIX_NUM_COLUMNS + x] = COLOUR_BLACK;
+		}
+	} else if(direction & LEDPANELS_SHIFT_DOWN) {
+		for(uint8_t y = 0; y < MATRIX_NUM_ROWS - 1; y++) {
+			for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+				frame[y][panel * MATRIX_NUM_COLUMNS + x] = frame[y + 1][panel * MATRIX_NUM_COLUMNS + x];
+			}
+		}
+		for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+			frame[MATRIX_NUM_ROWS - 1][panel * MATRIX_NUM_COLUMNS + x] = COLOUR_BLACK;
+		}
+	}
+	if(filter) {
+		for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+			mark(panel, y, 0xFFFF);
+		}
+	} else {
+		send_command(panel, CMD_SHIFT_DISPLAY);
+		(void)hal_spi_send_byte(direction);
+		hal_spi_select(0);
+	}
+}
+
+void ledpanels_touch(uint8_t x, uint8_t y) {
+	if(x < LEDPANELS_NUM_COLUMNS && y < MATRIX_NUM_ROWS) {
+		mark(x / MATRIX_NUM_COLUMNS, y, 1U << (x % MATRIX_NUM_COLUMNS));
+	}
+}
+
+void ledpanels_touch_all(void) {
+	for(uint8_t panel = 0; panel < LEDPANELS; panel++) {
+		for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+			mark(panel, y, 0xFFFF);
+		}
+	}
+}
+
+void ledpanels_set_filter(PixelFilter new_filter) {
+	filter = new_filter;
+}
+
+uint8_t ledpanels_flush(uint8_t max_rows) {
+	uint8_t sent = 0;
+	while(rows_waiting && (max_rows == 0 || sent < max_rows)) {
+		// The next panel with something to send (there must be one)
+		while(!send_row(next_panel)) {
+			next_panel = (next_panel + 1) % LEDPANELS;
+		}
+		next_panel = (next_panel + 1) % LEDPANELS;
+		rows_waiting--;
+		sent++;
+	}
+	hal_spi_select(0);
+	return rows_waiting;
+}
+
+// Add columns to those waiting to be sent in a row of a panel
+static void mark(uint8_t panel, uint8_t y, uint16_t columns) {
+	if(changed[panel][y] == 0) {
+		rows_waiting++;
+	}
+	changed[panel][y] |= columns;
+}
+
+// Drop the changes waiting for a panel
+static void forget(uint8_t panel) {
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		if(changed[panel][y]) {
+			changed[panel][y] = 0;
+			rows_waiting--;
+		}
+	}
+}
+
+// Send the lowest changed row of the given panel. Returns 0 if it had none.
+static uint8_t send_row(uint8_t panel) {
+	uint8_t count = 0;
+	uint8_t base = panel * MATRIX_NUM_COLUMNS;
+	uint16_t columns;
+	PixelColour* row;
+
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		columns = changed[panel][y];
+		if(columns == 0) {
+			continue;
+		}
+		changed[panel][y] = 0;
+		row = &frame[y][base];
+		for(uint16_t bits = columns; bits; bits &= bits - 1) {
+			count++;
+		}
+		if(count > MAX_PIXEL_COMMANDS) {
+			send_command(panel, CMD_UPDATE_ROW);
+			(void)hal_spi_send_byte(y);
+			for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+				(void)hal_spi_send_byte(filter ? filter(base + x, y, row[x]) : row[x]);
+			}
+		} else {
+			for(uint8_t x = 0; columns; x++, columns >>= 1) {
+				if(columns & 1) {
+					send_command(panel, CMD_UPDATE_PIXEL);
+					(void)hal_spi_send_byte((y << 4) | x);
+					(void)hal_spi_send_byte(filter ? filter(base + x, y, row[x]) : row[x]);
+				}
+			}
+		}
+		return 1;
+	}
+	return 0;
+}
+
+// Select a panel and send it a command byte
+static void send_command(uint8_t panel, uint8_t command) {
+	hal_spi_select(panel);
+	(void)hal_spi_send_byte(command);
+}
@@ -0,0 +1,80 @@
+/*
+ * ledpanels.h
+ *
+ * A display made of LEDPANELS LED matrix panels side by side (set at
+ * build time, e.g. -DLEDPANELS=2 - the default is the one panel), each on
+ * its own SPI slave select line (see hal_spi_select() in hal.h). Panel 0
+ * is on the left. The display is LEDPANELS_NUM_COLUMNS wide and is drawn
+ * into a framebuffer in RAM, then sent with ledpanels_flush().
+ *
+ * Only what has changed is sent. For each row of each panel the columns
+ * which have changed since the last flush are tracked - a row with a few
+ * changes is sent as pixel commands (3 bytes each), otherwise as a row
+ * command (18 bytes). Setting a pixel to the colour it already has costs
+ * nothing. A flush takes the panels in turn, a row of one then a row of
+ * the next, and can be limited to a number of rows per call - so a frame
+ * on a wide display costs no more SPI time than the rows which changed,
+ * and that cost can be spread over several frames without one panel
+ * waiting for all the others.
+ *
+ * A filter can be set which changes each pixel on its way to the panels
+ * (this is how effects.c draws over the game). The framebuffer keeps what
+ * was drawn - whoever changes what the filter does marks the pixels it
+ * affects with ledpanels_touch() so they are sent again.
+ *
+ * This is the only module which talks to the panels - the ledmatrix.c
+ * functions draw into the part of the framebuffer on panel 0.
+ *
+ * RAM: 128 bytes (the framebuffer) plus 16 bytes per panel.
+ */
+
+#ifndef LEDPANELS_H_
+#define LEDPANELS_H_
+
+#include <stdint.h>
+#include "ledmatrix.h"
+#include "hal.h"
+
+#define LEDPANELS_NUM_COLUMNS (MATRIX_NUM_COLUMNS * LEDPANELS)
+
+// Directions for ledpanels_shift()
+#define LEDPANELS_SHIFT_RIGHT 0x01
+#define LEDPANELS_SHIFT_LEFT 0x02
+#define LEDPANELS_SHIFT_DOWN 0x04
+#define LEDPANELS_SHIFT_UP 0x08
+
+// Returns the colour to send for the pixel at (x, y) which is drawn in the
+// given colour
+typedef PixelColour (*PixelFilter)(uint8_t x, uint8_t y, PixelColour colour);
+
+// Clear the framebuffer and the panels
+void ledpanels_init(void);
+
+// Draw into the framebuffer. Positions off the display are ignored.
+void ledpanels_set_pixel(uint8_t x, uint8_t y, PixelColour colour);
+PixelColour ledpanels_get_pixel(uint8_t x, uint8_t y);
+void ledpanels_fill(PixelColour colour);
+
+// Clear one panel's part of the framebuffer - with the panel's clear
+// command (one byte) rather than a row at a time if there is no filter
+void ledpanels_clear(uint8_t panel);
+
+// Move the contents of one panel one place in the given direction - the
+// row or column which comes in is black. Any changes waiting are sent
+// first, then the panel's shift command (two bytes). With a filter set
+// the panel is sent again instead, as the filter may depend on position.
+void ledpanels_shift(uint8_t panel, uint8_t direction);
+
+// Mark a pixel (or all of them) to be sent again although it hasn't
+// changed in the framebuffer
+void ledpanels_touch(uint8_t x, uint8_t y);
+void ledpanels_touch_all(void);
+
+// Set the filter (NULL for none)
+void ledpanels_set_filter(PixelFilter new_filter);
+
+// Send the rows which have changed to the panels - at most max_rows of
+// them (0 for no limit). Returns the number of rows still waiting.
+uint8_t ledpanels_flush(uint8_t max_rows);
+
+#endif /* LEDPANELS_H_ */
@@ -0,0 +1,180 @@
+/*
+ * profile.c
+ *
+ * Main loop phase profiler - see profile.h.
+ */
+
+#ifdef PROFILE
+
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "profile.h"
+#include "serialio.h"
+#include "timer0.h"
+#include "hal.h"
+
+#define CPU_CLOCK 8000000UL
+#define PHASE_NAME_LENGTH 8
+
+#define PHASE_STARTED 0x01
+#define LOOP_STARTED 0x02
+
+typedef struct {
+	uint32_t count;
+	uint32_t total;
+	uint16_t min;
+	uint16_t max;
+} PhaseTimes;
+
+typedef struct {
+	uint32_t count;
+	uint32_t total;
+	uint16_t max;
+} IsrTimes;
+
+static PhaseTimes times[NUM_PHASES];
+static uint16_t phase_start;
+static uint16_t loop_start;
+static uint8_t started;
+
+// Written by the interrupt handlers
+static volatile IsrTimes isr_times[NUM_ISRS];
+static uint32_t start_time;	// monotonic clock (ms) when the results were cleared
+
+static const char phase_names[NUM_PHASES][PHASE_NAME_LENGTH] PROGMEM = {
+	"input", "adc", "move", "lane0", "lane1", "lane2", "log0", "log1",
+	"output", "loop"
+};
+
+static const char isr_names[NUM_ISRS][PHASE_NAME_LENGTH] PROGMEM = {
+	"timer0", "buttons", "uart_tx", "uart_rx", "eeprom", "telem"
+};
+
+static void record(uint8_t phase, uint16_t cycles);
+
+void init_profile(void) {
+	hal_cycles_init();
+	for(uint8_t i = 0; i < NUM_PHASES; i++) {
+		times[i].count = 0;
+		times[i].total = 0;
+		times[i].min = 0xFFFF;
+		times[i].max = 0;
+	}
+	started = 0;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		for(uint8_t i = 0; i < NUM_ISRS; i++) {
+			isr_times[i].count = 0;
+			isr_times[i].total = 0;
+			isr_times[i].max = 0;
+		}
+	}
+	start_time = get_monotonic_time();
+}
+
+void profile_begin(void) {
+	phase_start = hal_cycles();
+	started |= PHASE_STARTED;
+}
+
+void profile_end(uint8_t phase) {
+	// Read the counter first so the bookkeeping isn't counted
+	uint16_t cycles = hal_cycles() - phase_start;
+	if(started & PHASE_STARTED) {
+		record(phase, cycles);
+		started &= ~PHASE_STARTED;
+	}
+}
+
+void profile_loop(void) {
+	uint16_t now = hal_cycles();
+	if(started & LOOP_STARTED) {
+		record(PHASE_LOOP, now - loop_start);
+	}
+	loop_start = now;
+	started |= LOOP_STARTED;
+}
+
+void profile_loop_end(void) {
+	uint16_t now = hal_cycles();
+	if(started & LOOP_STARTED) {
+		record(PHASE_LOOP, now - loop_start);
+	}
+	started &= ~LOOP_STARTED;
+}
+
+void profile_skip(void) {
+	started = 0;
+}
+
+void profile_isr(uint8_t isr, uint16_t cycles) {
+	volatile IsrTimes* t = &isr_times[isr];
+	t->count++;
+	t->total += cycles;
+	if(cycles > t->max) {
+		t->max = cycles;
+	}
+}
+
+void profile_dump(void) {
+	IsrTimes isrs[NUM_ISRS];
+	uint32_t elapsed;
+
+	// Take a copy of the ISR times first - sending the dump uses the UART
+	// interrupt
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		for(uint8_t i = 0; i < NUM_ISRS; i++) {
+			isrs[i] = *(IsrTimes*)&isr_times[i];
+		}
+	}
+	elapsed = get_monotonic_time() - start_time;
+
+	serial_put_string_P(PSTR("\nPROFILE "));
+	serial_put_uint32(CPU_CLOCK);
+	serial_put_char('\n');
+	for(uint8_t i = 0; i < NUM_PHASES; i++) {
+		serial_put_string_P(phase_names[i]);
+		serial_put_char(' ');
+		serial_put_uint32(times[i].count);
+		serial_put_char(' ');
+		serial_put_uint16(times[i].count ? times[i].min : 0);
+		serial_put_char(' ');
+		serial_put_uint16(times[i].max);
+		serial_put_char(' ');
+		serial_put_uint32(times[i].total);
+		serial_put_char('\n');
+	}
+
+	serial_put_string_P(PSTR("ISR "));
+	serial_put_uint32(elapsed);
+	serial_put_char('\n');
+	for(uint8_t i = 0; i < NUM_ISRS; i++) {
+		serial_put_string_P(isr_names[i]);
+		serial_put_char(' ');
+		serial_put_uint32(isrs[i].count);
+		serial_put_char(' ');
+		serial_put_uint16(isrs[i].max);
+		serial_put_char(' ');
+		serial_put_uint32(isrs[i].total);
+		serial_put_char('\n');
+	}
+	serial_put_string_P(PSTR("END\n"));
+
+	// Start again. Sending the dump will have taken a while, so the phase
+	// and iteration in progress aren't counted.
+	init_profile();
+}
+
+static void record(uint8_t phase, uint16_t cycles) {
+	PhaseTimes* t = &times[phase];
+	t->count++;
+	t->total += cycles;
+	if(cycles < t->min) {
+		t->min = cycles;
+	}
+	if(cycles > t->max) {
+		t->max = cycles;
+	}
+}
+
+#endif /* PROFILE */
@@ -0,0 +1,109 @@
+/*
+ * profile.h
+ *
+ * Main loop phase profiler. Built in only if PROFILE is defined (e.g.
+ * -DPROFILE) - otherwise the macros below compile to nothing.
+ *
+ * The phases of play_game() are timed with the cycle counter (timer 1,
+ * see hal.h) and the number of times each ran and its minimum, maximum
+ * and total time in cycles are kept. Phases don't nest, except that the
+ * whole loop iteration (PHASE_LOOP) is timed from the start of one
+ * iteration to the start of the next - or to the sleep at the end of it,
+ * as the loop sleeps when nothing is due. A phase which takes longer than the
+ * cycle counter's 8.192ms wrap is recorded wrongly - the iterations in
+ * which the game is paused or the results are dumped are skipped for
+ * that reason.
+ *
+ * Each interrupt service routine (in hal_avr.c) is timed the same way -
+ * the number of times it ran, its worst case and its total. This is the
+ * time from its first statement to its last: the vector jump and the
+ * register saves and restores the compiler adds around it (several tens
+ * of cycles for an ISR which calls a function) aren't included. ISR time
+ * is also included in the time of whichever phase it interrupted.
+ *
+ * profile_dump() sends the results to the serial terminal and starts
+ * again. The dump is one line per phase, then one line per ISR with the
+ * time (on the monotonic clock) the results cover, between a header and
+ * a footer:
+ *   PROFILE <cpu clock Hz>
+ *   <name> <count> <min> <max> <total>
+ *   ISR <milliseconds>
+ *   <name> <count> <max> <total>
+ *   END
+ * host/profile_trace.c turns it into a flame graph or a Chrome trace and
+ * works out each ISR's share of the CPU.
+ *
+ * RAM: 12 bytes per phase (120 bytes), 10 per ISR (60 bytes) plus 9.
+ * The totals wrap after 2^32 cycles (about 9 minutes of loop iterations),
+ * so dump at least that often.
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+
+// Phases - the order is the order in which they are listed in a dump
+#define PHASE_INPUT 0	// button queue and serial input
+#define PHASE_ADC 1	// waiting for the joystick conversion
+#define PHASE_MOVE 2	// working out and making the player's move
+#define PHASE_LANE 3	// scrolling traffic lanes 0 to 2 (PHASE_LANE + lane)
+#define PHASE_LOG 6	// scrolling river channels 0 and 1 (PHASE_LOG + channel)
+#define PHASE_OUTPUT 8	// telemetry and the lives LEDs
+#define PHASE_LOOP 9	// a whole iteration of the play_game() loop
+#define NUM_PHASES 10
+
+// Interrupt service routines
+#define ISR_TIMER0 0	// TIMER0_COMPA - the millisecond tick
+#define ISR_BUTTONS 1	// PCINT1
+#define ISR_UART_TX 2	// USART0_UDRE
+#define ISR_UART_RX 3	// USART0_RX
+#define ISR_EEPROM 4	// EE_READY
+#define ISR_TELEMETRY 5	// USART1_UDRE (TELEMETRY_USART 1 only)
+#define NUM_ISRS 6
+
+#ifdef PROFILE
+
+void init_profile(void);
+
+// Mark the start of a phase, then the end of it
+void profile_begin(void);
+void profile_end(uint8_t phase);
+
+// Mark the start of a loop iteration (ends the previous one)
+void profile_loop(void);
+
+// End the iteration in progress without starting the next - before the
+// loop sleeps, so the next profile_loop() doesn't count the time asleep
+void profile_loop_end(void);
+
+// Forget the phase and iteration in progress (they would wrap)
+void profile_skip(void);
+
+// Record a run of an interrupt service routine (called from the ISR)
+void profile_isr(uint8_t isr, uint16_t cycles);
+
+// Send the results to the serial terminal and clear them
+void profile_dump(void);
+
+#define PROFILE_INIT() init_profile()
+#define PROFILE_BEGIN() profile_begin()
+#define PROFILE_END(phase) profile_end(phase)
+#define PROFILE_LOOP() profile_loop()
+#define PROFILE_LOOP_END() profile_loop_end()
+#define PROFILE_SKIP() profile_skip()
+#define PROFILE_DUMP() profile_dump()
+
+#else
+
+#define PROFILE_INIT()
+#define PROFILE_BEGIN()
+#define PROFILE_END(phase)
+#define PROFILE_LOOP()
+#define PROFILE_LOOP_END()
+#define PROFILE_SKIP()
+#define PROFILE_DUMP()
+
+#endif /* PROFILE */
+
+#endif /* PROFILE_H_ */
@@ -6,22 +6,32 @@
 * Author: Peter Sutton. Modified by Chanon Kachornvuthidej 44456553
 */
 
-#include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
-#include <stdio.h>
 
-#define F_CPU 8000000L
-#include <util/delay.h>
 
 #include "ledmatrix.h"
+#include "ledpanels.h"
+#include "effects.h"
+#include "idle.h"
 #include "scrolling_char_display.h"
 #include "buttons.h"
 #include "serialio.h"
 #include "terminalio.h"
 #include "score.h"
 #include "timer0.h"
+#include "seven_seg.h"
 #include "game.h"
+#include "step.h"
+#include "telemetry.h"
+#include "frame.h"
+#include "savestate.h"
+#include "rewind.h"
+#include "replay.h"
+#include "autopilot.h"
+#include "profile.h"
+#include "ram.h"
+#include "hal.h"
 
 // Function prototypes - these are defined below (after main()) in the order
 // given here
@@ -31,16 +41,42 @@ void new_game(void);
 void play_game(void);
 void handle_game_over(void);
 void handle_next_level(void);
+static uint8_t start_pushed(void);
+static uint8_t attract_mode(void);
+static uint8_t check_frog(void);
+static uint8_t make_move(uint8_t frog, uint8_t move);
+static uint8_t game_moved_on(void);
+static uint8_t serial_move(char serial_input, char escape_sequence_char);
+static void enter_high_score(uint8_t player);
+#ifdef BENCH
+void run_benchmarks(void);	// bench/bench.c
+#endif
 
-//Speed timer. Higher means slower.
-volatile int speed0 = 1300;
-volatile int speed1 = 1250;
-volatile int speed2 = 1200;
-volatile int speed3 = 1150;
-volatile int speed4 = 1100;
-
-// ASCII code for Escape character
-#define ESCAPE_CHAR 27
+// The most LED matrix rows sent each time round the game loop - the rest
+// wait for the next time
+#define FRAME_ROWS 4
+// Effects (ms)
+#define NEW_GAME_FADE_TIME 600
+#define NEXT_LEVEL_WIPE_TIME 800
+// The most ms the game loop sleeps for when nothing is due - the joystick
+// has no interrupt so it is read at least this often
+#define JOYSTICK_PERIOD 10
+// The score has changed since it was last sent to the terminal
+static uint8_t score_changed;
+// A snapshot of the game is saved (see savestate.h) when something has
+// happened which would be a shame to lose - a frog losing a life or
+// filling a riverbank hole, a new level or a pause - at the next safe
+// point. Wear budget: that is about one save every 10 s of play (a
+// crossing takes about 11 s), so over SAVESTATE_SLOTS slots a slot is
+// written about 120 times an hour - the 100,000 writes an EEPROM cell is
+// good for last over 800 hours of play. (Saving every 2 s wore each slot
+// out in under 60 hours.)
+static uint8_t save_due;
+// Lives lost and riverbank at the last save
+static uint8_t saved_lives;
+static uint16_t saved_riverbank;
+// Carrying on from a snapshot at power up
+static uint8_t resuming;
 
 volatile uint8_t x_or_y = 0;	/* 0 = x, 1 = y */
 volatile uint32_t xcoord = 530;
@@ -48,15 +84,36 @@ volatile uint32_t ycoord = 530;
 
 /////////////////////////////// main //////////////////////////////////
 int main(void) {
+	uint8_t level;
 
 	// Setup hardware and call backs. This will turn on
 	// interrupts.
 	initialise_hardware();
+	reset_levels();
+	reset_speeds();
+#ifdef BENCH
+	// Cycle count benchmarks (bench/bench.c) - then carry on as normal
+	run_benchmarks();
+#endif
 	
-	// Show the splash screen message. Returns when display
-	// is complete
-	splash_screen();
-	
+	level = savestate_load();
+	if(level) {
+		// Carry on with the game that was going when the power went (it
+		// isn't recorded - the recording would start part way through)
+		set_level(level - 1);
+		for(uint8_t i = 1; i < level; i++) {
+			speed_up();
+		}
+		resuming = 1;
+	} else {
+		// Show the splash screen message. Returns when display
+		// is complete
+		splash_screen();
+		
+		// Record the first game (handle_game_over() starts the next
+		// recording or a playback)
+		replay_start_recording(get_number_of_frogs());
+	}
 	while(1) {
 		new_game();
 		play_game();
@@ -70,15 +127,8 @@ int main(void) {
 
 void initialise_hardware(void) {
 	
-	// Set up ADC - AVCC reference, right adjust
-	// Input selection doesn't matter yet - we'll swap this around in the while
-	// loop below.
-	ADMUX = (1<<REFS0);
-	// Turn on the ADC (but don't start a conversion yet). Choose a clock
-	// divider of 64. (The ADC clock must be somewhere
-	// between 50kHz and 200kHz. We will divide our 8MHz clock by 64
-	// to give us 125kHz.)
-	ADCSRA = (1<<ADEN)|(1<<ADPS2)|(1<<ADPS1);
+	// Set up ADC (for the joystick)
+	hal_adc_init();
 
 
 	ledmatrix_setup();
@@ -86,14 +136,17 @@ void initialise_hardware(void) {
 	// Setup serial port for 19200 baud communication with no echo
 	// of incoming characters
 	init_serial_stdio(19200,0);
+	init_telemetry(19200);
+	
+	// Read the high score table from EEPROM
+	load_game();
 	
 	init_timer0();
+	init_seven_seg();
+	PROFILE_INIT();
 	
 	//FOR LED LIVES
-	DDRA |= 0b11111000;
-	
-	//For buzzer
-	DDRD |= (0<<3);
+	hal_leds_init();
 	
 	// Turn on global interrupts
 	sei();
@@ -103,27 +156,104 @@ void splash_screen(void) {
 	// Clear terminal screen and output a message
 	clear_terminal();
 	move_cursor(10,10);
-	printf_P(PSTR("Frogger"));
+	serial_put_string_P(PSTR("Frogger"));
 	move_cursor(10,12);
-	printf_P(PSTR("CSSE2010/7201 project by Chanon Kachornvuthidej - 44456553"));
+	serial_put_string_P(PSTR("CSSE2010/7201 project by Chanon Kachornvuthidej - 44456553"));
 	init_score(); //Demonstration purposes
 	show_high();
 	
 	
+	move_cursor(10,14);
+	serial_put_string_P(PSTR("Press a button or 1 for one player, 2 for two players"));
+	
 	// Output the scrolling message to the LED matrix
-	// and wait for a push button to be pushed.
+	// and wait for a push button to be pushed (or the number of players
+	// to be chosen on the terminal).
 	ledmatrix_clear();
+	set_scrolling_display_rows(0, MATRIX_NUM_ROWS);
 	while(1) {
-		set_scrolling_display_text("FROGGER 44456553", COLOUR_GREEN);
+		set_scrolling_display_text_P(PSTR("FROGGER 44456553"), COLOUR_GREEN);
 		// Scroll the message until it has scrolled off the
 		// display or a button is pushed
 		while(scroll_display()) {
-			_delay_ms(150);
-			if(button_pushed() != NO_BUTTON_PUSHED) {
+			if(start_pushed()) {
 				return;
 			}
+			idle_sleep();
+		}
+		// Then the game plays itself for a while
+		if(attract_mode()) {
+			return;
+		}
+	}
+}
+
+// Check for a button push (one player) or 1 or 2 typed on the terminal
+// at the splash screen. Returns 1 (with the number of players set) if so.
+static uint8_t start_pushed(void) {
+	if(button_pushed() != NO_BUTTON_PUSHED) {
+		set_number_of_frogs(1);
+		return 1;
+	}
+	if(serial_input_available()) {
+		char serial_input = serial_get_char();
+		if(serial_input == '1' || serial_input == '2') {
+			set_number_of_frogs(serial_input - '0');
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Let the game play itself (see autopilot.h) on level 1 until its frog is
+// out of lives or the riverbank is full, or a game is started. The game is
+// stepped as in play_game() and the autopilot only plans once it is up to
+// date. The countdown runs as in a game but the game is quiet (see
+// set_game_quiet() in game.h) so the splash screen stays as it is on the
+// terminal. Nothing is recorded or saved, and the lives and score are put
+// back afterwards. Returns 1 if a game was started (see start_pushed()).
+static uint8_t attract_mode(void) {
+	uint32_t current_time, tick;
+	uint8_t move, playing = 1, start = 0;
+
+	set_number_of_frogs(1);
+	initialise_game();
+	set_game_quiet(1);
+	ledmatrix_defer_updates(1);
+	game_count();
+	tick = get_current_time();
+	set_game_tick(tick);
+	reset_count_at(tick);
+	start_scrolling(tick);
+	autopilot_start(tick);
+	while(playing && !start) {
+		current_time = get_current_time();
+		while(playing && tick != current_time) {
+			tick++;
+			playing = advance_game(tick);
+		}
+		if(playing) {
+			move = autopilot_step(tick, get_scroll_times(), get_scroll_periods(),
+					get_scroll_directions());
+			if(move != MOVE_NONE) {
+				playing = make_move(0, move);
+			}
 		}
+		effects_step(get_monotonic_time());
+		(void)ledpanels_flush(FRAME_ROWS);
+		start = start_pushed();
+		// The autopilot plans a little every tick
+		idle_until(tick + 1);
 	}
+	ledmatrix_defer_updates(0);
+	set_game_quiet(0);
+	effects_stop();
+	reset_levels();
+	init_score();
+	score_changed = 0;
+	ledmatrix_clear();
+	stop_count();
+	return start;
 }
 
 void new_game(void) {
@@ -137,13 +267,20 @@ void new_game(void) {
 	// Initialise the score
 	init_score();
 	move_cursor(60,12);
-	printf_P(PSTR("Your score is: "));
+	serial_put_string_P(PSTR("Your score is: "));
+	if(get_number_of_frogs() == 2) {
+		move_cursor(60,14);
+		serial_put_string_P(PSTR("Player 2 score: "));
+	}
 	show_score();
 	move_cursor(60,13);
-	printf_P(PSTR("This is level: "));
+	serial_put_string_P(PSTR("This is level: "));
 	show_level();
-	unpause();
+	unpause_clock();
 	game_count();
+	if(!effects_running()) {
+		effects_fade(1, NEW_GAME_FADE_TIME);
+	}
 	
 	
 	// Clear a button push or serial input if any are waiting
@@ -153,45 +290,90 @@ void new_game(void) {
 }
 
 void play_game(void) {
-	uint32_t current_time, last_move_time, last_move_time1, last_move_time2, last_move_time2_0, last_move_time2_1,
-	last_move_frog;
+	uint32_t current_time, tick, last_move_frog;
+	uint16_t joystick;
+	uint32_t deadline;
+	uint8_t move, frog, playing = 1, rows_waiting, late;
 	int8_t button;
 	char serial_input, escape_sequence_char;
 	uint8_t characters_into_escape_sequence = 0;
+#ifdef CHECK_INVARIANTS
+	uint8_t broken;
+#endif
 
-	
-	// Get the current time and remember this as the last time the vehicles
-	// and logs were moved.
+	// The game is stepped on one millisecond tick at a time from here. The
+	// countdown starts now and each lane and log scrolls every so many ms
+	// from now (see step.h), so how the game goes depends only on which moves are made
+	// on which ticks - which is what lets a recording be played back.
 	current_time = get_current_time();
-	last_move_time = current_time;
-	last_move_time1 = current_time;
-	last_move_time2 = current_time;
-	last_move_time2_0 = current_time;
-	last_move_time2_1 = current_time;
+	tick = current_time;
+	set_game_tick(tick);
+	reset_count_at(tick);
+	start_scrolling(tick);
+	if(resuming) {
+		savestate_restore(tick, get_scroll_times());
+		resuming = 0;
+	}
+	// A new level (or the game carried on) - save it
+	(void)game_moved_on();
+	save_due = 1;
+	rewind_start();
+	replay_new_level(tick);
 
 	last_move_frog = current_time;
+	// Drawing is sent a frame at a time from here
+	ledmatrix_defer_updates(1);
+	// Don't time the gap since the end of the last game or level
+	PROFILE_SKIP();
 	
 	// We play the game while the frog is alive and we haven't filled up the
 	// far riverbank
-	while(!is_frog_dead() && !is_riverbank_full()) {
-		show_count();
-		if(x_or_y == 0) { //For joystick
-			ADMUX = 0b01000001;
-			} else {
-			ADMUX = 0b01000010;
+	while(playing) {
+		PROFILE_LOOP();
+		frame_begin(tick);
+
+		// Bring the game up to the current time. Moves being played back
+		// are made on the tick they were recorded on.
+		current_time = get_current_time();
+		while(playing && tick != current_time) {
+			tick++;
+			playing = advance_game(tick);
+			while(playing && (move = replay_next_move(tick, &frog)) != MOVE_NONE) {
+				playing = make_move(frog, move);
+			}
 		}
-		// Start the ADC conversion
-		ADCSRA |= (1<<ADSC);
-		
-		while(ADCSRA & (1<<ADSC)) {
-			; /* Wait until conversion finished */
+		if(!playing) {
+			break;
 		}
+#ifdef CHECK_INVARIANTS
+		// Build with -DCHECK_INVARIANTS to end the game as soon as it gets
+		// into a state it shouldn't be in (see game_check_invariants())
+		if((broken = game_check_invariants()) != 0) {
+			serial_put_string_P(PSTR("\nInvariants broken "));
+			serial_put_uint16(broken);
+			serial_put_string_P(PSTR(" at tick "));
+			serial_put_uint32(tick);
+			serial_put_char('\n');
+			break;
+		}
+#endif
 
-		if(!is_frog_dead() && frog_has_reached_riverbank()) {
-			// Frog reached the other side successfully but the
-			// riverbank isn't full, put a new frog at the start
-			put_frog_in_start_position();
+		// Save a snapshot of the game once something has happened (not
+		// of one being played back). Until the frog that died comes back
+		// the game isn't at a safe point, and the EEPROM may still be busy
+		// with the last one, so it waits until both are ready.
+		if(game_moved_on()) {
+			save_due = 1;
 		}
+		if(save_due && !replay_is_playing() && savestate_capture(tick, get_scroll_times())) {
+			save_due = 0;
+		}
+		rewind_record(tick, get_scroll_times(), get_scroll_periods());
+
+		//For joystick - x is ADC channel 1, y is channel 2
+		PROFILE_BEGIN();
+		joystick = hal_adc_read(x_or_y == 0 ? 1 : 2);
+		PROFILE_END(PHASE_ADC);
 		
 		// Check for input - which could be a button push or serial input.
 		// Serial input may be part of an escape sequence, e.g. ESC [ D
@@ -201,6 +383,7 @@ void play_game(void) {
 		// if no button pushes are waiting to be returned.)
 		// Button pushes take priority over serial input. If there are both then
 		// we'll retrieve the serial input the next time through this loop
+		PROFILE_BEGIN();
 		serial_input = -1;
 		escape_sequence_char = -1;
 
@@ -210,209 +393,391 @@ void play_game(void) {
 			// No push button was pushed, see if there is any serial input
 			if(serial_input_available()) {
 				// Serial data was available - read the data from standard input
-				serial_input = fgetc(stdin);
-				// Check if the character is part of an escape sequence
-				if(characters_into_escape_sequence == 0 && serial_input == ESCAPE_CHAR) {
-					// We've hit the first character in an escape sequence (escape)
-					characters_into_escape_sequence++;
-					serial_input = -1; // Don't further process this character
-					} else if(characters_into_escape_sequence == 1 && serial_input == '[') {
-					// We've hit the second character in an escape sequence
-					characters_into_escape_sequence++;
-					serial_input = -1; // Don't further process this character
-					} else if(characters_into_escape_sequence == 2) {
-					// Third (and last) character in the escape sequence
-					escape_sequence_char = serial_input;
-					serial_input = -1;  // Don't further process this character - we
-					// deal with it as part of the escape sequence
-					characters_into_escape_sequence = 0;
-					} else {
-					// Character was not part of an escape sequence (or we received
-					// an invalid second character in the sequence). We'll process
-					// the data in the serial_input variable.
-					characters_into_escape_sequence = 0;
-				}
+				// (-1 if it is part of an escape sequence)
+				serial_input = read_escape_sequence(&characters_into_escape_sequence,
+						serial_get_char(), &escape_sequence_char);
 			}
 		}
+		if(serial_input != -1 || escape_sequence_char != -1) {
+			frame_note(FRAME_SERIAL);
+		}
+		PROFILE_END(PHASE_INPUT);
 
+		PROFILE_BEGIN();
 		if(current_time >= last_move_frog + 500){ //read joystick.
 			if(x_or_y == 0) {
-				xcoord = ADC;
+				xcoord = joystick;
 				} else {
-				ycoord = ADC;
+				ycoord = joystick;
 			}
 		}
 		// Next time through the loop, do the other direction
 		x_or_y ^= 1;
 		
-		// Process the input.
-		if(button==3 || escape_sequence_char=='D' || serial_input=='L' || serial_input=='l'|| ((xcoord < 300 && xcoord > 0) &&
+		// Process the input. With two players the terminal's movement keys
+		// are player 2's - player 1 has the buttons and the joystick.
+		move = MOVE_NONE;
+		frog = 0;
+		if(get_number_of_frogs() == 2) {
+			move = serial_move(serial_input, escape_sequence_char);
+			if(move != MOVE_NONE) {
+				frog = 1;
+				serial_input = -1;
+			}
+			escape_sequence_char = -1;
+		}
+		if(frog == 1) {
+			// Player 2's move - made below
+		} else if(button==3 || escape_sequence_char=='D' || serial_input=='L' || serial_input=='l'|| ((xcoord < 300 && xcoord > 0) &&
 		(ycoord < 570 && ycoord > 470))) {
-			move_frog_to_left();
+			move = MOVE_LEFT;
 			xcoord = 0;
 			last_move_frog = current_time;
 			} else if(button==2 || escape_sequence_char=='A' || serial_input=='U' || serial_input=='u' || ycoord > 600) {
 			// Attempt to move forward
 			if((xcoord < 480 && xcoord > 0)){ //diagonal movement
-				move_left_up();
+				move = MOVE_LEFT_UP;
 				}else if (xcoord > 570){
-				move_right_up();
+				move = MOVE_RIGHT_UP;
 				}else{
-				move_frog_forward();
+				move = MOVE_FORWARD;
 			}
-			show_score();
 			xcoord = 0;
 			ycoord = 0;
 			last_move_frog = current_time;
 			} else if(button==1 || escape_sequence_char=='B' || serial_input=='D' || serial_input=='d' || (ycoord < 400 && ycoord > 0)) {
 			// Attempt to move down
 			if((xcoord < 480 && xcoord > 0)){ //diagonal movement
-				move_left_down();
+				move = MOVE_LEFT_DOWN;
 				}else if(xcoord > 570){
-			move_right_down();}
+			move = MOVE_RIGHT_DOWN;}
 			else{
-				move_frog_backward();
+				move = MOVE_BACKWARD;
 			}
 			ycoord = 0;
 			xcoord = 0;
 			last_move_frog = current_time;
 			} else if(button==0 || escape_sequence_char=='C' || serial_input=='R' || serial_input=='r' || (xcoord > 800 && (ycoord < 570 && ycoord > 470))) {
-			move_frog_to_right();
+			move = MOVE_RIGHT;
 			xcoord = 0;
 			last_move_frog = current_time;
 		}
 		else if(serial_input == 'p' || serial_input == 'P') {
-			pause();
-			DDRD &= 0xBF;
+			(void)ledpanels_flush(0);
+			// The game may well be left paused - save it (it is written
+			// while paused, or if a frog is dying, once it carries on)
+			save_due = 1;
+			if(!replay_is_playing() && savestate_capture(tick, get_scroll_times())) {
+				save_due = 0;
+			}
+			pause_clock();
+			hal_buzzer_enable(0);
 			while(1){
-				show_count();
 				if(serial_input_available()){
-					serial_input = fgetc(stdin);
+					serial_input = serial_get_char();
 					if(serial_input == 'p' || serial_input == 'P'){
 						clear_push();
 						break;
 					}
 				}
+				idle_sleep();
 			}
-			unpause();
+			unpause_clock();
+			// The time paused would wrap the cycle counter
+			PROFILE_SKIP();
+			// and isn't frame time
+			frame_begin(tick);
 		}
-		// else - invalid input or we're part way through an escape sequence -
-		// do nothing
-		
-		current_time = get_current_time();
-
-		if(!is_frog_dead() && current_time >= last_move_time + speed0){ //Move row at different speed
-			scroll_vehicle_lane(0, 1);
-			last_move_time = current_time;
+		else if(serial_input == 't' || serial_input == 'T') {
+			toggle_telemetry();
 		}
-		if(!is_frog_dead() && current_time >= last_move_time1 + speed1) {
-			scroll_vehicle_lane(1, -1);
-			last_move_time1 = current_time;
+		else if((serial_input == 'b' || serial_input == 'B') && !replay_is_playing()) {
+			// Step back in time (see rewind.h). A game which has been
+			// rewound can't be played back, so it isn't recorded any more.
+			if(rewind_step(tick, get_scroll_times(), get_scroll_periods())) {
+				effects_stop();
+				replay_stop();
+			}
+		}
+		else if(serial_input == 'h' || serial_input == 'H') {
+			// Send the frogs' moves over the last few seconds
+			rewind_history(tick);
+		}
+		else if(serial_input == 'f' || serial_input == 'F') {
+			// Send the main loop profile (if built with PROFILE defined)
+			PROFILE_DUMP();
 		}
-		if(!is_frog_dead() && current_time >= last_move_time2 + speed2) {
-			scroll_vehicle_lane(2, 1);
-			last_move_time2 = current_time;
+		else if(serial_input == 'm' || serial_input == 'M') {
+			// Send the RAM use (the stack high water mark)
+			ram_report();
 		}
-		if(!is_frog_dead() && current_time >= last_move_time2_0 + speed3) {
-			scroll_river_channel(0, -1);
-			last_move_time2_0 = current_time;
+		else if(serial_input == 'c' || serial_input == 'C') {
+			// Send the CPU load, the frame overruns and the save state times
+			load_report();
+			frame_report();
+			savestate_report();
 		}
+		// else - invalid input or we're part way through an escape sequence -
+		// do nothing
 		
-		if(!is_frog_dead() && current_time >= last_move_time2_1 + speed4) {
-			scroll_river_channel(1, 1);
-			last_move_time2_1 = current_time;
+		// Moves are made on the current tick. While a recording is being
+		// played back the players' moves are ignored.
+		if(move != MOVE_NONE && !replay_is_playing()) {
+			replay_record_move(tick, frog, move);
+			playing = make_move(frog, move);
 		}
+		PROFILE_END(PHASE_MOVE);
+		
+		PROFILE_BEGIN();
+		effects_step(get_monotonic_time());
+		rows_waiting = ledpanels_flush(FRAME_ROWS);
 
-		//CODE for showing LED lives
-		switch(5 - get_time_died()){
-			case 1:
-			PORTA = 0x08;
-			break;
-			case 2:
-			PORTA = 0x18;
-			break;
-			case 3:
-			PORTA = 0x38;
-			break;
-			case 4:
-			PORTA = 0x78;
-			break;
-			case 5:
-			PORTA = 0xF8;
-			break;
+		// The game is up to date. The rest is only for show, so it waits
+		// for a frame with time to spare if this one is over budget.
+		late = frame_over_budget();
+		defer_count(late);
+		if(!late) {
+			if(score_changed) {
+				score_changed = 0;
+				show_score();
+				frame_note(FRAME_SCORE);
+			}
+			telemetry_tick(current_time);
+
+			//CODE for showing LED lives (player 1's)
+			switch(5 - get_time_died(0)){
+				case 1:
+				hal_leds_set(0x08);
+				break;
+				case 2:
+				hal_leds_set(0x18);
+				break;
+				case 3:
+				hal_leds_set(0x38);
+				break;
+				case 4:
+				hal_leds_set(0x78);
+				break;
+				case 5:
+				hal_leds_set(0xF8);
+				break;
+			}
 		}
+		PROFILE_END(PHASE_OUTPUT);
+		frame_end();
 
+		// Sleep until something is due - the next lane or log scroll or
+		// joystick reading - or there is input. Effects, rows still to be
+		// sent and moves being played back need every tick.
+		deadline = tick + JOYSTICK_PERIOD;
+		if(effects_running() || rows_waiting || replay_is_playing()) {
+			deadline = tick + 1;
+		}
+		// Time asleep isn't loop time - the iteration ends here
+		PROFILE_LOOP_END();
+		idle_until(scroll_deadline(deadline));
 	}
+	ledmatrix_defer_updates(0);
+	defer_count(0);
+	score_changed = 0;
 	show_score();
-	PORTA = 0x00;
+	hal_leds_set(0x00);
 	
 	// We get here if the frog is dead or the riverbank is full
 	// The game is over.
 }
 
+// Deal with frogs dying or reaching the far riverbank. Returns 0 if the
+// game is over (out of lives or the riverbank is full).
+static uint8_t check_frog(void) {
+	return update_frogs();
+}
+
+// Make a move with the given frog - whether a player's or one being played
+// back. Returns 0 if the game is over.
+static uint8_t make_move(uint8_t frog, uint8_t move) {
+	move_frog(frog, move);
+	frame_note(FRAME_MOVE);
+	if(move == MOVE_FORWARD || move == MOVE_LEFT_UP || move == MOVE_RIGHT_UP) {
+		// Sent at the end of the frame
+		score_changed = 1;
+	}
+	return check_frog();
+}
+
+// Whether a frog has lost a life or filled a riverbank hole since the
+// last call
+static uint8_t game_moved_on(void) {
+	uint8_t lives = 0;
+	uint16_t riverbank = get_riverbank_status();
+	for(uint8_t i = 0; i < get_number_of_frogs(); i++) {
+		lives += get_time_died(i);
+	}
+	if(lives == saved_lives && riverbank == saved_riverbank) {
+		return 0;
+	}
+	saved_lives = lives;
+	saved_riverbank = riverbank;
+	return 1;
+}
+
+// Player 2's move from the terminal - the letters L, U, D and R or the
+// cursor keys. Returns MOVE_NONE if the input isn't a move.
+static uint8_t serial_move(char serial_input, char escape_sequence_char) {
+	if(escape_sequence_char=='D' || serial_input=='L' || serial_input=='l') {
+		return MOVE_LEFT;
+	} else if(escape_sequence_char=='A' || serial_input=='U' || serial_input=='u') {
+		return MOVE_FORWARD;
+	} else if(escape_sequence_char=='B' || serial_input=='D' || serial_input=='d') {
+		return MOVE_BACKWARD;
+	} else if(escape_sequence_char=='C' || serial_input=='R' || serial_input=='r') {
+		return MOVE_RIGHT;
+	}
+	return MOVE_NONE;
+}
+
 void handle_game_over() {
+	// Nothing to carry on with at the next power up
+	savestate_clear();
 	//Reset all value back to original
 	reset_level();
+	reset_levels();
 	reset_count();
-	speed0 = 1300;
-	speed1 = 1250;
-	speed2 = 1200;
-	speed3 = 1150;
-	speed4 = 1100;
+	reset_speeds();
 
-	int column = 0;
-	char name[11];
 	char serial_input = -1;
 	move_cursor(10,3);
-	printf_P(PSTR("GAME OVER"));
+	serial_put_string_P(PSTR("GAME OVER"));
 	
-	if(get_score_collect()[4] < get_score()){ //Get the name of player if score is higher than the lowest rank
+	if(replay_is_playing()){
 		move_cursor(10,7);
-		printf_P(PSTR("Congratulations you scored a high score!! Please type your name: "));
-		move_cursor(column,9);
-		while(column < 10){
-			serial_input = -1;
-			if(serial_input_available()) {
-				serial_input = fgetc(stdin);
-				if((serial_input == 'D') && (column > 0)){
-					column--;
-					move_cursor(column,9);
-				}
-				else if(serial_input == 10){
-					break;
-				}
-				else if(((serial_input>= 65) && (serial_input <=90))| ((serial_input>=97) && (serial_input <= 122)) |
-				(serial_input==32)){
-					name[column] = serial_input;
-					printf("%c",serial_input);
-					column++;
-				}
+		serial_put_string_P(PSTR("End of replay"));
+	}
+	else {
+		for(uint8_t player = 0; player < get_number_of_frogs(); player++) {
+			//Get the name of player if score is higher than the lowest rank
+			if(get_score_collect()[4] < get_score(player)) {
+				enter_high_score(player);
 			}
 		}
-		name[10] = '\0';
-		add_data(name);
-		save_game();
 	}
 	
+	replay_stop();
+	
 	move_cursor(10,5);
-	printf_P(PSTR("Press a button to start again"));
+	serial_put_string_P(PSTR("Press a button to start again (1 or 2 = number of players)"));
+	move_cursor(10,6);
+	serial_put_string_P(PSTR("(r = replay last game, x = send replay, l = load replay)"));
 	show_high();
+	// A banner across the game field (the bottom row is left)
+	set_scrolling_display_rows(1, MATRIX_NUM_ROWS - 1);
+	set_scrolling_display_text_P(PSTR("GAME OVER"), COLOUR_RED);
 	clear_push(); //clear any button queue
-	while(button_pushed() == NO_BUTTON_PUSHED) {
-		; // wait
+	while(1) {
+		// Let the last frog's death finish and the banner go by
+		(void)scroll_display();
+		effects_step(get_monotonic_time());
+		(void)ledpanels_flush(FRAME_ROWS);
+		if(button_pushed() != NO_BUTTON_PUSHED) {
+			replay_start_recording(get_number_of_frogs());
+			break;
+		}
+		if(!serial_input_available()) {
+			// Nothing to do until the next interrupt
+			idle_sleep();
+		} else {
+			serial_input = serial_get_char();
+			if(serial_input == '1' || serial_input == '2') {
+				set_number_of_frogs(serial_input - '0');
+				replay_start_recording(get_number_of_frogs());
+				break;
+			}
+			else if(serial_input == 'x' || serial_input == 'X') {
+				replay_dump();
+			}
+			else if(serial_input == 'f' || serial_input == 'F') {
+				// Main loop profile (PROFILE builds only)
+				PROFILE_DUMP();
+			}
+			else if(serial_input == 'h' || serial_input == 'H') {
+				// How the game ended
+				rewind_history(get_current_time());
+			}
+			else if(serial_input == 'm' || serial_input == 'M') {
+				ram_report();
+			}
+			else if(serial_input == 'c' || serial_input == 'C') {
+				load_report();
+				frame_report();
+				savestate_report();
+			}
+			else if(serial_input == 'r' || serial_input == 'R') {
+				replay_start_playback();
+				set_number_of_frogs(replay_players());
+				break;
+			}
+			else if(serial_input == 'l' || serial_input == 'L') {
+				// Read a line of hex (as sent by 'x') then play it
+				replay_load_start();
+				do {
+					while(!serial_input_available()) {
+						idle_sleep();
+					}
+					serial_input = serial_get_char();
+				} while(replay_load_char(serial_input));
+				replay_start_playback();
+				set_number_of_frogs(replay_players());
+				break;
+			}
+		}
 	}
+	effects_stop();
+}
 
+// Ask the given player for their name and add their score to the high
+// score table
+static void enter_high_score(uint8_t player) {
+	int column = 0;
+	char name[11];
+	char serial_input = -1;
+	
+	move_cursor(10,7);
+	serial_put_string_P(PSTR("Congratulations you scored a high score!! Please type your name: "));
+	if(get_number_of_frogs() == 2) {
+		serial_put_string_P(player == 0 ? PSTR("(player 1) ") : PSTR("(player 2) "));
+	}
+	move_cursor(column,9);
+	clear_to_end_of_line();
+	while(column < 10){
+		serial_input = -1;
+		if(!serial_input_available()) {
+			idle_sleep();
+		} else {
+			serial_input = serial_get_char();
+			if((serial_input == 'D') && (column > 0)){
+				column--;
+				move_cursor(column,9);
+			}
+			else if(serial_input == 10){
+				break;
+			}
+			else if(((serial_input>= 65) && (serial_input <=90))| ((serial_input>=97) && (serial_input <= 122)) |
+			(serial_input==32)){
+				name[column] = serial_input;
+				serial_put_char(serial_input);
+				column++;
+			}
+		}
+	}
+	name[10] = '\0';
+	add_data(name, get_score(player));
+	save_game();
 }
 void handle_next_level(void){ //If river bank full then move to next level
 	next_level();
-	speed0 -= 80;
-	speed1 -= 80;
-	speed2 -= 80;
-	speed3 -= 80;
-	speed4 -= 80;
-	for(int i =0; i<16;i++){ //Shift display
-		_delay_ms(90);
-		ledmatrix_shift_display_left();
-	}
+	speed_up();
+	// The new level is revealed from the left as it starts - the game goes
+	// on meanwhile
+	effects_wipe(COLOUR_BLACK, 1, NEXT_LEVEL_WIPE_TIME);
 	make_noise(2000);
 }
@@ -0,0 +1,30 @@
+/*
+ * ram.c
+ *
+ * RAM budget report - see ram.h.
+ */
+
+#include <avr/pgmspace.h>
+
+#include "ram.h"
+#include "serialio.h"
+#include "hal.h"
+
+void ram_report(void) {
+	uint16_t used = hal_ram_static();
+	uint16_t untouched = hal_ram_untouched();
+
+	if(used == 0) {
+		serial_put_string_P(PSTR("\nRAM use isn't measured on this build\n"));
+		return;
+	}
+	serial_put_string_P(PSTR("\nRAM "));
+	serial_put_uint16(HAL_RAM_SIZE);
+	serial_put_string_P(PSTR(" static "));
+	serial_put_uint16(used);
+	serial_put_string_P(PSTR(" stack "));
+	serial_put_uint16(HAL_RAM_SIZE - used - untouched);
+	serial_put_string_P(PSTR(" free "));
+	serial_put_uint16(untouched);
+	serial_put_char('\n');
+}
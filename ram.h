@@ -0,0 +1,17 @@
+/*
+ * ram.h
+ *
+ * RAM budget. The ATmega324A has 2KB of RAM, shared between the static
+ * data (.data and .bss - host/ram_report.sh lists it by module) and the
+ * stack. The free RAM is painted at power up (see hal.h) so the deepest
+ * the stack has gone since then can be reported.
+ */
+
+#ifndef RAM_H_
+#define RAM_H_
+
+// Send a line with the RAM use to the serial terminal:
+//   RAM <size> static <bytes> stack <high water mark> free <never used>
+void ram_report(void);
+
+#endif /* RAM_H_ */
@@ -0,0 +1,202 @@
+/*
+ * replay.c
+ *
+ * Game recording and playback - see replay.h for the log format.
+ */
+
+#include <avr/pgmspace.h>
+
+#include "replay.h"
+#include "game.h"
+#include "serialio.h"
+
+#define REPLAY_IDLE 0
+#define REPLAY_RECORDING 1
+#define REPLAY_PLAYING 2
+
+static uint8_t replay_log[REPLAY_LOG_SIZE];
+static uint16_t log_length = 0;
+static uint16_t log_position;
+static uint8_t replay_mode = REPLAY_IDLE;
+
+// Tick of the last entry (recording) or of the next entry due (playback)
+static uint32_t entry_tick;
+// Code of the next entry when playing back
+static uint8_t next_code;
+// Players in the recording being played back
+static uint8_t players;
+
+// Hex loading - high nibble waiting for its low nibble
+static uint8_t load_byte;
+static uint8_t load_have_nibble;
+
+static void record(uint32_t tick, uint8_t code);
+static void read_next_entry(void);
+
+void replay_start_recording(uint8_t players) {
+	log_length = 0;
+	replay_mode = REPLAY_RECORDING;
+	if(players == 2) {
+		entry_tick = 0;
+		record(0, REPLAY_PLAYER_2);
+	}
+}
+
+void replay_start_playback(void) {
+	log_position = 0;
+	entry_tick = 0;
+	read_next_entry();
+	players = 1;
+	if(next_code == REPLAY_PLAYER_2) {
+		players = 2;
+		read_next_entry();
+	}
+	replay_mode = REPLAY_PLAYING;
+}
+
+uint8_t replay_players(void) {
+	return players;
+}
+
+void replay_stop(void) {
+	replay_mode = REPLAY_IDLE;
+}
+
+uint8_t replay_is_playing(void) {
+	return replay_mode == REPLAY_PLAYING;
+}
+
+void replay_new_level(uint32_t tick) {
+	if(replay_mode == REPLAY_RECORDING) {
+		// Ticks count from the start of the level
+		entry_tick = tick;
+		record(tick, REPLAY_NEW_LEVEL);
+	} else if(replay_mode == REPLAY_PLAYING) {
+		// Skip to the start of the next level in the log. (If a level
+		// ended early the rest of its moves are dropped.)
+		while(next_code != REPLAY_NEW_LEVEL && next_code != MOVE_NONE) {
+			read_next_entry();
+		}
+		if(next_code == REPLAY_NEW_LEVEL) {
+			entry_tick = tick;
+			read_next_entry();
+		}
+	}
+}
+
+void replay_record_move(uint32_t tick, uint8_t frog, uint8_t move) {
+	if(replay_mode == REPLAY_RECORDING) {
+		if(frog == 1) {
+			record(tick, REPLAY_PLAYER_2);
+		}
+		record(tick, move);
+	}
+}
+
+uint8_t replay_next_move(uint32_t tick, uint8_t* frog) {
+	uint8_t move;
+	if(replay_mode != REPLAY_PLAYING || next_code == MOVE_NONE
+			|| next_code == REPLAY_NEW_LEVEL || tick != entry_tick) {
+		return MOVE_NONE;
+	}
+	*frog = 0;
+	if(next_code == REPLAY_PLAYER_2) {
+		*frog = 1;
+		read_next_entry();
+		if(next_code == REPLAY_NEW_LEVEL || tick != entry_tick) {
+			return MOVE_NONE; // cut short (the log filled up)
+		}
+	}
+	move = next_code;
+	read_next_entry();
+	return move;
+}
+
+// Append an entry to the log. The entry is only added if it fits in full -
+// once the log is full the rest of the game isn't recorded.
+static void record(uint32_t tick, uint8_t code) {
+	uint8_t buffer[5];
+	uint8_t length = 0;
+	uint32_t value = ((tick - entry_tick) << 4) | code;
+	do {
+		buffer[length] = value & 0x7F;
+		value >>= 7;
+		if(value) {
+			buffer[length] |= 0x80;
+		}
+		length++;
+	} while(value);
+	if(log_length + length > REPLAY_LOG_SIZE) {
+		replay_mode = REPLAY_IDLE;
+		return;
+	}
+	for(uint8_t i = 0; i < length; i++) {
+		replay_log[log_length++] = buffer[i];
+	}
+	entry_tick = tick;
+}
+
+// Decode the next entry into next_code and entry_tick. next_code is
+// MOVE_NONE at the end of the log.
+static void read_next_entry(void) {
+	uint32_t value = 0;
+	uint8_t shift = 0;
+	uint8_t byte;
+	do {
+		if(log_position >= log_length || shift > 28) {
+			next_code = MOVE_NONE;
+			return;
+		}
+		byte = replay_log[log_position++];
+		value |= (uint32_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while(byte & 0x80);
+	next_code = value & 0x0F;
+	entry_tick += value >> 4;
+}
+
+void replay_dump(void) {
+	static const char hex_digits[] PROGMEM = "0123456789ABCDEF";
+	for(uint16_t i = 0; i < log_length; i++) {
+		serial_put_char(pgm_read_byte(&hex_digits[replay_log[i] >> 4]));
+		serial_put_char(pgm_read_byte(&hex_digits[replay_log[i] & 0x0F]));
+	}
+	serial_put_char('\n');
+}
+
+uint16_t replay_get_log(const uint8_t** log) {
+	*log = replay_log;
+	return log_length;
+}
+
+void replay_load_start(void) {
+	log_length = 0;
+	load_have_nibble = 0;
+	replay_mode = REPLAY_IDLE;
+}
+
+uint8_t replay_load_char(char c) {
+	uint8_t nibble;
+	if(c == '\n' || c == '\r') {
+		return 0;
+	}
+	if(c >= '0' && c <= '9') {
+		nibble = c - '0';
+	} else if(c >= 'A' && c <= 'F') {
+		nibble = c - 'A' + 10;
+	} else if(c >= 'a' && c <= 'f') {
+		nibble = c - 'a' + 10;
+	} else {
+		return 1; // Ignore anything else (spaces etc.)
+	}
+	if(!load_have_nibble) {
+		load_byte = nibble << 4;
+		load_have_nibble = 1;
+	} else {
+		load_have_nibble = 0;
+		if(log_length < REPLAY_LOG_SIZE) {
+			replay_log[log_length++] = load_byte | nibble;
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,74 @@
+/*
+ * replay.h
+ *
+ * Recording and playback of games. Every move the players make is logged
+ * with the game tick it was made on, counted from the start of the level.
+ * The game is stepped one tick at a time (see set_game_tick() in game.h),
+ * so feeding the same moves back on the same ticks through the same code
+ * reproduces the game exactly - frog movements, lane positions and score.
+ * A recording covers one game, from the first level to game over.
+ *
+ * The log is a sequence of unsigned varints (7 bits per byte, least
+ * significant bits first, top bit set on every byte but the last). Each is
+ *     (ticks since the previous entry << 4) | code
+ * where code is one of the MOVE_ values in game.h, or REPLAY_NEW_LEVEL at
+ * the start of each level (ticks count from zero again after it). A move
+ * up to 1 second after the previous one takes 2 bytes.
+ *
+ * Moves are player 1's unless the entry before is REPLAY_PLAYER_2 (with
+ * the move itself 0 ticks later). A recording of a two player game starts
+ * with a REPLAY_PLAYER_2 entry on its own, before the first
+ * REPLAY_NEW_LEVEL - one player recordings are the same as they always
+ * were.
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdint.h>
+
+#define REPLAY_LOG_SIZE 256
+#define REPLAY_NEW_LEVEL 15
+#define REPLAY_PLAYER_2 14
+
+// Start recording a new game with the given number of players (discarding
+// the last recording)
+void replay_start_recording(uint8_t players);
+
+// Start playing back the log from the beginning
+void replay_start_playback(void);
+
+// The number of players in the recording being played back
+uint8_t replay_players(void);
+
+// Stop recording or playing back. The log is kept.
+void replay_stop(void);
+
+uint8_t replay_is_playing(void);
+
+// Called at the start of each level with the game tick it starts on.
+void replay_new_level(uint32_t tick);
+
+// Log a move made by the given frog (player) on the given tick (if
+// recording)
+void replay_record_move(uint32_t tick, uint8_t frog, uint8_t move);
+
+// When playing back, return the next move if it is due on the given tick,
+// otherwise MOVE_NONE. *frog is set to the frog making it. Call again
+// until MOVE_NONE in case there are several moves on the same tick.
+uint8_t replay_next_move(uint32_t tick, uint8_t* frog);
+
+// Send the log to the serial port as a line of hex
+void replay_dump(void);
+
+// The log itself (for host tools - see host/replay_check.c). *log is set
+// to the start of it and its length is returned.
+uint16_t replay_get_log(const uint8_t** log);
+
+// Load a log sent as hex (as output by replay_dump()). Call
+// replay_load_start() then pass each character received to
+// replay_load_char() until it returns 0 (at the end of the line).
+void replay_load_start(void);
+uint8_t replay_load_char(char c);
+
+#endif /* REPLAY_H_ */
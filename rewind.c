@@ -0,0 +1,388 @@
+/*
+ * rewind.c
+ *
+ * Rewind buffer - see rewind.h for the format.
+ */
+
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "rewind.h"
+#include "savestate.h"
+#include "entity.h"
+#include "serialio.h"
+
+// A delta changes runs of up to MAX_RUN bytes, each one byte holding the
+// length (less 1) in its top 2 bits and the offset in the others - so a
+// snapshot has to be under 64 bytes. A delta with more than MAX_RUNS runs
+// is written as a keyframe instead.
+#define MAX_RUN 4
+#define MAX_RUNS 12
+// (the offset of a run has 6 bits)
+typedef char snapshot_fits_in_delta_offsets[sizeof(GameSnapshot) <= 64 ? 1 : -1];
+// The most ticks a delta can be after the one before. A longer gap takes
+// extra deltas with no changes.
+#define MAX_GAP 254
+// A keyframe - the marker, the tick and the snapshot
+#define KEYFRAME_BYTES (5 + sizeof(GameSnapshot))
+// Keyframes there can be in the ring at once
+#define MAX_KEYS (REWIND_SIZE / KEYFRAME_BYTES + 1)
+
+static uint8_t ring[REWIND_SIZE];
+static uint16_t tail;		// the oldest byte - always a keyframe
+static uint16_t used;
+static uint16_t keys[MAX_KEYS];	// where each keyframe is, oldest first
+static uint8_t num_keys;
+static uint16_t key_bytes;	// bytes of deltas after the newest keyframe
+// The newest snapshot in the ring (with times as ticks) and its tick
+static GameSnapshot last;
+static uint32_t last_tick;
+// After a rewind the ticks in the ring are behind the game clock by this
+static uint32_t shift;
+
+// Reading the ring
+static uint16_t reader;
+static uint16_t read_left;
+
+static uint8_t run_length(const uint8_t* old_data, const uint8_t* new_data, uint8_t i);
+static void to_ticks(GameSnapshot* snapshot, uint16_t tick);
+static void to_times(GameSnapshot* snapshot, uint16_t tick);
+static uint8_t move_on_times(GameSnapshot* snapshot, const GameSnapshot* before,
+		const uint16_t* scroll_period, uint8_t set);
+static void copy_times(GameSnapshot* snapshot, const GameSnapshot* from);
+static void put_keyframe(uint32_t tick, const GameSnapshot* snapshot);
+static void drop_oldest(void);
+static void put(uint8_t value);
+static uint8_t get(void);
+static uint32_t next_entry_tick(uint32_t tick);
+static uint8_t read_entry(GameSnapshot* snapshot, uint32_t* tick);
+
+void rewind_start(void) {
+	tail = 0;
+	used = 0;
+	num_keys = 0;
+	shift = 0;
+}
+
+void rewind_record(uint32_t tick, const uint32_t* next_scroll_time,
+		const uint16_t* scroll_period) {
+	GameSnapshot now;
+	uint8_t* old_data = (uint8_t*)&last;
+	uint8_t* new_data = (uint8_t*)&now;
+	uint8_t runs = 0, run;
+	uint32_t gap, pads;
+	uint16_t length = 2;
+
+	memset(&now, 0, sizeof(now));	// no stray padding to compare
+	if(!take_snapshot(&now, tick, next_scroll_time)) {
+		return;
+	}
+	tick -= shift;
+	to_ticks(&now, tick);
+	// A time which didn't move on by its period (more than one scroll or
+	// step since the last entry, or a new countdown) takes a keyframe
+	if(num_keys == 0 || !move_on_times(&now, &last, scroll_period, 0)) {
+		put_keyframe(tick, &now);
+		return;
+	}
+	// They are, so leave them out of the delta
+	copy_times(&last, &now);
+	for(uint8_t i = 0; i < sizeof(GameSnapshot); i += run ? run : 1) {
+		run = run_length(old_data, new_data, i);
+		if(run) {
+			runs++;
+			length += 1 + run;
+		}
+	}
+	if(runs == 0) {
+		return;
+	}
+	// A gap of more than MAX_GAP takes a delta with no changes (2 bytes)
+	// for each MAX_GAP ticks before the last (up to) MAX_GAP
+	gap = tick - last_tick;
+	pads = gap > MAX_GAP ? (gap - 1) / MAX_GAP : 0;
+	if(runs > MAX_RUNS || pads > REWIND_KEY_BYTES / 2
+			|| key_bytes + length + 2*pads > REWIND_KEY_BYTES) {
+		put_keyframe(tick, &now);
+		return;
+	}
+	length += 2*pads;
+	// There is always room once the older keyframes have gone, as a
+	// keyframe and REWIND_KEY_BYTES of deltas fit in the ring
+	while(REWIND_SIZE - used < length) {
+		drop_oldest();
+	}
+	if(num_keys == 0) {
+		put_keyframe(tick, &now);
+		return;
+	}
+	for(; pads; pads--) {
+		put(MAX_GAP);
+		put(0);
+		gap -= MAX_GAP;
+	}
+	put(gap);
+	put(runs);
+	for(uint8_t i = 0; i < sizeof(GameSnapshot); i += run ? run : 1) {
+		run = run_length(old_data, new_data, i);
+		if(run) {
+			put(((run - 1) << 6) | i);
+			for(uint8_t j = 0; j < run; j++) {
+				put(new_data[i + j]);
+			}
+		}
+	}
+	key_bytes += length;
+	last = now;
+	last_tick = tick;
+}
+
+uint8_t rewind_step(uint32_t tick, uint32_t* next_scroll_time,
+		const uint16_t* scroll_period) {
+	GameSnapshot snapshot, before;
+	uint32_t snapshot_tick = 0;
+	uint32_t target = tick - shift - REWIND_STEP;
+	uint16_t keep, key;
+
+	if(used == 0) {
+		return 0;
+	}
+	// Go forward from the oldest keyframe to the last entry at or before
+	// the target (or stay on the oldest keyframe if it is after it)
+	reader = tail;
+	read_left = used;
+	read_entry(&snapshot, &snapshot_tick);
+	while(read_left && (int32_t)(next_entry_tick(snapshot_tick) - target) <= 0) {
+		before = snapshot;
+		if(read_entry(&snapshot, &snapshot_tick)) {
+			move_on_times(&snapshot, &before, scroll_period, 1);
+		}
+	}
+	// Drop what came after
+	keep = used - read_left;
+	used = keep;
+	for(;;) {
+		key = (keys[num_keys - 1] + REWIND_SIZE - tail) % REWIND_SIZE;
+		if(key < keep) {
+			break;
+		}
+		num_keys--;
+	}
+	key_bytes = keep - key - KEYFRAME_BYTES;
+	last = snapshot;
+	last_tick = snapshot_tick;
+	shift = tick - snapshot_tick;
+
+	to_times(&snapshot, snapshot_tick);
+	restore_snapshot(&snapshot, tick, next_scroll_time);
+	return 1;
+}
+
+void rewind_history(uint32_t tick) {
+	GameSnapshot snapshot;
+	uint32_t snapshot_tick = 0;
+	SavedFrog frogs[MAX_FROGS];
+
+	memset(frogs, 0x80, sizeof(frogs));	// not a position a frog can be in
+	reader = tail;
+	read_left = used;
+	serial_put_string_P(PSTR("\nRewind "));
+	serial_put_uint32(used ? tick - shift - next_entry_tick(0) : 0);
+	serial_put_string_P(PSTR(" ms in "));
+	serial_put_uint16(used);
+	serial_put_string_P(PSTR(" bytes\n"));
+	while(read_left) {
+		read_entry(&snapshot, &snapshot_tick);
+		if(memcmp(frogs, snapshot.game.frogs, sizeof(frogs)) == 0) {
+			continue;
+		}
+		memcpy(frogs, snapshot.game.frogs, sizeof(frogs));
+		serial_put_uint32(tick - shift - snapshot_tick);
+		for(uint8_t i = 0; i < snapshot.game.num_frogs; i++) {
+			serial_put_char(' ');
+			serial_put_uint16(frogs[i].row);
+			serial_put_char(',');
+			serial_put_uint16(frogs[i].column);
+			serial_put_string_P(PSTR(" lost "));
+			serial_put_uint16(frogs[i].time_died);
+		}
+		serial_put_char('\n');
+	}
+}
+
+// The number of bytes (up to MAX_RUN) from offset i which have changed -
+// 0 if the one at i hasn't
+static uint8_t run_length(const uint8_t* old_data, const uint8_t* new_data, uint8_t i) {
+	uint8_t run = 0;
+	while(run < MAX_RUN && i + run < sizeof(GameSnapshot)
+			&& old_data[i + run] != new_data[i + run]) {
+		run++;
+	}
+	return run;
+}
+
+// Change the times left in a snapshot to the (bottom 16 bits of the) ticks
+// they run out on, and back. A hazard's time of 0 (it never steps) is left
+// alone - so one which would be due on tick 0 is put on the tick before.
+static void to_ticks(GameSnapshot* snapshot, uint16_t tick) {
+	EntityState* entity = snapshot->game.entities;
+	snapshot->count_left += tick;
+	for(uint8_t i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		snapshot->scroll_left[i] += tick;
+	}
+	for(uint8_t i = 0; i < MAX_LEVEL_ENTITIES; i++, entity++) {
+		if(entity->timer) {
+			entity->timer += tick;
+			if(entity->timer == 0) {
+				entity->timer--;
+			}
+		}
+	}
+}
+
+static void to_times(GameSnapshot* snapshot, uint16_t tick) {
+	EntityState* entity = snapshot->game.entities;
+	snapshot->count_left -= tick;
+	for(uint8_t i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		snapshot->scroll_left[i] -= tick;
+	}
+	for(uint8_t i = 0; i < MAX_LEVEL_ENTITIES; i++, entity++) {
+		if(entity->timer) {
+			entity->timer -= tick;
+		}
+	}
+}
+
+// Check (set == 0) or set (set == 1) the times in a snapshot against the
+// snapshot before - a row's next scroll is a period on from the one before
+// if it has scrolled since, otherwise the same, and likewise a hazard's
+// next step. Returns 0 if a time isn't what it should be.
+static uint8_t move_on_times(GameSnapshot* snapshot, const GameSnapshot* before,
+		const uint16_t* scroll_period, uint8_t set) {
+	const SavedGame* game = &snapshot->game;
+	const SavedGame* game_before = &before->game;
+	EntityState* entity = snapshot->game.entities;
+	const EntityState* entity_before = before->game.entities;
+	uint16_t time;
+
+	for(uint8_t i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		time = before->scroll_left[i];
+		if(i < 3 ? game->lane_position[i] != game_before->lane_position[i]
+				: game->log_position[i - 3] != game_before->log_position[i - 3]) {
+			time += scroll_period[i];
+		}
+		if(set) {
+			snapshot->scroll_left[i] = time;
+		} else if(snapshot->scroll_left[i] != time) {
+			return 0;
+		}
+	}
+	for(uint8_t i = 0; i < MAX_LEVEL_ENTITIES; i++, entity++, entity_before++) {
+		time = entity_before->timer;
+		if(entity->column != entity_before->column || entity->phase != entity_before->phase) {
+			time += get_entity_period(i);
+		}
+		if(set) {
+			entity->timer = time;
+		} else if(entity->timer != time) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Copy the scroll and step times (not the countdown) from one snapshot
+// to another
+static void copy_times(GameSnapshot* snapshot, const GameSnapshot* from) {
+	for(uint8_t i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		snapshot->scroll_left[i] = from->scroll_left[i];
+	}
+	for(uint8_t i = 0; i < MAX_LEVEL_ENTITIES; i++) {
+		snapshot->game.entities[i].timer = from->game.entities[i].timer;
+	}
+}
+
+static void put_keyframe(uint32_t tick, const GameSnapshot* snapshot) {
+	const uint8_t* data = (const uint8_t*)snapshot;
+	while(used + KEYFRAME_BYTES > REWIND_SIZE || num_keys == MAX_KEYS) {
+		drop_oldest();
+	}
+	keys[num_keys++] = (tail + used) % REWIND_SIZE;
+	put(REWIND_KEYFRAME);
+	for(uint8_t i = 0; i < 4; i++) {
+		put(tick >> (8*i));
+	}
+	for(uint8_t i = 0; i < sizeof(GameSnapshot); i++) {
+		put(data[i]);
+	}
+	key_bytes = 0;
+	last = *snapshot;
+	last_tick = tick;
+}
+
+// Drop the oldest keyframe and its deltas (or everything if there is only
+// the one)
+static void drop_oldest(void) {
+	if(num_keys <= 1) {
+		rewind_start();
+		return;
+	}
+	used -= (keys[1] + REWIND_SIZE - tail) % REWIND_SIZE;
+	tail = keys[1];
+	num_keys--;
+	for(uint8_t i = 0; i < num_keys; i++) {
+		keys[i] = keys[i + 1];
+	}
+}
+
+static void put(uint8_t value) {
+	ring[(tail + used) % REWIND_SIZE] = value;
+	used++;
+}
+
+static uint8_t get(void) {
+	uint8_t value = ring[reader];
+	reader = (reader + 1) % REWIND_SIZE;
+	read_left--;
+	return value;
+}
+
+// The tick of the entry at the reader, given the tick of the one before
+static uint32_t next_entry_tick(uint32_t tick) {
+	uint32_t key_tick = 0;
+	if(ring[reader] != REWIND_KEYFRAME) {
+		return tick + ring[reader];
+	}
+	for(uint8_t i = 4; i > 0; i--) {
+		key_tick = (key_tick << 8) | ring[(reader + i) % REWIND_SIZE];
+	}
+	return key_tick;
+}
+
+// Read the entry at the reader - a keyframe replaces the snapshot, a delta
+// changes it. *tick is the tick of the entry before and is set to this one.
+// Returns 1 for a delta (whose times still have to be moved on).
+static uint8_t read_entry(GameSnapshot* snapshot, uint32_t* tick) {
+	uint8_t* data = (uint8_t*)snapshot;
+	uint8_t runs, run, offset;
+
+	*tick = next_entry_tick(*tick);
+	if(get() == REWIND_KEYFRAME) {
+		for(uint8_t i = 0; i < 4; i++) {
+			(void)get();
+		}
+		for(uint8_t i = 0; i < sizeof(GameSnapshot); i++) {
+			data[i] = get();
+		}
+		return 0;
+	}
+	for(runs = get(); runs; runs--) {
+		offset = get();
+		run = (offset >> 6) + 1;
+		offset &= 0x3F;
+		while(run--) {
+			data[offset++] = get();
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,67 @@
+/*
+ * rewind.h
+ *
+ * Rewind buffer. The last few seconds of a level are kept in a ring of
+ * REWIND_SIZE bytes of RAM as game snapshots (see GameSnapshot in
+ * savestate.h), one for each time round the game loop in which something
+ * changed, so the game can be stepped back (rewind_step()) and the lead
+ * up to a death looked at afterwards (rewind_history()).
+ *
+ * The ring holds keyframes - a whole snapshot - each followed by deltas:
+ *     keyframe: REWIND_KEYFRAME, the tick (4 bytes), the snapshot
+ *     delta:    ticks since the last entry (0 to 254), the number of runs
+ *               of changed bytes, then for each run its length (1 to 4)
+ *               less 1 in the top 2 bits of a byte with its offset in the
+ *               snapshot, and the new values
+ * Times in a snapshot are kept as the (bottom 16 bits of the) tick they
+ * run out on rather than the time left, so a delta is only needed when
+ * something actually happens - a scroll, a hazard stepping or a move. Nor
+ * do deltas carry times: a row scrolling or a hazard stepping puts its
+ * next time a period on, which the reader works out for itself, and any
+ * other change of time (two scrolls between entries, say) takes a
+ * keyframe. A new keyframe is written once the deltas since the last one come to
+ * REWIND_KEY_BYTES, and when the ring is full the oldest keyframe and its
+ * deltas make way. So recording costs a comparison of one snapshot each
+ * time round the loop whatever happened, and stepping back decodes at
+ * most one ring's worth of entries.
+ *
+ * Snapshots are only taken at safe points (no frog dying) so the ticks a
+ * frog is dying are skipped.
+ */
+
+#ifndef REWIND_H_
+#define REWIND_H_
+
+#include <stdint.h>
+
+#define REWIND_SIZE 256
+#define REWIND_KEY_BYTES 96
+#define REWIND_KEYFRAME 0xFF
+
+// How far back each rewind_step() goes (ms)
+#define REWIND_STEP 1000
+
+// Start again (empty) at the start of a level
+void rewind_start(void);
+
+// Add the state of the game on the given tick (with the game clock times
+// each scrolling row next scrolls, and the ms between its scrolls) if it
+// has changed. Call each time round
+// the game loop once the game is up to date.
+void rewind_record(uint32_t tick, const uint32_t* next_scroll_time,
+		const uint16_t* scroll_period);
+
+// Put the game back to how it was REWIND_STEP ms before (or as far back as
+// the ring goes), carrying on from the given tick. Whatever came after is
+// dropped. Returns 0 if there is nothing to go back to.
+uint8_t rewind_step(uint32_t tick, uint32_t* next_scroll_time,
+		const uint16_t* scroll_period);
+
+// Send the frogs' moves and lives over the time in the ring to the serial
+// terminal (tick is the game clock now) - how far back the ring goes, then
+// a line each time a frog moved or lost a life:
+//   Rewind <ms> ms in <bytes> bytes
+//   <ms ago> <row>,<column> lost <lives lost> (then the same for player 2)
+void rewind_history(uint32_t tick);
+
+#endif /* REWIND_H_ */
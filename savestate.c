@@ -0,0 +1,159 @@
+/*
+ * savestate.c
+ *
+ * Save states - see savestate.h.
+ */
+
+#include <stddef.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+
+#include "savestate.h"
+#include "score.h"
+#include "timer0.h"
+#include "terminalio.h"
+#include "serialio.h"
+#include "eeprom_writer.h"
+#include "hal.h"
+
+#define SAVESTATE_MAGIC 0x53	// 'S'
+#define SAVESTATE_VERSION 1
+
+typedef struct {
+	uint8_t magic;
+	uint8_t version;
+	uint8_t sequence;	// incremented for each save - newest record wins
+	GameSnapshot snapshot;
+	uint16_t crc;		// must be last
+} SaveState;
+
+// The record being written (it mustn't change until the write is done) or
+// the one read at power up
+static SaveState state;
+static uint8_t current_slot = SAVESTATE_SLOTS-1;
+
+// Times in get_fine_time() units
+static uint16_t capture_time, capture_max, restore_time;
+
+static uint16_t state_crc(SaveState* record);
+static void write_state(void);
+
+uint8_t take_snapshot(GameSnapshot* snapshot, uint32_t tick,
+		const uint32_t* next_scroll_time) {
+	if(!get_saved_game(&snapshot->game)) {
+		return 0;
+	}
+	snapshot->level = get_level();
+	for(uint8_t i = 0; i < MAX_FROGS; i++) {
+		snapshot->score[i] = get_score(i);
+		snapshot->temp_score[i] = get_temp_score(i);
+	}
+	snapshot->count_left = get_count_left_at(tick);
+	for(uint8_t i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		snapshot->scroll_left[i] = next_scroll_time[i] - tick;
+	}
+	return 1;
+}
+
+void restore_snapshot(const GameSnapshot* snapshot, uint32_t tick,
+		uint32_t* next_scroll_time) {
+	restore_saved_game(&snapshot->game);
+	for(uint8_t i = 0; i < MAX_FROGS; i++) {
+		restore_score(i, snapshot->score[i], snapshot->temp_score[i]);
+	}
+	show_score();
+	set_count_left_at(tick, snapshot->count_left);
+	for(uint8_t i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		next_scroll_time[i] = tick + snapshot->scroll_left[i];
+	}
+}
+
+uint8_t savestate_capture(uint32_t tick, const uint32_t* next_scroll_time) {
+	uint16_t start = get_fine_time();
+	if(eeprom_write_busy() || !take_snapshot(&state.snapshot, tick, next_scroll_time)) {
+		return 0;
+	}
+	write_state();
+	capture_time = get_fine_time() - start;
+	if(capture_time > capture_max) {
+		capture_max = capture_time;
+	}
+	return 1;
+}
+
+void savestate_clear(void) {
+	while(eeprom_write_busy()) {
+		;
+	}
+	state.snapshot.level = 0;
+	write_state();
+}
+
+uint8_t savestate_load(void) {
+	SaveState record;
+	uint8_t found = 0;
+	for(uint8_t slot = 0; slot < SAVESTATE_SLOTS; slot++) {
+		hal_eeprom_read_block(&record, SAVESTATE_BASE + slot*sizeof(SaveState),
+				sizeof(SaveState));
+		if(record.magic != SAVESTATE_MAGIC || record.version != SAVESTATE_VERSION
+				|| record.crc != state_crc(&record)) {
+			continue; // Never written, old layout or cut short
+		}
+		// Sequence numbers wrap around - compare the difference
+		if(!found || (int8_t)(record.sequence - state.sequence) > 0) {
+			state = record;
+			current_slot = slot;
+			found = 1;
+		}
+	}
+	if(!found) {
+		state.magic = SAVESTATE_MAGIC;
+		state.version = SAVESTATE_VERSION;
+		state.snapshot.level = 0;
+		return 0;
+	}
+	if(state.snapshot.level) {
+		set_number_of_frogs(state.snapshot.game.num_frogs);
+	}
+	return state.snapshot.level;
+}
+
+void savestate_restore(uint32_t tick, uint32_t* next_scroll_time) {
+	uint16_t start = get_fine_time();
+	restore_snapshot(&state.snapshot, tick, next_scroll_time);
+	restore_time = get_fine_time() - start;
+}
+
+void savestate_report(void) {
+	serial_put_string_P(PSTR("\nSave state "));
+	serial_put_uint16(sizeof(SaveState));
+	serial_put_string_P(PSTR(" bytes capture "));
+	serial_put_uint32((uint32_t)capture_time * 8);
+	serial_put_string_P(PSTR(" max "));
+	serial_put_uint32((uint32_t)capture_max * 8);
+	serial_put_string_P(PSTR(" restore "));
+	serial_put_uint32((uint32_t)restore_time * 8);
+	serial_put_char('\n');
+}
+
+// Write the record to the next slot in the background
+static void write_state(void) {
+	state.sequence++;
+	state.crc = state_crc(&state);
+	current_slot++;
+	if(current_slot >= SAVESTATE_SLOTS) {
+		current_slot = 0;
+	}
+	eeprom_write_start(SAVESTATE_BASE + current_slot*sizeof(SaveState),
+			&state, sizeof(SaveState));
+}
+
+// CRC of everything in the record except the CRC itself
+static uint16_t state_crc(SaveState* record) {
+	uint8_t* data = (uint8_t*)record;
+	uint16_t crc = 0xFFFF;
+	for(uint8_t i = 0; i < offsetof(SaveState, crc); i++) {
+		crc = _crc_ccitt_update(crc, data[i]);
+	}
+	return crc;
+}
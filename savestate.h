@@ -0,0 +1,81 @@
+/*
+ * savestate.h
+ *
+ * Save states - so a game carries on where it was after the power goes.
+ * While a game is being played, a snapshot of it is written to EEPROM
+ * whenever something worth keeping happens (see savestate_capture() and
+ * its use in project.c, which has the EEPROM wear budget). At power up savestate_load()
+ * finds the newest one, and if it was taken during a game that game is
+ * carried on from the same tick instead of showing the splash screen.
+ *
+ * A snapshot is a record of a few dozen bytes: the level (number and
+ * layout), each frog's position and lives, the lane and log positions,
+ * the riverbank, the hazards, the scores, the time left on the countdown
+ * and the time until each lane and log next scrolls. Like the high score
+ * table (score.c) it has a version and a sequence number, goes to each of
+ * SAVESTATE_SLOTS slots in turn (so no slot wears out) and ends with a
+ * CRC, so one cut short by the power going fails its check and the one
+ * before it is used. A record with level 0 means no game was going.
+ *
+ * The time taken to capture a snapshot (in the game loop, so it counts
+ * against the frame budget - see frame.h) and to restore one is kept for
+ * savestate_report().
+ */
+
+#ifndef SAVESTATE_H_
+#define SAVESTATE_H_
+
+#include <stdint.h>
+#include "game.h"
+
+// The state of a game being played - what a snapshot holds (the rewind
+// buffer, rewind.h, keeps them too)
+typedef struct {
+	uint8_t level;		// level number shown - 0 if no game was going
+	SavedGame game;
+	uint32_t score[MAX_FROGS];
+	uint32_t temp_score[MAX_FROGS];
+	uint16_t count_left;	// ms
+	uint16_t scroll_left[NUM_SCROLLING_ROWS];	// ms until each row scrolls
+} GameSnapshot;
+
+// Fill in a snapshot of the game on the given tick, with the game clock
+// times each scrolling row next scrolls (NUM_SCROLLING_ROWS of them).
+// Returns 0 if the game isn't at a safe point (see get_saved_game()).
+uint8_t take_snapshot(GameSnapshot* snapshot, uint32_t tick,
+		const uint32_t* next_scroll_time);
+
+// Carry on from a snapshot with the game clock at tick. The game, scores
+// and countdown are restored (and shown) and next_scroll_time set.
+void restore_snapshot(const GameSnapshot* snapshot, uint32_t tick,
+		uint32_t* next_scroll_time);
+
+// Where the snapshots go in EEPROM (see eeprom_writer.h) - a snapshot is
+// 66 bytes, so the slots take up 768 to 965
+#define SAVESTATE_BASE 768
+#define SAVESTATE_SLOTS 3
+
+// Take a snapshot of the game (see take_snapshot()) and start writing it
+// to EEPROM. Returns 0 if it wasn't taken because the game isn't at a
+// safe point or the EEPROM is still busy.
+uint8_t savestate_capture(uint32_t tick, const uint32_t* next_scroll_time);
+
+// Write a record saying no game is going (at game over). Waits for any
+// write still in progress.
+void savestate_clear(void);
+
+// Read the newest valid snapshot at power up. Returns the level number it
+// was taken on, or 0 if there is no game to carry on. If there is, the
+// number of players is set from it.
+uint8_t savestate_load(void);
+
+// Carry on from the snapshot read by savestate_load() (see
+// restore_snapshot()) - call at the start of play, after new_game().
+void savestate_restore(uint32_t tick, uint32_t* next_scroll_time);
+
+// Send the size of a snapshot and the times taken to capture (the last
+// and the longest) and restore one to the serial terminal:
+//   Save state <bytes> bytes capture <us> max <us> restore <us>
+void savestate_report(void);
+
+#endif /* SAVESTATE_H_ */
@@ -2,81 +2,181 @@
 * score.c
 *
 * Written by Peter Sutton
+*
+* The high score table is kept in RAM and saved to EEPROM as a record
+* with a sequence number and CRC. Records go to EEPROM_SLOTS slots in
+* turn (so no one slot wears out) and are written in the background by
+* eeprom_writer.c. The CRC is the last thing written, so a record cut
+* short by a power failure fails its check and the previous slot is
+* used at the next power up. A save is written from a copy of the table,
+* so the table can change while it is going, and a save asked for while
+* another write is in progress is started as soon as that write finishes.
 */
 
 #include "score.h"
+#include <stddef.h>
 #include <string.h>
-#include <avr/eeprom.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+#include "eeprom_writer.h"
+#include "game.h"
+#include "hal.h"
+
+#define RECORD_MAGIC 0x48	// 'H'
+#define RECORD_VERSION 1
+#define EEPROM_SLOTS 8
+#define EEPROM_BASE 0
+
+typedef struct {
+	uint8_t magic;
+	uint8_t version;
+	uint8_t sequence;	// incremented for each save - newest record wins
+	uint32_t score[5];
+	char name[5][11];
+	uint16_t crc;		// must be last
+} HighScoreRecord;
+
+static uint32_t score[MAX_FROGS];
+static uint32_t temp_score[MAX_FROGS];
+static HighScoreRecord high_scores;
+static HighScoreRecord saving;	// the copy being written to EEPROM
+static volatile uint8_t save_pending = 0;
+static uint8_t current_slot = EEPROM_SLOTS-1;
 
-uint32_t score;
-uint32_t temp_score = 0;
-char name_collect[5][11];
-uint32_t score_collect[5];
+static void start_save(void);
+static uint16_t record_crc(HighScoreRecord* record);
+static void default_high_scores(void);
 
 void init_score(void) {
-	score_collect[0] = 5; //Dummy value
-	score_collect[1] = 4; //Dummy value
-	score_collect[2] = 3; //Dummy value
-	score_collect[3] = 2; //Dummy value
-	score_collect[4] = 1; //Dummy value
-	score = 0;
+	for(uint8_t i = 0; i < MAX_FROGS; i++) {
+		score[i] = 0;
+		temp_score[i] = 0;
+	}
 }
 
-void add_to_score(uint16_t value) {
-	score += value;
+void add_to_score(uint8_t player, uint16_t value) {
+	score[player] += value;
+}
+void update_temp(uint8_t player){ // If successfully reached the other side save this score incase the frog dies
+	temp_score[player] = score[player];
 }
-void update_temp(void){ // If successfully reached the other side save this score incase the frog dies
-	temp_score = score;
+void reset_to_temp(uint8_t player){ // Set score back to last successful cross
+	score[player] = temp_score[player];
 }
-void reset_to_temp(void){ // Set score back to last successful cross
-	score = temp_score;
+
+uint32_t get_score(uint8_t player) {
+	return score[player];
 }
 
-uint32_t get_score(void) {
-	return score;
+uint32_t get_temp_score(uint8_t player) {
+	return temp_score[player];
 }
 
-void add_data(char* name){ //Add score and name of player in case of high-score achieved
-
-	uint32_t current, next;
-	char c_name[11],n_name[11];
-	for(int i = 0;i<5;i++){  //Check position of high-score on the ranking and replace it with the new one
-		if(score_collect[i] < score){
-			current = score_collect[i];
-			score_collect[i] = score;
-			strncpy(c_name,name_collect[i],11);
-			strcat(name_collect[i], name);
-
-			for(int j = i+1; j < 5; j++){ //shift lower scores down by 1 step and the last one discarded
-				next = score_collect[j];
-				score_collect[j] = current;
-				current = next;
-				strncpy(n_name,name_collect[j],11);
-				strcat(name_collect[j], c_name);
-				strncpy(c_name,n_name,11);
-			}
+void restore_score(uint8_t player, uint32_t value, uint32_t temp) {
+	score[player] = value;
+	temp_score[player] = temp;
+}
+
+void add_data(char* name, uint32_t new_score){ //Add score and name of player in case of high-score achieved
+	uint8_t i, j;
+	for(i = 0; i < 5; i++){ //Find the position of the new score in the ranking
+		if(high_scores.score[i] < new_score){
 			break;
 		}
 	}
-	
+	if(i == 5){
+		return;
+	}
+	// A queued save copies the table from the EEPROM ready interrupt - don't
+	// let it see the table half changed
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		for(j = 4; j > i; j--){ //shift lower scores down by 1 step and the last one discarded
+			high_scores.score[j] = high_scores.score[j-1];
+			memcpy(high_scores.name[j], high_scores.name[j-1], 11);
+		}
+		high_scores.score[i] = new_score;
+		strncpy(high_scores.name[i], name, 10);
+		high_scores.name[i][10] = '\0';
+	}
 }
 
 uint32_t* get_score_collect(void){
-	return score_collect;
+	return high_scores.score;
 }
 
 char* get_name_collect(void){
-	return *name_collect;
+	return *high_scores.name;
 }
 
-void load_game(void){ //Load from EEPROM
-	for(int i = 0 ;i<5;i++){
-		score_collect[i] = eeprom_read_dword((uint32_t*)i);
-		eeprom_read_block((void*)name_collect[i], (const void*) i+5, 11);
+void load_game(void){ //Load from EEPROM - the newest valid record
+	HighScoreRecord record;
+	uint8_t found = 0;
+	for(uint8_t slot = 0; slot < EEPROM_SLOTS; slot++){
+		hal_eeprom_read_block(&record, EEPROM_BASE + slot*sizeof(HighScoreRecord),
+				sizeof(HighScoreRecord));
+		if(record.magic != RECORD_MAGIC || record.version != RECORD_VERSION
+				|| record.crc != record_crc(&record)){
+			continue; // Never written, old layout or cut short
+		}
+		// Sequence numbers wrap around - compare the difference
+		if(!found || (int8_t)(record.sequence - high_scores.sequence) > 0){
+			high_scores = record;
+			current_slot = slot;
+			found = 1;
+		}
+	}
+	if(!found){
+		default_high_scores();
+	}
+	eeprom_write_set_done_handler(start_save);
+}
+
+void save_game(void){ //Save to EEPROM in the background
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		save_pending = 1;
+		// If another write is going (the last save, or a save state) the
+		// save starts when it finishes - start_save() is the writer's
+		// done handler
+		if(!eeprom_write_busy()){
+			start_save();
+		}
 	}
 }
 
-void save_game(void){ //Save to EEPROM	for(int i = 0;i<5;i++){		eeprom_update_dword((uint32_t*) i,score_collect[i]);		eeprom_update_block((const void*)name_collect+i, (void*)i+5,11);	}
+// Start the save asked for, if there is one. Only called with interrupts
+// off and nothing being written, so saving isn't in use.
+static void start_save(void){
+	if(!save_pending){
+		return;
+	}
+	save_pending = 0;
+	high_scores.sequence++;
+	high_scores.crc = record_crc(&high_scores);
+	saving = high_scores;
+	current_slot++;
+	if(current_slot >= EEPROM_SLOTS){
+		current_slot = 0;
+	}
+	eeprom_write_start(EEPROM_BASE + current_slot*sizeof(HighScoreRecord),
+			&saving, sizeof(HighScoreRecord));
 }
 
+// CRC of everything in the record except the CRC itself
+static uint16_t record_crc(HighScoreRecord* record){
+	uint8_t* data = (uint8_t*)record;
+	uint16_t crc = 0xFFFF;
+	for(uint8_t i = 0; i < offsetof(HighScoreRecord, crc); i++){
+		crc = _crc_ccitt_update(crc, data[i]);
+	}
+	return crc;
+}
 
+static void default_high_scores(void){
+	memset(&high_scores, 0, sizeof(high_scores));
+	high_scores.magic = RECORD_MAGIC;
+	high_scores.version = RECORD_VERSION;
+	for(uint8_t i = 0; i < 5; i++){
+		high_scores.score[i] = 5 - i; //Dummy values
+	}
+	current_slot = EEPROM_SLOTS-1;
+}
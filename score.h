@@ -9,14 +9,28 @@
 
 #include <stdint.h>
 
+// Scores - one per player (frog - see game.h). The temporary score is the
+// score when the player's frog last reached the riverbank, which is what
+// the score goes back to when the frog dies.
 void init_score(void);
-void add_to_score(uint16_t value);
-uint32_t get_score(void);
-void add_data(char* name);
-
-void reset_to_temp(void);
-void update_temp(void);
-
+void add_to_score(uint8_t player, uint16_t value);
+uint32_t get_score(uint8_t player);
+
+void reset_to_temp(uint8_t player);
+void update_temp(uint8_t player);
+uint32_t get_temp_score(uint8_t player);
+// Set both (when carrying on from a save state - see savestate.h)
+void restore_score(uint8_t player, uint32_t value, uint32_t temp);
+
+// Add a score to the high score table (if it is high enough) with the
+// given name
+void add_data(char* name, uint32_t new_score);
+
+// High score table. load_game() reads the newest valid table from EEPROM
+// into RAM (or sets up default scores if there isn't one) and should be
+// called once at power up. save_game() starts writing the table to EEPROM
+// in the background and returns straight away - if another EEPROM write is
+// in progress the save is queued and starts when that write finishes.
 void save_game(void);
 void load_game(void);
 
@@ -6,9 +6,9 @@
  * This is an example of how the LED display board can be used. 
  * This program scrolls a message from right to left on the
  * board. The font used is defined below and is 7 dots high and
- * varies between 3 and 5 dots wide, depending on the character.
- * Letters and numbers can be handled (though lower case
- * letters are displayed as upper case). All other characters
+ * varies between 1 and 5 dots wide, depending on the character.
+ * Letters, numbers and most punctuation can be handled (though lower
+ * case letters are displayed as upper case). All other characters
  * display as a blank column.
  * 
  * The program also demonstrates how data can be stored in the
@@ -21,22 +21,26 @@
  * constants can live just in the program memory and not be 
  * copied to RAM. (This saves several hundred bytes of RAM.)
  *
+ * The message is turned into columns of dots a few characters ahead of
+ * where it is on the display, into a small ring of columns. The timer
+ * interrupt says when the next step is due and scroll_display() (called
+ * from the main loop) draws it, so nothing waits.
  */
 
 #include "scrolling_char_display.h"
 #include "ledmatrix.h"
 #include <avr/pgmspace.h>
+#include <util/atomic.h>
 
 /* FONT DEFINITION
  *
  * The following define the columns of data to be displayed
- * for each character (a-z and 0-9). The most significant
- * 7 bits (bit 7 to bit 1) represent the data for rows 7 to 1 
- * (top to bottom). The least significant bit is 1 only for
- * the last column of letter data. (This is how the software
- * will know when it has reached the last column for this 
- * character. We do not display data for this bit, i.e. 
- * row y=0 on the display will always be blank.
+ * for each character from space (32) to underscore (95), one after
+ * the other. The most significant 7 bits (bit 7 to bit 1) represent
+ * the data for rows 7 to 1 (top to bottom). Bit 0 is always 0.
+ * font_offset[] gives where each character's columns start - a
+ * character's columns end where the next one's start. (There are
+ * fewer than 256 columns in all.)
  * As an example, the data for the 4 columns of letter A is as 
  * follows:
  * bit 7  ** 
@@ -46,202 +50,283 @@
  * bit 3 *  *
  * bit 2 *  *
  * bit 1 *  *
- * bit 0    *
+ * bit 0
  */
+#define FONT_FIRST ' '
+#define FONT_GLYPHS 64
 
-/* Data for letters A-Z */
-static const uint8_t cols_A[] PROGMEM = {126, 144, 144, 127};
-static const uint8_t cols_B[] PROGMEM = {254, 146, 146, 109};
-static const uint8_t cols_C[] PROGMEM = {124, 130, 130, 69};
-static const uint8_t cols_D[] PROGMEM = {254, 130, 130, 125};
-static const uint8_t cols_E[] PROGMEM = {254, 146, 146, 131};
-static const uint8_t cols_F[] PROGMEM = {254, 144, 144, 129};
-static const uint8_t cols_G[] PROGMEM = {124, 130, 146, 93};
-static const uint8_t cols_H[] PROGMEM = {254, 16, 16, 255};
-static const uint8_t cols_I[] PROGMEM = {130, 254, 131};
-static const uint8_t cols_J[] PROGMEM = {4, 2, 2, 253};
-static const uint8_t cols_K[] PROGMEM = {254, 16, 40, 199};
-static const uint8_t cols_L[] PROGMEM = {254, 2, 2, 3};
-static const uint8_t cols_M[] PROGMEM = {254, 64, 48, 64, 255};
-static const uint8_t cols_N[] PROGMEM = {254, 32, 16, 255};
-static const uint8_t cols_O[] PROGMEM = {124, 130, 130, 125};
-static const uint8_t cols_P[] PROGMEM = {254, 144, 144, 97};
-static const uint8_t cols_Q[] PROGMEM = {124, 130, 138, 124, 3};
-static const uint8_t cols_R[] PROGMEM = {254, 144, 152, 103};
-static const uint8_t cols_S[] PROGMEM = {100, 146, 146, 77};
-static const uint8_t cols_T[] PROGMEM = {128, 128, 254, 128, 129};
-static const uint8_t cols_U[] PROGMEM = {252, 2, 2, 253};
-static const uint8_t cols_V[] PROGMEM = {248, 4, 2, 4, 249};
-static const uint8_t cols_W[] PROGMEM = {252, 2, 28, 2, 253};
-static const uint8_t cols_X[] PROGMEM = {198, 40, 16, 40, 199};
-static const uint8_t cols_Y[] PROGMEM = {224, 16, 14, 16, 225};
-static const uint8_t cols_Z[] PROGMEM = {134, 138, 146, 162, 195};
-
-/* Data for numbers 0 to 9 */
-static const uint8_t cols_0[] PROGMEM = {124, 146, 162, 125};
-static const uint8_t cols_1[] PROGMEM = {66, 254, 3};
-static const uint8_t cols_2[] PROGMEM = {70, 138, 146, 99};
-static const uint8_t cols_3[] PROGMEM = {68, 146, 146, 109};
-static const uint8_t cols_4[] PROGMEM = {24, 40, 72, 255};
-static const uint8_t cols_5[] PROGMEM = {228, 162, 162, 157};
-static const uint8_t cols_6[] PROGMEM = {124, 146, 146, 77};
-static const uint8_t cols_7[] PROGMEM = {128, 158, 160, 193};
-static const uint8_t cols_8[] PROGMEM = {108, 146, 146, 109};
-static const uint8_t cols_9[] PROGMEM = {100, 146, 146, 125};
-
-/* The following two arrays point to the font data above. 
- * We store pointers to the beginning of the column data
- * for each letter 
-*/
-static const uint8_t* const letters[26] PROGMEM = {
-		cols_A, cols_B, cols_C, cols_D, cols_E, cols_F,
-		cols_G, cols_H, cols_I, cols_J, cols_K, cols_L,
-		cols_M, cols_N, cols_O, cols_P, cols_Q, cols_R, 
-		cols_S, cols_T, cols_U, cols_V, cols_W, cols_X,
-		cols_Y, cols_Z };
-		
-static const uint8_t* const numbers[10] PROGMEM = {
-		cols_0, cols_1, cols_2, cols_3, cols_4, 
-		cols_5, cols_6, cols_7, cols_8, cols_9 };
+static const uint8_t font_columns[] PROGMEM = {
+	0, 0,	// ' '
+	250,	// '!'
+	192, 0, 192,	// '"'
+	40, 254, 40, 254, 40,	// '#'
+	96, 146, 254, 146, 12,	// '$'
+	196, 200, 16, 38, 70,	// '%'
+	108, 146, 170, 68, 10,	// '&'
+	192,	// '\''
+	124, 130,	// '('
+	130, 124,	// ')'
+	84, 56, 84,	// '*'
+	16, 56, 16,	// '+'
+	2, 4,	// ','
+	16, 16, 16,	// '-'
+	2,	// '.'
+	2, 12, 16, 96, 128,	// '/'
+	124, 146, 162, 124,	// '0'
+	66, 254, 2,	// '1'
+	70, 138, 146, 98,	// '2'
+	68, 146, 146, 108,	// '3'
+	24, 40, 72, 254,	// '4'
+	228, 162, 162, 156,	// '5'
+	124, 146, 146, 76,	// '6'
+	128, 158, 160, 192,	// '7'
+	108, 146, 146, 108,	// '8'
+	100, 146, 146, 124,	// '9'
+	36,	// ':'
+	2, 36,	// ';'
+	16, 40, 68,	// '<'
+	40, 40, 40,	// '='
+	68, 40, 16,	// '>'
+	64, 138, 144, 96,	// '?'
+	124, 130, 186, 170, 120,	// '@'
+	126, 144, 144, 126,	// 'A'
+	254, 146, 146, 108,	// 'B'
+	124, 130, 130, 68,	// 'C'
+	254, 130, 130, 124,	// 'D'
+	254, 146, 146, 130,	// 'E'
+	254, 144, 144, 128,	// 'F'
+	124, 130, 146, 92,	// 'G'
+	254, 16, 16, 254,	// 'H'
+	130, 254, 130,	// 'I'
+	4, 2, 2, 252,	// 'J'
+	254, 16, 40, 198,	// 'K'
+	254, 2, 2, 2,	// 'L'
+	254, 64, 48, 64, 254,	// 'M'
+	254, 32, 16, 254,	// 'N'
+	124, 130, 130, 124,	// 'O'
+	254, 144, 144, 96,	// 'P'
+	124, 130, 138, 124, 2,	// 'Q'
+	254, 144, 152, 102,	// 'R'
+	100, 146, 146, 76,	// 'S'
+	128, 128, 254, 128, 128,	// 'T'
+	252, 2, 2, 252,	// 'U'
+	248, 4, 2, 4, 248,	// 'V'
+	252, 2, 28, 2, 252,	// 'W'
+	198, 40, 16, 40, 198,	// 'X'
+	224, 16, 14, 16, 224,	// 'Y'
+	134, 138, 146, 162, 194,	// 'Z'
+	254, 130,	// '['
+	128, 96, 16, 12, 2,	// '\\'
+	130, 254,	// ']'
+	64, 128, 64,	// '^'
+	2, 2, 2,	// '_'
+};
+static const uint8_t font_offset[FONT_GLYPHS + 1] PROGMEM = {
+	0, 2, 3, 6, 11, 16, 21, 26,
+	27, 29, 31, 34, 37, 39, 42, 43,
+	48, 52, 55, 59, 63, 67, 71, 75,
+	79, 83, 87, 88, 90, 93, 96, 99,
+	103, 108, 112, 116, 120, 124, 128, 132,
+	136, 140, 143, 147, 151, 155, 160, 164,
+	168, 172, 177, 181, 185, 190, 194, 199,
+	204, 209, 214, 219, 221, 226, 228, 231,
+	234,
+};
+
+/* Columns of the message waiting to be shown (a ring - RING_SIZE must be
+ * a power of 2 and at least the width of the display). ring_start is the
+ * column at the left of the display and ring_fill is how many columns
+ * have been worked out from there - it is topped up to RING_SIZE after
+ * each step.
+ */
+#define RING_SIZE 32
+static uint8_t ring[RING_SIZE];
+static uint8_t ring_start;
+static uint8_t ring_fill;
+
+/* Where we are in the message (in program memory). next_char points to
+ * the next character to put in the ring, or is 0 at the end of the
+ * message; glyph_column and glyph_end are the columns of the current
+ * character (in font_columns[]) still to go in. A blank column goes in
+ * before each character.
+ */
+static const char* next_char = 0;
+static uint8_t glyph_column;
+static uint8_t glyph_end;
+static uint8_t lead_in;		// blank columns before the message
+
+/* Steps (of one column) left before the message has scrolled off */
+static uint16_t steps_left = 0;
 
 /* Keep track of the pixel colour to be used */
 static PixelColour colour = COLOUR_RED;
 
-/* Keep track of which column of data is next to be displayed. 
- * next_col_ptr points to that column, or is 0 if there is
- * no next column.
- */
-static volatile const uint8_t* next_col_ptr = 0;
+/* The rows the message is shown in */
+static uint8_t band_bottom = 0;
+static uint8_t band_height = MATRIX_NUM_ROWS;
 
-/* String to be displayed. 
- * next_char_to_display will be used to point to the next
- * character from this string to be displayed.
- */
-static char* display_string;
+/* Steps due - counted by the timer interrupt while scrolling is set */
+static volatile uint8_t scrolling;
+static volatile uint8_t steps_due;
+static volatile uint8_t period_left;
 
-static volatile char* next_char_to_display = 0;
+static uint8_t char_width(char c);
+static uint8_t next_column(void);
+static void fill_ring(void);
+static void draw_band(void);
 
 /*
  * Set the message to be displayed - we just copy the 
  * pointer not the string it points to, so it is important
  * that the original string not change after this function
  * is called while the string is still being displayed.
- * We reset the pointers to ensure the next column to be displayed
- * comes from the first character of this string.
+ * The message starts off the right hand side of the display and
+ * takes one step for each of its columns and the display's width.
  */
-void set_scrolling_display_text(char* string_to_display, PixelColour c) {
+void set_scrolling_display_text_P(const char* string_to_display, PixelColour c) {
+	uint16_t width = 0;
 	colour = c;
-	display_string = string_to_display;
-	next_col_ptr = 0;
-	next_char_to_display = 0;
+	for(const char* s = string_to_display; pgm_read_byte(s); s++) {
+		width += 1 + char_width(pgm_read_byte(s));
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		next_char = string_to_display;
+		glyph_column = glyph_end = 0;
+		lead_in = MATRIX_NUM_COLUMNS;
+		ring_start = 0;
+		ring_fill = 0;
+		steps_left = width + MATRIX_NUM_COLUMNS;
+		steps_due = 0;
+		period_left = SCROLL_PERIOD;
+		scrolling = 1;
+	}
+	fill_ring();
+}
+
+void set_scrolling_display_rows(uint8_t bottom, uint8_t height) {
+	if(bottom < MATRIX_NUM_ROWS && height >= 1 && bottom + height <= MATRIX_NUM_ROWS) {
+		band_bottom = bottom;
+		band_height = height;
+	}
 }
 
 /*
- * Scroll the display. Should be called whenever the display
- * is to be scrolled. 
- * Returns 1 if still scrolling display.
+ * Draw the steps which are due. Returns 1 if still scrolling display.
  */
 uint8_t scroll_display(void) {
-	static uint8_t shift_countdown = 0;
-	uint8_t i;
-	uint8_t col_data;
-	char next_char;
-	uint8_t finished = 0;
-
-	/* Data to be displayed in the next column - by 
-	 * default we show a blank column. Bit 7 of this
-	 * column data corresponds to row 7 of the display
-	 * etc.
-	 */
-	col_data = 0;
-
-	if(next_col_ptr) {
-		/* We're currently outputting a character and next_col_ptr
-		 * points to the display data for the next column. We
-		 * extract that data from program memory.
-		 */
-		col_data = pgm_read_byte(next_col_ptr);
-
-		if(col_data & 1) {
-			/* Least significant bit is set - this is the last
-			 * column of this character
-			 */
-			next_col_ptr = 0;
+	uint8_t steps;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		steps = steps_due;
+		steps_due = 0;
+	}
+	if(steps > steps_left) {
+		steps = steps_left;
+	}
+	if(steps == 0) {
+		return steps_left != 0;
+	}
+	steps_left -= steps;
+	if(steps_left == 0) {
+		scrolling = 0;
+	}
+	for(uint8_t i = 0; i < steps; i++) {
+		if(ring_fill) {
+			ring_start = (ring_start + 1) & (RING_SIZE - 1);
+			ring_fill--;
 		} else {
-			/* This is not the last column of this character - make
-			 * the pointer point to the data for the next column.
-			 */
-			next_col_ptr++;
+			// Behind by more than the ring - skip a column
+			(void)next_column();
 		}
-	} else if(next_char_to_display) {
-		/* We're not currently outputting a character, but we
-		 * do have more characters to display. We will output
-		 * a blank column this time (col_data value remains 0)
-		 * but we will set up our pointer (next_col_ptr) so that
-		 * it points to the data for the first column of dots for
-		 * the next character. We first get the next character to be 
-		 * displayed and advance our next character pointer 
-		 * (next_char_to_display) so that it points to the character 
-		 * after.
+	}
+	fill_ring();
+	
+	if(steps == 1 && band_bottom == 0 && band_height == MATRIX_NUM_ROWS) {
+		/* Shift the current display one pixel to the left and insert the 
+		 * new column data at column 15.
 		 */
-		next_char = *(next_char_to_display++);
-		if(next_char == 0) {
-			/* We reached the null character at the end of the string.
-			 * There is no next character, reset our pointer to 
-			 * the next character and set our countdown until the 
-			 * message disappears from the display.
-			 */
-			next_char_to_display = 0;
-			shift_countdown = 16;
-		} else if (next_char >= 'a' && next_char <= 'z') {
-			/* Character is a lower case letter - the next column to 
-			 * be displayed will be the first column of the letter
-			 * data for that letter
-			 */
-			next_col_ptr = (const uint8_t*)pgm_read_word(&letters[next_char - 'a']);
-		} else if (next_char >= 'A' && next_char <= 'Z') {
-			/* Upper case character */
-			next_col_ptr = (const uint8_t*)pgm_read_word(&letters[next_char - 'A']);
-		} else if (next_char >= '0' && next_char <= '9') {
-			/* Digit */
-			next_col_ptr = (const uint8_t*)pgm_read_word(&numbers[next_char - '0']);
+		uint8_t col_data = ring[(ring_start + MATRIX_NUM_COLUMNS - 1) & (RING_SIZE - 1)];
+		MatrixColumn column_colour_data;
+		ledmatrix_shift_display_left();
+		for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+			// If the relevant font bit is set, we colour this pixel, otherwise blank
+			column_colour_data[y] = ((col_data >> y) & 1) ? colour : COLOUR_BLACK;
 		}
+		ledmatrix_update_column(MATRIX_NUM_COLUMNS - 1, column_colour_data);
 	} else {
-		/* We're not outputting a column of dots and there is 
-		 * no next character. Move on to the string that we
-		 * have stored (if any).
-		 */
-		if(!display_string) {
-			/* May be finished - flag this and adjust below if we're still
-			 * showing pixels
-			 */
-			finished = 1;
-		}
-		next_char_to_display = display_string;
-		display_string = 0;
+		draw_band();
 	}
-	
-	/* Shift the current display one pixel to the left and insert the 
-	 * new column data at column 15.
-	 * Adjust our "finished" variable if we've finished scrolling the
-	 * message off the display
-	 */
-	ledmatrix_shift_display_left();
-	MatrixColumn column_colour_data;
-	for(i=7; i>=1; i--) {
-		// If the relevant font bit is set, we make this a red pixel, otherwise blank
-		if(col_data & 0x80) {
-			column_colour_data[i] = colour;
-		} else {
-			column_colour_data[i] = 0;
+	return steps_left != 0;
+}
+
+void scrolling_display_tick(void) {
+	if(scrolling && --period_left == 0) {
+		period_left = SCROLL_PERIOD;
+		if(steps_due < 0xFF) {
+			steps_due++;
 		}
-		col_data <<= 1;
 	}
-	column_colour_data[0] = 0;
-	ledmatrix_update_column(15, column_colour_data);
-	if(shift_countdown > 0) {
-		shift_countdown--;
+}
+
+// The number of columns of dots in a character
+static uint8_t char_width(char c) {
+	if(c >= 'a' && c <= 'z') {
+		c -= 'a' - 'A';
+	}
+	if(c < FONT_FIRST || c >= FONT_FIRST + FONT_GLYPHS) {
+		return 0;
+	}
+	c -= FONT_FIRST;
+	return pgm_read_byte(&font_offset[c + 1]) - pgm_read_byte(&font_offset[(uint8_t)c]);
+}
+
+// The next column of the message - blank once the message has all gone in
+static uint8_t next_column(void) {
+	char c;
+	if(lead_in) {
+		lead_in--;
+		return 0;
+	}
+	if(glyph_column != glyph_end) {
+		return pgm_read_byte(&font_columns[glyph_column++]);
+	}
+	if(!next_char) {
+		return 0;
+	}
+	c = pgm_read_byte(next_char++);
+	if(c == 0) {
+		next_char = 0;
+		return 0;
+	}
+	if(c >= 'a' && c <= 'z') {
+		c -= 'a' - 'A';
+	}
+	if(c >= FONT_FIRST && c < FONT_FIRST + FONT_GLYPHS) {
+		glyph_column = pgm_read_byte(&font_offset[c - FONT_FIRST]);
+		glyph_end = pgm_read_byte(&font_offset[c - FONT_FIRST + 1]);
+	}
+	// The blank column before the character
+	return 0;
+}
+
+// Work out columns until the ring is full
+static void fill_ring(void) {
+	while(ring_fill < RING_SIZE) {
+		ring[(ring_start + ring_fill) & (RING_SIZE - 1)] = next_column();
+		ring_fill++;
+	}
+}
+
+// Draw the band of rows the message is shown in. The top of the band is
+// the top of the font - if the band is less than 7 rows high the bottom
+// of the message is cut off.
+static void draw_band(void) {
+	MatrixRow row;
+	for(uint8_t y = band_bottom; y < band_bottom + band_height; y++) {
+		uint8_t bit = MATRIX_NUM_ROWS - (band_bottom + band_height - y);
+		for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+			uint8_t col_data = ring[(ring_start + x) & (RING_SIZE - 1)];
+			row[x] = ((col_data >> bit) & 1) ? colour : COLOUR_BLACK;
+		}
+		ledmatrix_update_row(y, row);
 	}
-	finished = finished && (shift_countdown == 0);
-	return !finished;
 }
@@ -10,8 +10,12 @@
 #include <stdint.h>
 #include "pixel_colour.h"
 
+/* Milliseconds between steps of one column */
+#define SCROLL_PERIOD 150
+
 /* Sets the text to be displayed and the colour it will be
- * scrolled with. The message will start displaying immediately
+ * scrolled with. The string must be in program memory, e.g.
+ * PSTR("...") (so that it doesn't take up RAM). The message will start displaying immediately
  * so will overwrite/interfere with any currently scrolling
  * message. To avoid this, wait until the scroll_display()
  * function below has returned 0 to indicate the message scrolling
@@ -20,15 +24,27 @@
  * after this function is called while the string is still
  * being displayed.
  */
-void set_scrolling_display_text(char* string, PixelColour colour);
+void set_scrolling_display_text_P(const char* string, PixelColour colour);
+
+/* Sets the rows the text is shown in - height rows from bottom up (the
+ * default is the whole display). The other rows are left alone. The
+ * font is 7 rows high and the top of the text is at the top of the rows
+ * - the bottom of it is cut off if there are fewer than 7.
+ */
+void set_scrolling_display_rows(uint8_t bottom, uint8_t height);
 
-/* Scroll the display. Should be called whenever the display
- * is to be scrolled one pixel to the left. It is recommended that
- * this function NOT be called from an interrupt service routine as
- * it will wait for SPI communication to be finished before returning. 
- * This could take over 1ms.
+/* Scroll the display by however many steps are due (one every
+ * SCROLL_PERIOD ms, counted by scrolling_display_tick()). Call it
+ * as often as you like from the main program - it returns straight away
+ * if no step is due. It should NOT be called from an interrupt service
+ * routine as it sends to the LED matrix.
  * Returns 1 while a message is still scrolling, 0 when done.
  */
 uint8_t scroll_display(void);
+
+/* Count the time to the next step - called every millisecond by the
+ * timer 0 interrupt handler.
+ */
+void scrolling_display_tick(void);
 	
-#endif /* SCROLLING_CHAR_DISPLAY_H_ */
\ No newline at end of file
+#endif /* SCROLLING_CHAR_DISPLAY_H_ */
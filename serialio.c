@@ -23,11 +23,11 @@
 #include <stdio.h>
 #include <stdint.h>
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
 
-/* System clock rate in Hz. (L at the end indicates this is a long constant) */
-#define SYSCLK 8000000L
+#include "serialio.h"
+#include "hal.h"
 
 /* Global variables */
 /* Circular buffer to hold outgoing characters. The insert_pos variable
@@ -47,9 +47,10 @@ volatile uint8_t out_insert_pos;
 volatile uint8_t bytes_in_out_buffer;
 
 /* Circular buffer to hold incoming characters. Works on same principle
- * as output buffer
+ * as output buffer. (64 bytes, paid for by moving constant data to flash,
+ * so that keys typed in a burst while the game is busy aren't lost.)
  */
-#define INPUT_BUFFER_SIZE 16
+#define INPUT_BUFFER_SIZE 64
 volatile char input_buffer[INPUT_BUFFER_SIZE];
 volatile uint8_t input_insert_pos;
 volatile uint8_t bytes_in_input_buffer;
@@ -66,14 +67,16 @@ void init_serial_stdio(long baudrate, int8_t echo);
 static int uart_put_char(char, FILE*);
 static int uart_get_char(FILE*);
 
+#ifndef HAL_NATIVE
 /* Setup a stream that uses the uart get and put functions. We will
- * make standard input and output use this stream below.
+ * make standard input and output use this stream below. (This is
+ * avr-libc's stdio - the host build uses serial_get_char() only.)
  */
 static FILE myStream = FDEV_SETUP_STREAM(uart_put_char, uart_get_char,
 		_FDEV_SETUP_RW);
+#endif
 
 void init_serial_stdio(long baudrate, int8_t echo) {
-	uint16_t ubrr;
 	/*
 	 * Initialise our buffers
 	*/
@@ -88,48 +91,135 @@ void init_serial_stdio(long baudrate, int8_t echo) {
 	*/
 	do_echo = echo;
 	
-	/* Configure the serial port baud rate */
-	/* (This differs from the datasheet formula so that we get 
-	 * rounding to the nearest integer while using integer division
-	 * (which truncates)).
-	*/
-	ubrr = ((SYSCLK / (8 * baudrate)) + 1)/2 - 1;
-	UBRR0 = ubrr;
-	
-	/*
-	 * Enable transmission and receiving via UART. We don't enable
-	 * the UDR empty interrupt here (we wait until we've got a
-	 * character to transmit).
+	/* Configure the baud rate and enable transmission, receiving and
+	 * the receive complete interrupt (see hal_uart_init()).
 	 * NOTE: Interrupts must be enabled globally for this
 	 * library to work, but we do not do this here.
 	*/
-	UCSR0B = (1<<RXEN0)|(1<<TXEN0);
-	
-	/*
-	 * Enable receive complete interrupt 
-	*/
-	UCSR0B  |= (1 <<RXCIE0);
+	hal_uart_init(baudrate);
 
+#ifndef HAL_NATIVE
 	/* Set up our stream so the put and get functions below are used 
 	 * to write/read characters via the serial port when we use
 	 * stdio functions
 	*/
 	stdout = &myStream;
 	stdin = &myStream;
+#endif
 }
 
 int8_t serial_input_available(void) {
+	hal_poll();
 	return (bytes_in_input_buffer != 0);
 }
 
+char serial_get_char(void) {
+	return uart_get_char(0);
+}
+
 void clear_serial_input_buffer(void) {
 	/* Just adjust our buffer data so it looks empty */
 	input_insert_pos = 0;
 	bytes_in_input_buffer = 0;
 }
 
+uint8_t serial_output_space(void) {
+	return OUTPUT_BUFFER_SIZE - bytes_in_out_buffer;
+}
+
+void serial_write_raw(const uint8_t* data, uint8_t length) {
+	/* Same buffer handling as uart_put_char() below, but for a whole
+	 * block of bytes at once and without waiting for space.
+	 */
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		while(length-- && bytes_in_out_buffer < OUTPUT_BUFFER_SIZE) {
+			out_buffer[out_insert_pos++] = *data++;
+			bytes_in_out_buffer++;
+			if(out_insert_pos == OUTPUT_BUFFER_SIZE) {
+				out_insert_pos = 0;
+			}
+		}
+		hal_uart_tx_interrupt(1);
+	}
+}
+
+void serial_put_char(char c) {
+	(void)uart_put_char(c, 0);
+}
+
+void serial_put_string_P(const char* string) {
+	char c;
+	while((c = pgm_read_byte(string++)) != 0) {
+		(void)uart_put_char(c, 0);
+	}
+}
+
+/* Decimal conversion is done by repeated subtraction of powers of ten
+ * rather than division - the AVR has no divide instruction and a 32 bit
+ * division loop costs several hundred cycles per digit. At most 9
+ * subtractions are needed per digit.
+ */
+static const uint16_t powers_of_ten_16[4] PROGMEM = {10000, 1000, 100, 10};
+static const uint32_t powers_of_ten_32[5] PROGMEM = {
+	1000000000, 100000000, 10000000, 1000000, 100000 };
+
+void serial_put_uint16(uint16_t value) {
+	uint8_t started = 0;
+	for(uint8_t i = 0; i < 4; i++) {
+		uint16_t power = pgm_read_word(&powers_of_ten_16[i]);
+		char digit = '0';
+		while(value >= power) {
+			value -= power;
+			digit++;
+		}
+		if(started || digit != '0') {
+			(void)uart_put_char(digit, 0);
+			started = 1;
+		}
+	}
+	(void)uart_put_char('0' + value, 0);
+}
+
+void serial_put_uint32(uint32_t value) {
+	uint8_t started = 0;
+	if(value <= 0xFFFF) {
+		serial_put_uint16(value);
+		return;
+	}
+	for(uint8_t i = 0; i < 5; i++) {
+		uint32_t power = pgm_read_dword(&powers_of_ten_32[i]);
+		char digit = '0';
+		while(value >= power) {
+			value -= power;
+			digit++;
+		}
+		if(started || digit != '0') {
+			(void)uart_put_char(digit, 0);
+			started = 1;
+		}
+	}
+	/* Remaining value is below 100000 - do the last five digits with
+	 * 16 bit arithmetic where possible. Leading zeros must be kept here.
+	 */
+	char digit = '0';
+	while(value >= 10000) {
+		value -= 10000;
+		digit++;
+	}
+	(void)uart_put_char(digit, 0);
+	for(uint8_t i = 1; i < 4; i++) {
+		uint16_t power = pgm_read_word(&powers_of_ten_16[i]);
+		digit = '0';
+		while((uint16_t)value >= power) {
+			value -= power;
+			digit++;
+		}
+		(void)uart_put_char(digit, 0);
+	}
+	(void)uart_put_char('0' + value, 0);
+}
+
 static int uart_put_char(char c, FILE* stream) {
-	uint8_t interrupts_enabled;
 	
 	/* Add the character to the buffer for transmission (if there 
 	 * is space to do so). If not we wait until the buffer has space.
@@ -147,12 +237,11 @@ static int uart_put_char(char c, FILE* stream) {
 	 * enough space. The bytes_in_buffer variable will get modified by the
 	 * ISR which extracts bytes from the buffer.
 	*/
-	interrupts_enabled = bit_is_set(SREG, SREG_I);
 	while(bytes_in_out_buffer >= OUTPUT_BUFFER_SIZE) {
-		if(!interrupts_enabled) {
+		if(!hal_interrupts_enabled()) {
 			return 1;
 		}		
-		/* else do nothing */
+		hal_poll();
 	}
 	
 	/* Add the character to the buffer for transmission if there
@@ -164,27 +253,25 @@ static int uart_put_char(char c, FILE* stream) {
 	 * We reenable them if they were enabled when we entered the
 	 * function.
 	*/	
-	cli();
-	out_buffer[out_insert_pos++] = c;
-	bytes_in_out_buffer++;
-	if(out_insert_pos == OUTPUT_BUFFER_SIZE) {
-		/* Wrap around buffer pointer if necessary */
-		out_insert_pos = 0;
-	}
-	/* Reenable interrupts (UDR Empty interrupt may have been
-	 * disabled) - we ensure it is now enabled so that it will
-	 * fire and deal with the next character in the buffer. */
-	UCSR0B |= (1 << UDRIE0);
-	if(interrupts_enabled) {
-		sei();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		out_buffer[out_insert_pos++] = c;
+		bytes_in_out_buffer++;
+		if(out_insert_pos == OUTPUT_BUFFER_SIZE) {
+			/* Wrap around buffer pointer if necessary */
+			out_insert_pos = 0;
+		}
+		/* Reenable interrupts (UDR Empty interrupt may have been
+		 * disabled) - we ensure it is now enabled so that it will
+		 * fire and deal with the next character in the buffer. */
+		hal_uart_tx_interrupt(1);
 	}
 	return 0;
 }
 
-int uart_get_char(FILE* stream) {
+static int uart_get_char(FILE* stream) {
 	/* Wait until we've received a character */
 	while(bytes_in_input_buffer == 0) {
-		/* do nothing */
+		hal_poll();
 	}
 	
 	/*
@@ -194,22 +281,19 @@ int uart_get_char(FILE* stream) {
 	 * characters before the insert position (taking into account
 	 * that we may need to wrap around).
 	 */
-	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
-	cli();
 	char c;
-	if(input_insert_pos - bytes_in_input_buffer < 0) {
-		/* Need to wrap around */
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer
-				+ INPUT_BUFFER_SIZE];
-	} else {
-		c = input_buffer[input_insert_pos - bytes_in_input_buffer];
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		if(input_insert_pos - bytes_in_input_buffer < 0) {
+			/* Need to wrap around */
+			c = input_buffer[input_insert_pos - bytes_in_input_buffer
+					+ INPUT_BUFFER_SIZE];
+		} else {
+			c = input_buffer[input_insert_pos - bytes_in_input_buffer];
+		}
+		
+		/* Decrement our count of bytes in the input buffer */
+		bytes_in_input_buffer--;
 	}
-	
-	/* Decrement our count of bytes in the input buffer */
-	bytes_in_input_buffer--;
-	if(interrupts_enabled) {
-		sei();
-	}	
 	return c;
 }
 
@@ -217,7 +301,7 @@ int uart_get_char(FILE* stream) {
  * Define the interrupt handler for UART Data Register Empty (i.e. 
  * another character can be taken from our buffer and written out)
  */
-ISR(USART0_UDRE_vect) 
+void serial_tx_interrupt(void)
 {
 	/* Check if we have data in our buffer */
 	if(bytes_in_out_buffer > 0) {
@@ -241,7 +325,7 @@ ISR(USART0_UDRE_vect)
 		bytes_in_out_buffer--;
 		
 		/* Output the character via the UART */
-		UDR0 = c;
+		hal_uart_write(c);
 	} else {
 		/* No data in the buffer. We disable the UART Data
 		 * Register Empty interrupt because otherwise it 
@@ -249,7 +333,7 @@ ISR(USART0_UDRE_vect)
 		 * The interrupt is reenabled when a character is
 		 * placed in the buffer.
 		 */
-		UCSR0B &= ~(1<<UDRIE0);
+		hal_uart_tx_interrupt(0);
 	}
 }
 
@@ -259,12 +343,9 @@ ISR(USART0_UDRE_vect)
  * the input buffer.
  */
 
-ISR(USART0_RX_vect) 
+void serial_rx_interrupt(char c)
 {
-	/* Read the character - we ignore the possibility of overrun. */
-	char c;
-	c = UDR0;
-		
+
 	if(do_echo && bytes_in_out_buffer < OUTPUT_BUFFER_SIZE) {
 		/* If echoing is enabled and there is output buffer
 		 * space, echo the received character back to the UART.
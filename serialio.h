@@ -27,13 +27,43 @@ void init_serial_stdio(long baudrate, int8_t echo);
 
 /* Test if input is available from the serial port. Return 0 if not,
  * non-zero otherwise. If there is input available then it can be read
- * with a suitable standard IO library function, e.g. fgetc().
+ * with serial_get_char() or a suitable standard IO library function,
+ * e.g. fgetc().
  */
 int8_t serial_input_available(void);
 
+/* Return the next character received, waiting for one if necessary.
+ * (The same as fgetc(stdin) but it works on the host build too.)
+ */
+char serial_get_char(void);
+
 /* Discard any input waiting to be read from the serial port. (Characters may
  * have been typed when we didn't want them - clear them.
  */
 void clear_serial_input_buffer(void);
 
+/* Return the number of characters that can currently be added to the
+ * output buffer without waiting.
+ */
+uint8_t serial_output_space(void);
+
+/* Add the given bytes to the output buffer exactly as they are (no
+ * newline translation). This does not go through the stdio stream and
+ * never blocks - the caller must check serial_output_space() first. Bytes
+ * that don't fit are discarded.
+ */
+void serial_write_raw(const uint8_t* data, uint8_t length);
+
+/* Lightweight output functions. These put characters straight into the
+ * output buffer (waiting for space if necessary, as for stdio output) and
+ * are much cheaper than printf()/printf_P() which go through vfprintf.
+ * '\n' is output as "\r\n" as it is for stdio output.
+ * serial_put_string_P() takes a string in program memory, e.g. PSTR("...")
+ * Numbers are output in decimal without leading zeros.
+ */
+void serial_put_char(char c);
+void serial_put_string_P(const char* string);
+void serial_put_uint16(uint16_t value);
+void serial_put_uint32(uint32_t value);
+
 #endif /* SERIALIO_H_ */
\ No newline at end of file
@@ -0,0 +1,60 @@
+/*
+ * seven_seg.c
+ *
+ * Interrupt driven two digit seven segment display.
+ */
+
+#include <avr/pgmspace.h>
+
+#include "seven_seg.h"
+#include "hal.h"
+
+// Segment patterns for digits 0 to 9
+static const uint8_t seven_seg_data[10] PROGMEM = {63,6,91,79,102,109,125,7,127,111};
+
+#define SEGMENT_DP 0x80
+
+/* Two buffers of segment data - [buffer][digit]. Digit 0 is the right hand
+ * digit, digit 1 the left. The interrupt handler only ever reads the
+ * buffer given by front_buffer. seven_seg_set() fills in the other buffer
+ * and then swaps them over (a single byte write, so it can't be seen half
+ * done by the interrupt handler).
+ */
+static volatile uint8_t digit_buffer[2][2];
+static volatile uint8_t front_buffer;
+static uint8_t displaycc = 0;
+
+void init_seven_seg(void) {
+	hal_seven_seg_init();
+	seven_seg_blank();
+}
+
+void seven_seg_set(uint8_t value, uint8_t decimal_points) {
+	uint8_t back = front_buffer ^ 1;
+	uint8_t tens = 0;
+	while(value >= 10) {
+		value -= 10;
+		tens++;
+	}
+	digit_buffer[back][0] = pgm_read_byte(&seven_seg_data[value]);
+	digit_buffer[back][1] = pgm_read_byte(&seven_seg_data[tens % 10]);
+	if(decimal_points & SEVEN_SEG_DP_RIGHT) {
+		digit_buffer[back][0] |= SEGMENT_DP;
+	}
+	if(decimal_points & SEVEN_SEG_DP_LEFT) {
+		digit_buffer[back][1] |= SEGMENT_DP;
+	}
+	front_buffer = back;
+}
+
+void seven_seg_blank(void) {
+	uint8_t back = front_buffer ^ 1;
+	digit_buffer[back][0] = 0;
+	digit_buffer[back][1] = 0;
+	front_buffer = back;
+}
+
+void seven_seg_multiplex(void) {
+	hal_seven_seg_write(displaycc, digit_buffer[front_buffer][displaycc]);
+	displaycc ^= 1;
+}
@@ -0,0 +1,35 @@
+/*
+ * seven_seg.h
+ *
+ * Two digit seven segment display. The segments (and decimal point on
+ * bit 7) are on port C and the digit select (CC) line is pin D2.
+ *
+ * The digits are multiplexed from the timer 0 interrupt (every
+ * millisecond) so the display stays bright and steady whatever the main
+ * loop is doing. The value shown is double buffered - setting a new value
+ * never shows half of the old one and half of the new.
+ */
+
+#ifndef SEVEN_SEG_H_
+#define SEVEN_SEG_H_
+
+#include <stdint.h>
+
+// Bits of the decimal point argument to seven_seg_set()
+#define SEVEN_SEG_DP_RIGHT 0x01
+#define SEVEN_SEG_DP_LEFT 0x02
+
+// Set up the port pins and blank the display
+void init_seven_seg(void);
+
+// Show the given value (0 to 99, both digits are always shown) with the
+// given decimal points turned on
+void seven_seg_set(uint8_t value, uint8_t decimal_points);
+
+// Turn all segments off
+void seven_seg_blank(void);
+
+// Show the next digit. This is called from the timer 0 interrupt handler.
+void seven_seg_multiplex(void);
+
+#endif /* SEVEN_SEG_H_ */
@@ -0,0 +1,86 @@
+/*
+ * step.c
+ *
+ * Stepping the game on a tick at a time - see step.h.
+ */
+
+#include <avr/pgmspace.h>
+
+#include "step.h"
+#include "game.h"
+#include "frame.h"
+#include "profile.h"
+
+// Ms between scrolls of each lane (0-2) and river channel (3-4) on
+// level 1. Higher means slower.
+static const uint16_t initial_speed[NUM_SCROLLING_ROWS] PROGMEM = {1300, 1250, 1200, 1150, 1100};
+static const int8_t scroll_direction[NUM_SCROLLING_ROWS] PROGMEM = {1, -1, 1, -1, 1};
+static uint16_t speed[NUM_SCROLLING_ROWS];
+static uint32_t next_scroll_time[NUM_SCROLLING_ROWS];
+
+void reset_speeds(void) {
+	for(uint8_t i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		speed[i] = pgm_read_word(&initial_speed[i]);
+	}
+}
+
+void speed_up(void) {
+	for(uint8_t i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		if(speed[i] > 2*LEVEL_SPEED_UP) {
+			speed[i] -= LEVEL_SPEED_UP;
+		}
+	}
+}
+
+void start_scrolling(uint32_t tick) {
+	for(uint8_t i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		next_scroll_time[i] = tick + speed[i];
+	}
+}
+
+uint8_t advance_game(uint32_t tick) {
+	set_game_tick(tick);
+	step_hazards();
+	if(!update_frogs()) {
+		return 0;
+	}
+	for(uint8_t i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		if(tick == next_scroll_time[i]) { //Move row at different speed
+			next_scroll_time[i] += speed[i];
+			frame_note(FRAME_SCROLL);
+			PROFILE_BEGIN();
+			if(i < 3) {
+				scroll_vehicle_lane(i, (int8_t)pgm_read_byte(&scroll_direction[i]));
+				PROFILE_END(PHASE_LANE + i);
+			} else {
+				scroll_river_channel(i - 3, (int8_t)pgm_read_byte(&scroll_direction[i]));
+				PROFILE_END(PHASE_LOG + i - 3);
+			}
+			if(!update_frogs()) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+uint32_t scroll_deadline(uint32_t deadline) {
+	for(uint8_t i = 0; i < NUM_SCROLLING_ROWS; i++) {
+		if((int32_t)(next_scroll_time[i] - deadline) < 0) {
+			deadline = next_scroll_time[i];
+		}
+	}
+	return deadline;
+}
+
+uint32_t* get_scroll_times(void) {
+	return next_scroll_time;
+}
+
+const uint16_t* get_scroll_periods(void) {
+	return speed;
+}
+
+const int8_t* get_scroll_directions(void) {
+	return scroll_direction;
+}
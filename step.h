@@ -0,0 +1,53 @@
+/*
+ * step.h
+ *
+ * Stepping the game on a millisecond tick at a time: the hazards step
+ * every tick and each lane of traffic and river channel scrolls every so
+ * many ticks, the same number for all levels until speed_up() takes some
+ * off for the next. The main loop (play_game() and the attract mode in
+ * project.c) and the host tools which play games without it (e.g.
+ * host/replay_check.c) all step through here, so a game goes the same in
+ * each - which ticks the moves are made on decide the rest.
+ *
+ * The scrolling rows are numbered as in game.h: 0 to 2 the lanes, 3 and 4
+ * the river channels.
+ */
+
+#ifndef STEP_H_
+#define STEP_H_
+
+#include <stdint.h>
+
+// Milliseconds taken off each scroll period a level (see speed_up())
+#define LEVEL_SPEED_UP 80
+
+// Go back to level 1's scroll periods
+void reset_speeds(void);
+
+// Each level the lanes and logs scroll faster - LEVEL_SPEED_UP ms less
+// between scrolls, until they are down to 2*LEVEL_SPEED_UP
+void speed_up(void);
+
+// Start each lane and log scrolling from the given tick - the first
+// scroll of each is its scroll period after it
+void start_scrolling(uint32_t tick);
+
+// Step the game on to the given tick (one after the last) - step the
+// hazards and scroll the lanes and logs which are due, dealing with frogs
+// dying (update_frogs() in game.h) after each. Returns 0 if the game or
+// level is over.
+uint8_t advance_game(uint32_t tick);
+
+// The earlier of the given deadline and the next scroll - when the main
+// loop next has something to do
+uint32_t scroll_deadline(uint32_t deadline);
+
+// The tick each row next scrolls on (can be changed - e.g. by a save
+// state being restored, see savestate.h), the ms between its scrolls and
+// the way it scrolls (-1 left, 1 right - in program memory), each
+// NUM_SCROLLING_ROWS (game.h) long
+uint32_t* get_scroll_times(void);
+const uint16_t* get_scroll_periods(void);
+const int8_t* get_scroll_directions(void);
+
+#endif /* STEP_H_ */
@@ -0,0 +1,217 @@
+/*
+ * telemetry.c
+ *
+ * Binary telemetry stream - see telemetry.h for the frame format.
+ */
+
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+#include "telemetry.h"
+#include "game.h"
+#include "serialio.h"
+#include "hal.h"
+
+#define KEYFRAME_FLAG 0x8000
+#define KEYFRAME_MASK 0x7FFF	// all 15 state bytes
+#define KEYFRAME_PERIOD 1000	// ms between keyframes
+
+static uint8_t enabled = 0;
+static uint8_t force_keyframe;
+static uint8_t sequence;
+static uint16_t min_period;	// ms between frames
+static uint32_t last_frame_time;
+static uint32_t last_keyframe_time;
+
+// State sent in the last frame - deltas are worked out against this
+static uint8_t last_state[TELEMETRY_STATE_SIZE];
+
+#if TELEMETRY_USART == 1
+/* Small circular buffer for USART1, same principle as the output buffer
+ * in serialio.c. Two frames fit.
+ */
+#define TX1_BUFFER_SIZE (2*TELEMETRY_FRAME_BYTES)
+static volatile uint8_t tx1_buffer[TX1_BUFFER_SIZE];
+static volatile uint8_t tx1_insert_pos;
+static volatile uint8_t bytes_in_tx1_buffer;
+#endif
+
+static void pack_state(uint8_t* packed);
+static uint8_t cobs_encode(const uint8_t* data, uint8_t length, uint8_t* encoded);
+static uint8_t output_space(void);
+static void output_bytes(const uint8_t* data, uint8_t length);
+
+void init_telemetry(long baudrate) {
+	/* Time taken to send the largest frame in ms, doubled so telemetry
+	 * uses no more than half of the link. Rounded up.
+	 */
+	min_period = ((TELEMETRY_FRAME_BYTES * 10L * 2 * 1000) + baudrate - 1) / baudrate;
+	enabled = 0;
+#if TELEMETRY_USART == 1
+	hal_uart1_init(baudrate);
+	tx1_insert_pos = 0;
+	bytes_in_tx1_buffer = 0;
+#endif
+}
+
+void toggle_telemetry(void) {
+	enabled = !enabled;
+	force_keyframe = 1;
+}
+
+uint8_t telemetry_enabled(void) {
+	return enabled;
+}
+
+void telemetry_tick(uint32_t current_time) {
+	uint8_t state[TELEMETRY_STATE_SIZE];
+	uint8_t frame[3 + TELEMETRY_STATE_SIZE + 2];
+	uint8_t encoded[TELEMETRY_FRAME_BYTES];
+	uint8_t length, i;
+	uint16_t mask, crc;
+
+	if(!enabled || (current_time - last_frame_time) < min_period) {
+		return;
+	}
+
+	pack_state(state);
+	if(force_keyframe || (current_time - last_keyframe_time) >= KEYFRAME_PERIOD) {
+		mask = KEYFRAME_FLAG | KEYFRAME_MASK;
+	} else {
+		mask = 0;
+		for(i = 0; i < TELEMETRY_STATE_SIZE; i++) {
+			if(state[i] != last_state[i]) {
+				mask |= (1<<i);
+			}
+		}
+		if(mask == 0) {
+			return; // Nothing changed this tick
+		}
+	}
+
+	// Build the frame - sequence number, mask, changed bytes then CRC
+	frame[0] = sequence;
+	frame[1] = mask & 0xFF;
+	frame[2] = mask >> 8;
+	length = 3;
+	for(i = 0; i < TELEMETRY_STATE_SIZE; i++) {
+		if(mask & (1<<i)) {
+			frame[length++] = state[i];
+		}
+	}
+	crc = 0xFFFF;
+	for(i = 0; i < length; i++) {
+		crc = _crc_ccitt_update(crc, frame[i]);
+	}
+	frame[length++] = crc & 0xFF;
+	frame[length++] = crc >> 8;
+
+	// Encode with a delimiter either side
+	encoded[0] = 0;
+	length = 1 + cobs_encode(frame, length, encoded + 1);
+	encoded[length++] = 0;
+
+	if(output_space() < length) {
+		// Link is busy - drop this frame. The changes will go in the next one.
+		return;
+	}
+	output_bytes(encoded, length);
+
+	for(i = 0; i < TELEMETRY_STATE_SIZE; i++) {
+		last_state[i] = state[i];
+	}
+	if(mask & KEYFRAME_FLAG) {
+		last_keyframe_time = current_time;
+		force_keyframe = 0;
+	}
+	last_frame_time = current_time;
+	sequence++;
+}
+
+// Pack the game state in the order given in telemetry.h
+static void pack_state(uint8_t* packed) {
+	GameState state;
+	get_game_state(&state);
+	packed[0] = state.frog_row;
+	packed[1] = state.frog_column;
+	packed[2] = state.lane_position[0];
+	packed[3] = state.lane_position[1];
+	packed[4] = state.lane_position[2];
+	packed[5] = state.log_position[0];
+	packed[6] = state.log_position[1];
+	packed[7] = state.riverbank_status & 0xFF;
+	packed[8] = state.riverbank_status >> 8;
+	packed[9] = state.score & 0xFF;
+	packed[10] = (state.score >> 8) & 0xFF;
+	packed[11] = (state.score >> 16) & 0xFF;
+	packed[12] = state.score >> 24;
+	packed[13] = state.time_died;
+	packed[14] = state.count;
+}
+
+/* Consistent Overhead Byte Stuffing. Removes all zero bytes from the data
+ * so that zero can be used as the frame delimiter. The encoded data is one
+ * byte longer than the original (for frames under 254 bytes). Returns the
+ * encoded length.
+ */
+static uint8_t cobs_encode(const uint8_t* data, uint8_t length, uint8_t* encoded) {
+	uint8_t code_pos = 0;	// where the current run length goes
+	uint8_t out_pos = 1;
+	uint8_t code = 1;
+	for(uint8_t i = 0; i < length; i++) {
+		if(data[i] == 0) {
+			encoded[code_pos] = code;
+			code_pos = out_pos++;
+			code = 1;
+		} else {
+			encoded[out_pos++] = data[i];
+			code++;
+		}
+	}
+	encoded[code_pos] = code;
+	return out_pos;
+}
+
+#if TELEMETRY_USART == 1
+
+static uint8_t output_space(void) {
+	return TX1_BUFFER_SIZE - bytes_in_tx1_buffer;
+}
+
+static void output_bytes(const uint8_t* data, uint8_t length) {
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		while(length--) {
+			tx1_buffer[tx1_insert_pos++] = *data++;
+			bytes_in_tx1_buffer++;
+			if(tx1_insert_pos == TX1_BUFFER_SIZE) {
+				tx1_insert_pos = 0;
+			}
+		}
+		hal_uart1_tx_interrupt(1);
+	}
+}
+
+void telemetry_tx_interrupt(void) {
+	if(bytes_in_tx1_buffer > 0) {
+		if(tx1_insert_pos < bytes_in_tx1_buffer) {
+			hal_uart1_write(tx1_buffer[tx1_insert_pos - bytes_in_tx1_buffer + TX1_BUFFER_SIZE]);
+		} else {
+			hal_uart1_write(tx1_buffer[tx1_insert_pos - bytes_in_tx1_buffer]);
+		}
+		bytes_in_tx1_buffer--;
+	} else {
+		hal_uart1_tx_interrupt(0);
+	}
+}
+
+#else
+
+static uint8_t output_space(void) {
+	return serial_output_space();
+}
+
+static void output_bytes(const uint8_t* data, uint8_t length) {
+	serial_write_raw(data, length);
+}
+
+#endif
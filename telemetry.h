@@ -0,0 +1,69 @@
+/*
+ * telemetry.h
+ *
+ * Optional binary telemetry stream of the game state for offline analysis.
+ * When enabled, a frame is sent each game tick (rate limited - see below)
+ * containing the bytes of the packed game state that changed since the
+ * previous frame. A keyframe with the whole state is sent when telemetry
+ * is turned on and then once a second so a decoder can (re)synchronise.
+ * host/telemetry_decode.c turns the stream back into one line per tick.
+ *
+ * Packed state (15 bytes, multi-byte values are sent LSB first):
+ *   0      frog_row
+ *   1      frog_column
+ *   2-4    lane_position[0..2]
+ *   5-6    log_position[0..1]
+ *   7-8    riverbank_status
+ *   9-12   score
+ *   13     time_died
+ *   14     count (countdown value)
+ *
+ * Frame (before encoding):
+ *   seq    1 byte, incremented for every frame sent
+ *   mask   2 bytes, bit i set if byte i of the packed state follows.
+ *          Bit 15 is set for a keyframe (all 15 state bytes follow).
+ *   data   0 to 15 bytes, the changed state bytes in order
+ *   crc    2 bytes, CRC-16/CCITT of seq, mask and data as computed by
+ *          avr-libc _crc_ccitt_update() starting from 0xFFFF
+ * The frame is COBS encoded and sent with a 0x00 byte before and after it,
+ * so terminal text sent on the same USART is never mistaken for a frame.
+ *
+ * Bandwidth: the largest frame is 1+2+15+2 = 20 bytes, 21 once COBS encoded,
+ * 23 with the delimiters, i.e. 230 bits on the wire (8N1). Telemetry is
+ * allowed at most half of the link so the terminal still gets through:
+ *   19200 baud  - one frame every 24 ms at most (~41 frames per second)
+ *   115200 baud - one frame every 4 ms at most (250 frames per second)
+ * The period is worked out from the baud rate in init_telemetry() and
+ * frames are dropped (never queued) if the output buffer can't take them.
+ *
+ * Frames go out on USART0 (shared with the terminal) unless TELEMETRY_USART
+ * is defined as 1. USART1 uses PD3 (TXD1) which is the buzzer enable switch
+ * input on the standard board, so that switch must be moved first.
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+
+#ifndef TELEMETRY_USART
+#define TELEMETRY_USART 0
+#endif
+
+#define TELEMETRY_STATE_SIZE 15
+#define TELEMETRY_FRAME_BYTES 23	// worst case on the wire, with delimiters
+
+// Set up telemetry (initially off). baudrate is the rate of the USART the
+// frames go out on - the serial terminal rate for USART0.
+void init_telemetry(long baudrate);
+
+// Turn telemetry on or off. Turning it on starts with a keyframe.
+void toggle_telemetry(void);
+uint8_t telemetry_enabled(void);
+
+// Send a frame for the current tick if telemetry is on, the minimum period
+// has passed and there is something to send. current_time is the game clock
+// (milliseconds).
+void telemetry_tick(uint32_t current_time);
+
+#endif /* TELEMETRY_H_ */
@@ -10,54 +10,93 @@
 #include <avr/pgmspace.h>
 
 #include "terminalio.h"
+#include "serialio.h"
 #include "score.h" 
+#include "game.h"
 int level = 0;
+
+/* All output goes through the lightweight functions in serialio.c rather
+ * than printf_P() - escape sequences are sent on every score update so
+ * they need to be cheap.
+ */
 void move_cursor(int x, int y) {
-	printf_P(PSTR("\x1b[%d;%dH"), y, x);
+	serial_put_string_P(PSTR("\x1b["));
+	serial_put_uint16(y);
+	serial_put_char(';');
+	serial_put_uint16(x);
+	serial_put_char('H');
 }
 
 void normal_display_mode(void) {
-	printf_P(PSTR("\x1b[0m"));
+	serial_put_string_P(PSTR("\x1b[0m"));
 }
 
 void reverse_video(void) {
-	printf_P(PSTR("\x1b[7m"));
+	serial_put_string_P(PSTR("\x1b[7m"));
 }
 
 void clear_terminal(void) {
-	printf_P(PSTR("\x1b[2J"));
+	serial_put_string_P(PSTR("\x1b[2J"));
 }
 
 void clear_to_end_of_line(void) {
-	printf_P(PSTR("\x1b[K"));
+	serial_put_string_P(PSTR("\x1b[K"));
 }
 
 void set_display_attribute(DisplayParameter parameter) {
-	printf_P(PSTR("\x1b[%dm"), parameter);
+	serial_put_string_P(PSTR("\x1b["));
+	serial_put_uint16(parameter);
+	serial_put_char('m');
 }
 
 void hide_cursor() {
-	printf_P(PSTR("\x1b[?25l"));
+	serial_put_string_P(PSTR("\x1b[?25l"));
 }
 
 void show_cursor() {
-	printf_P(PSTR("\x1b[?25h"));
+	serial_put_string_P(PSTR("\x1b[?25h"));
 }
 
 void enable_scrolling_for_whole_display(void) {
-	printf_P(PSTR("\x1b[r"));
+	serial_put_string_P(PSTR("\x1b[r"));
 }
 
 void set_scroll_region(int8_t y1, int8_t y2) {
-	printf_P(PSTR("\x1b[%d;%dr"), y1, y2);
+	serial_put_string_P(PSTR("\x1b["));
+	serial_put_uint16(y1);
+	serial_put_char(';');
+	serial_put_uint16(y2);
+	serial_put_char('r');
 }
 
 void scroll_down(void) {
-	printf_P(PSTR("\x1bM"));	// ESC-M
+	serial_put_string_P(PSTR("\x1bM"));	// ESC-M
 }
 
 void scroll_up(void) {
-	printf_P(PSTR("\x1b\x44"));	// ESC-D
+	serial_put_string_P(PSTR("\x1b\x44"));	// ESC-D
+}
+
+char read_escape_sequence(uint8_t* characters_into_escape_sequence, char c,
+		char* escape_char) {
+	if(*characters_into_escape_sequence == 0 && c == ESCAPE_CHAR) {
+		// We've hit the first character in an escape sequence (escape)
+		(*characters_into_escape_sequence)++;
+		return -1;
+	} else if(*characters_into_escape_sequence == 1 && c == '[') {
+		// We've hit the second character in an escape sequence
+		(*characters_into_escape_sequence)++;
+		return -1;
+	} else if(*characters_into_escape_sequence == 2) {
+		// Third (and last) character in the escape sequence
+		*escape_char = c;
+		*characters_into_escape_sequence = 0;
+		return -1;
+	}
+	// Character was not part of an escape sequence (or we received an
+	// invalid second character in the sequence)
+	*characters_into_escape_sequence = 0;
+	return c;
 }
 
 void draw_horizontal_line(int8_t y, int8_t start_x, int8_t end_x) {
@@ -65,10 +104,7 @@ void draw_horizontal_line(int8_t y, int8_t start_x, int8_t end_x) {
 	move_cursor(start_x, y);
 	reverse_video();
 	for(i=start_x; i <= end_x; i++) {
-		printf(" ");	/* No need to use printf_P - printing
-		* a single character gets optimised
-		* to a putchar call
-		*/
+		serial_put_char(' ');
 	}
 	normal_display_mode();
 }
@@ -78,41 +114,44 @@ void draw_vertical_line(int8_t x, int8_t start_y, int8_t end_y) {
 	move_cursor(x, start_y);
 	reverse_video();
 	for(i=start_y; i < end_y; i++) {
-		printf(" ");
+		serial_put_char(' ');
 		/* Move down one and back to the left one */
-		printf_P(PSTR("\x1b[B\x1b[D"));
+		serial_put_string_P(PSTR("\x1b[B\x1b[D"));
 	}
-	printf(" ");
+	serial_put_char(' ');
 	normal_display_mode();
 }
 
 void show_high(void){ //high scores
 	move_cursor(10,15);
-	printf("HIGH SCORES:");
+	serial_put_string_P(PSTR("HIGH SCORES:"));
 	move_cursor(10,17);
 	uint32_t *score = get_score_collect();
 	//char name[5][11] = get_name_collect();
 	for(int i = 0; i<5;i++){
-		printf("%" PRIu32 "\n\t ",*(score+i));
+		serial_put_uint32(*(score+i));
+		serial_put_string_P(PSTR("\n\t "));
 		//printf("%s", get_name_collect()[i]); Display names (not working)
 	}
 	
 
 }
 
-void show_score(void){ //update the score on screen
-	move_cursor(75,12);
-	clear_to_end_of_line();
-	if(get_score()<10){
-		move_cursor(78,12);
-		}else if(get_score()<100){
-		move_cursor(77,12);
-		}else{
-		move_cursor(76,12);
+void show_score(void){ //update the score on screen - player 2's (if playing) is two rows below player 1's
+	for(uint8_t player = 0; player < get_number_of_frogs(); player++){
+		uint32_t score = get_score(player);
+		int y = 12 + 2*player;
+		move_cursor(75,y);
+		clear_to_end_of_line();
+		if(score<10){
+			move_cursor(78,y);
+			}else if(score<100){
+			move_cursor(77,y);
+			}else{
+			move_cursor(76,y);
+		}
+		serial_put_uint32(score);
 	}
-	printf("%lu",get_score());
-	
-
 }
 
 void show_level(void){ //which level are we on
@@ -120,10 +159,16 @@ void show_level(void){ //which level are we on
 	move_cursor(75,13);
 	clear_to_end_of_line();
 	move_cursor(78,13);
-	printf("%d",level);
+	serial_put_uint16(level);
 	
 }
 void reset_level(void){ //if game over then reset level back to first level
 	level = 0;
 }
+int get_level(void){
+	return level;
+}
+void set_level(int new_level){
+	level = new_level;
+}
 
@@ -83,8 +83,22 @@ void scroll_up(void);
 void show_score(void);
 void show_level(void);
 void reset_level(void);
+// The level number shown, and setting it (show_level() shows the next one)
+int get_level(void);
+void set_level(int new_level);
 void show_high(void);
 
+// Escape sequences typed on the terminal, e.g. ESC [ D for the left cursor
+// key. Give each character received to read_escape_sequence() along with
+// a byte (0 to start with) it keeps its place in. It returns the character
+// if it isn't part of an escape sequence, otherwise -1 - and for the last
+// character of one, sets *escape_char to it (e.g. 'D'). An ESC or ESC [
+// followed by something else gives that something else as a character.
+// Only the given byte is used, so it can be checked on its own.
+#define ESCAPE_CHAR 27
+char read_escape_sequence(uint8_t* characters_into_escape_sequence, char c,
+		char* escape_char);
+
 // Draw a reverse video line on the terminal. startx must be <= endx.
 // starty must be <= endy
 void draw_horizontal_line(int8_t y, int8_t startx, int8_t endx);
@@ -6,230 +6,276 @@
 * We setup timer0 to generate an interrupt every 1ms
 * We update a global clock tick variable - whose value
 * can be retrieved using the get_clock_ticks() function.
+*
+* This is the only timebase in the program. The game clock
+* (get_current_time()) is the same clock with the time spent
+* paused taken off, and the round countdown is a deadline on
+* the game clock - so pausing freezes both. Timer 1 is not used.
 */
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
+#include <util/atomic.h>
 
 
 #include "timer0.h"
+#include "seven_seg.h"
+#include "scrolling_char_display.h"
+#include "hal.h"
 
 /* Our internal clock tick count - incremented every
-* millisecond. Will overflow every ~49 days. */
-static volatile uint32_t clockTicks;
+* millisecond. The low 16 bits are the fast tick - they can be read
+* with interrupts off for just two instructions. The high 16 bits
+* extend it so the full count overflows every ~49 days. */
+static volatile uint16_t clockTicks;
+static volatile uint16_t clockTicksHigh;
 volatile uint8_t pause_game;
-volatile uint8_t displaycc = 0;
-volatile uint16_t count = 15;
-uint8_t seven_seg_data[10] = {63,6,91,79,102,109,125,7,127,111};
 
-static uint8_t flag = 0; //Is the timer less than 1? To show miliseconds. 0 == No
+/* Game clock. Time spent paused is added up in paused_time so the game clock
+* is the millisecond clock minus paused_time. While paused it stays at the
+* time the pause started. */
+static uint32_t paused_time;
+static uint32_t pause_started;
+
+/* Round countdown. The count shown starts at 15 and goes down by one every
+* COUNT_STEP ms until it reaches 1, then it shows tenths (0.9 to 0.0) going
+* down every COUNT_TENTH ms. (These are the rates timer 1 used to run at.)
+* The frog dies when the game clock reaches count_deadline. */
+#define COUNT_START 15
+#define COUNT_STEP 1280
+#define COUNT_TENTH 80
+#define COUNT_TENTHS_TIME (9*COUNT_TENTH)
+#define ROUND_TIME ((COUNT_START-1)*COUNT_STEP + COUNT_TENTHS_TIME)
+static volatile uint32_t count_deadline;
+static volatile uint8_t count_running = 0;
+static volatile uint8_t count_deferred = 0;
+static uint8_t count_shown = 0xFF;
 
-#define F_CPU 8000000L
-#include <util/delay.h>
+/* The countdown display is brought up to date every COUNT_REFRESH ms from
+* the timer interrupt (must be a power of 2) */
+#define COUNT_REFRESH 16
+
+static uint16_t get_fast_ticks(void);
+static uint32_t game_time(uint16_t high, uint16_t low);
+static uint16_t count_from_time(uint32_t now);
+static void show_count(uint32_t now);
 
 ///BUZZER
 uint16_t freq = 200;	// Hz
 float dutycycle = 2;	// %
 uint16_t clockperiod;
 uint16_t pulsewidth;
+/* A noise lasts NOISE_TIME ms - the timer interrupt handler turns the
+* buzzer off when noise_left gets to 0 */
+#define NOISE_TIME 600
+static volatile uint16_t noise_left;
 
 
-/* Set up timer 0 to generate an interrupt every 1ms.
-* We will divide the clock by 64 and count up to 124.
-* We will therefore get an interrupt every 64 x 125
-* clock cycles, i.e. every 1 milliseconds with an 8MHz
-* clock.
-* The counter will be reset to 0 when it reaches it's
-* output compare value.
+/* Set up timer 0 to generate an interrupt every 1ms (see hal_clock_init())
+* and the buzzer PWM.
 */
 void init_timer0(void) {
-	/* Reset clock tick count. L indicates a long (32 bit)
-	* constant.
-	*/
-	clockTicks = 0L;
-	
-	/* Clear the timer */
-	TCNT0 = 0;
-
-	/* Set the output compare value to be 124 */
-	OCR0A = 124;
-	
-	/* Set the timer to clear on compare match (CTC mode)
-	* and to divide the clock by 64. This starts the timer
-	* running.
-	*/
-	TCCR0A = (1<<WGM01);
-	TCCR0B = (1<<CS01)|(1<<CS00);
-
-	/* Enable an interrupt on output compare match.
-	* Note that interrupts have to be enabled globally
-	* before the interrupts will fire.
-	*/
-	TIMSK0 |= (1<<OCIE0A);
+	/* Reset clock tick count and the game clock */
+	clockTicks = 0;
+	clockTicksHigh = 0;
+	paused_time = 0;
 	
-	/* Make sure the interrupt flag is cleared by writing a
-	* 1 to it.
-	*/
-	TIFR0 &= (1<<OCF0A);
+	hal_clock_init();
 
 	//Buzzer
 	clockperiod = (1000000UL / freq);
 	pulsewidth = (dutycycle * clockperiod) / 100;
-
-	// Set the maximum count value for timer/counter 1 to be one less than the clockperiod
-	OCR2A = clockperiod - 1;
+	hal_buzzer_set(clockperiod, pulsewidth);
+	hal_buzzer_init();
 	
-	// Set the count compare value based on the pulse width. The value will be 1 less
-	// than the pulse width - unless the pulse width is 0.
-	if(pulsewidth == 0) {
-		OCR2B = 0;
-		} else {
-		OCR2B = pulsewidth - 1;
+}
+
+/* The fast tick is read with interrupts off so the interrupt can't fire
+* when we've copied just one of its two bytes. */
+static uint16_t get_fast_ticks(void) {
+	uint16_t ticks;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		ticks = clockTicks;
 	}
-	
-	// Set up timer/counter 1 for Fast PWM, counting from 0 to the value in OCR1A
-	// before reseting to 0. Count at 1MHz (CLK/8).
-	// Configure output OC1B to be clear on compare match and set on timer/counter
-	// overflow (non-inverting mode).
-	TCCR2A = (1<<COM2A1)|(0<<COM2A0)|(1 << COM0B1) | (0 <<COM0B0)| (1 <<WGM21) | (1 << WGM20);
-	TCCR2B = (1 << WGM22) | (0 << CS22) | (1 << CS21) | (0 << CS20);
-	
+	return ticks;
 }
 
-uint32_t get_current_time(void) {
-	uint32_t returnValue;
+uint32_t get_monotonic_time(void) {
+	uint16_t high, low;
+	hal_poll();
+	/* If the fast tick wraps between reading the two halves the high
+	* half will have changed - just read them again. */
+	do {
+		high = clockTicksHigh;
+		low = get_fast_ticks();
+	} while(high != clockTicksHigh);
+	return ((uint32_t)high << 16) | low;
+}
 
-	/* Disable interrupts so we can be sure that the interrupt
-	* doesn't fire when we've copied just a couple of bytes
-	* of the value. Interrupts are re-enabled if they were
-	* enabled at the start.
-	*/
-	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
-	cli();
-	returnValue = clockTicks;
-	if(interruptsOn) {
-		sei();
+uint16_t get_fine_time(void) {
+	uint16_t ticks;
+	uint8_t counter, pending;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		ticks = clockTicks;
+		counter = hal_clock_count(&pending);
+		/* The timer may have just matched but the interrupt not run yet */
+		ticks += pending;
 	}
-	return returnValue;
+	return ticks*125 + counter;
 }
 
-void pause(void){ //Stop all game function
-	pause_game = 1;
+static uint32_t game_time(uint16_t high, uint16_t low) {
+	if(pause_game) {
+		return pause_started - paused_time;
+	}
+	return (((uint32_t)high << 16) | low) - paused_time;
 }
-void unpause(void){ //resume all game function from the point of stopping
-	pause_game = 0;
+
+uint32_t get_current_time(void) {
+	uint32_t now = get_monotonic_time();
+	return game_time(now >> 16, now & 0xFFFF);
+}
+
+void pause_clock(void){ //Stop all game function
+	if(!pause_game) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			pause_started = get_monotonic_time();
+			pause_game = 1;
+		}
+	}
+}
+void unpause_clock(void){ //resume all game function from the point of stopping
+	if(pause_game) {
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			paused_time += get_monotonic_time() - pause_started;
+			pause_game = 0;
+		}
+	}
 }
 
-ISR(TIMER0_COMPA_vect) {
+void timer0_interrupt(void) {
 	/* Increment our clock tick count */
-	if(!pause_game){
-		clockTicks++;
+	if(++clockTicks == 0) {
+		clockTicksHigh++;
+	}
+	/* Multiplex the seven segment display - one digit each millisecond */
+	seven_seg_multiplex();
+	scrolling_display_tick();
+	if(noise_left && --noise_left == 0) {
+		hal_buzzer_enable(0);
+	}
+	if(count_running && !count_deferred && (clockTicks & (COUNT_REFRESH-1)) == 0) {
+		show_count(game_time(clockTicksHigh, clockTicks));
 	}
-	
 }
 
-void game_count(void){
-	//SET UP FOR 7 display
+void defer_count(uint8_t defer){
+	count_deferred = defer;
+}
 
-	DDRC |= 0xFF;
-	DDRD |= 0x04;
+void game_count(void){ //Start the round countdown
+	reset_count();
+	count_running = 1;
+}
 
-	OCR1A = 9999; /* Clock divided by 8 - count for 10000 cycles */
-	TCCR1A = 0; /* CTC mode */
-	TCCR1B = (1<<WGM12)|(1<<CS12)|(1<<CS10); /* Divide clock by 256 */
+void stop_count(void){
+	// The timer interrupt handler also updates the display
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		count_running = 0;
+		count_shown = 0xFF;
+		seven_seg_blank();
+	}
+}
 
-	///* Enable interrupt on timer on output compare match
-	//*/
-	TIMSK1 = (1<<OCIE1A);
+// Work out the count to show from the time left before the deadline
+static uint16_t count_from_time(uint32_t now){
+	int32_t remaining = count_deadline - now;
+	if(remaining <= 0){
+		return 0;
+	}
+	if(remaining <= COUNT_TENTHS_TIME){ //Less than 1 - tenths
+		return ((uint16_t)remaining + COUNT_TENTH - 1) / COUNT_TENTH;
+	}
+	return 2 + ((uint16_t)remaining - COUNT_TENTHS_TIME - 1) / COUNT_STEP;
+}
+
+// Put the current count on the seven segment display if it has changed.
+// The display is refreshed by the timer 0 interrupt handler.
+static void show_count(uint32_t now){
+	uint8_t value = count_from_time(now);
+	if(value != count_shown){
+		count_shown = value;
+		if(count_deadline - now > COUNT_TENTHS_TIME){ //Whole seconds - show both digits
+			seven_seg_set(value, 0);
+			}else{ //Less than 1 second - show 0.x
+			seven_seg_set(value, SEVEN_SEG_DP_LEFT);
+		}
+	}
+}
 
-	/* Ensure interrupt flag is cleared */
-	TIFR1 = (1<<OCF1A);
+void reset_count(void){
+	reset_count_at(get_current_time());
+}
 
+void reset_count_at(uint32_t now){
+	// The timer interrupt handler also updates the display
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		count_deadline = now + ROUND_TIME;
+		show_count(now);
+	}
+}
 
-	///* Turn on global interrupts */
-	sei();
+uint16_t get_count(void){
+	return get_count_at(get_current_time());
 }
 
-void show_count(void){
-	if(!flag){ //Is it  less than 1 second? flag = 1 == yes it is less than 1 second. Show 0.x on display.
-		if(displaycc == 0) {
-			/* Display rightmost digit - tenths of seconds */
-			PORTC = seven_seg_data[count%10];
-			PORTD = 0x00;
-			
-			} else {
-			/* Display leftmost digit - seconds + decimal point */
-			PORTC = seven_seg_data[count/10];
-			PORTD = 0x04;
-		}
-		}else{ // No timer is more than 1 second.
-		if(displaycc == 0) {
-			/* Display rightmost digit - tenths of seconds */
-			PORTC = seven_seg_data[count%10];
-			PORTD = 0x00;
-			
-			} else {
-			/* Display leftmost digit - seconds + decimal point */
-			PORTC = seven_seg_data[0]|0b10000000;
-			PORTD = 0x04;
-		}
+uint16_t get_count_at(uint32_t now){
+	// count_deadline is only changed here in the main program so it
+	// doesn't need to be read with interrupts off
+	if(!count_running){
+		return COUNT_START;
 	}
-	
-	displaycc = 1 ^ displaycc;
-	/* Output the digit selection (CC) bit */
+	return count_from_time(now);
 }
 
-void reset_count(void){ 
-	count = 15;
+uint8_t count_expired_at(uint32_t now){
+	return count_running && (int32_t)(now - count_deadline) >= 0;
 }
 
-uint16_t get_count(void){
-	return count;
+uint16_t get_count_left_at(uint32_t now){
+	int32_t remaining = count_deadline - now;
+	return remaining > 0 ? remaining : 0;
 }
 
-ISR(TIMER1_COMPA_vect) {
-	if(!pause_game){
-		count--;
-		if((count == 1) && (!flag)){ //Display milliseconds
-			TCCR1B = (1<<WGM12)|(1<<CS11)|(1<<CS10);
-			flag = 1;
-			count = 9;
-		}
-		else if(count<=0){ //Display seconds
-			TCCR1B = (1<<WGM12)|(1<<CS12)|(1<<CS10);
-			flag = 0;
-		}
+void set_count_left_at(uint32_t now, uint16_t left){
+	if(left > ROUND_TIME){
+		left = ROUND_TIME;
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		count_deadline = now + left;
+		show_count(now);
 	}
 }
 
 void make_noise(uint16_t tone){ //Make noise for buzzer. Parameter is frequency.
-	for(int i =0; i < 3; i++){
-		if(PIND & 0x08) {
-			DDRD |= (1<<6);
-			freq = tone;
-		}
-		if(PINA & 0x01) {
-			dutycycle = 40;
-			}else{
-			dutycycle = 2.3;
-		}
-		
-		// Work out the clock period and pulse width
-		clockperiod = (1000000UL / freq);
-		pulsewidth = (dutycycle * clockperiod) / 100;
-		
-		// Update the PWM registers
-		if(pulsewidth > 0) {
-			// The compare value is one less than the number of clock cycles in the pulse width
-			OCR2B = pulsewidth - 1;
-			} else {
-			OCR2B = 0;
-		}
-		// Set the maximum count value for timer/counter 1 to be one less than the clockperiod
-		OCR2A = clockperiod - 1;
-		_delay_ms(200);
+	uint8_t switches = hal_switches_read();
+	if(switches & HAL_SWITCH_SOUND) {
+		hal_buzzer_enable(1);
+		freq = tone;
+	}
+	if(switches & HAL_SWITCH_VOLUME) {
+		dutycycle = 40;
+		}else{
+		dutycycle = 2.3;
+	}
+	
+	// Work out the clock period and pulse width
+	clockperiod = (1000000UL / freq);
+	pulsewidth = (dutycycle * clockperiod) / 100;
+	
+	// Update the PWM. The noise stops by itself - we don't wait for it.
+	hal_buzzer_set(clockperiod, pulsewidth);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		noise_left = NOISE_TIME;
 	}
-	DDRD &= 0xBF;
 }
 
 
@@ -25,16 +25,56 @@
  */
 void init_timer0(void);
 
-/* Return the current clock tick value - milliseconds since the timer was
- * initialised.
+/* Return the current game clock value - milliseconds since the timer was
+ * initialised, not counting time spent paused.
  */
 uint32_t get_current_time(void);
+
+/* Return milliseconds since the timer was initialised, including time
+ * spent paused.
+ */
+uint32_t get_monotonic_time(void);
+
+/* Return a fine grained timestamp in units of 8 microseconds (one timer 0
+ * count). This wraps around every 524ms so is only useful for measuring
+ * short intervals.
+ */
+uint16_t get_fine_time(void);
+
+/* Round countdown. game_count() starts it, reset_count() starts it again
+ * from the top, stop_count() stops it and blanks the seven segment display
+ * and get_count() returns the value shown on the display (0 when time has
+ * run out). It is a deadline on the game clock so
+ * it is frozen while the game is paused.
+ */
 void game_count(void);
-void show_count(void);
 void reset_count(void);
+void stop_count(void);
 uint16_t get_count(void);
+
+/* The same as above but for a given game clock time rather than now.
+ * count_expired_at() is a cheap test for get_count_at() returning 0.
+ */
+void reset_count_at(uint32_t now);
+uint16_t get_count_at(uint32_t now);
+uint8_t count_expired_at(uint32_t now);
+/* The ms of the round left at the given game clock time, and setting it
+ * (for a save state - see savestate.h).
+ */
+uint16_t get_count_left_at(uint32_t now);
+void set_count_left_at(uint32_t now, uint16_t left);
+/* While deferred (defer is 1) the timer interrupt doesn't bring the count
+ * on the seven segment display up to date - it catches up afterwards.
+ */
+void defer_count(uint8_t defer);
+/* Sound the buzzer at the given frequency (Hz) for 0.6s if the sound
+ * switch is on. Returns straight away.
+ */
 void make_noise(uint16_t tone);
-void pause(void);
-void unpause(void);
+/* Stop the game clock (get_current_time()) and start it again from where
+ * it stopped.
+ */
+void pause_clock(void);
+void unpause_clock(void);
 
 #endif
\ No newline at end of file